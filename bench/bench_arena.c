@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "document.h"
+
+// Compares the per-node malloc/free tree against the arena-backed JsonDocument
+// (with and without zero-copy strings) on the same synthetic document, parsed
+// and discarded many times.
+
+#define DEFAULT_RECORDS 2000
+#define DEFAULT_ITERATIONS 200
+#define RECORD_SIZE 160
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_document(int records) {
+  size_t capacity = (size_t)records * RECORD_SIZE + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  text[length++] = '[';
+  for (int i = 0; i < records; ++i) {
+    length += snprintf(text + length, capacity - length,
+      "%s{\"id\": %d, \"name\": \"user%d\", \"active\": %s, \"score\": %d.%02d, "
+      "\"tags\": [\"a\", \"b\", \"c\"], \"parent\": null}",
+      i > 0 ? ", " : "", i, i, i % 2 ? "true" : "false", i % 100, i % 97);
+  }
+  text[length++] = ']';
+  text[length] = '\0';
+
+  return text;
+}
+
+static double bench_heap(const char* text, int iterations) {
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    TokenizerState tokenizer = init_tokenizer(text);
+    ParserState parser_state = init_pull_parser(&tokenizer);
+    ParseError error;
+    JsonValue* root = parse_json_text(&parser_state, &error);
+    if (!root) {
+      print_error(&error, false);
+      return -1;
+    }
+    free_json_value(root);
+    free_parser_state(&parser_state);
+  }
+  return now_seconds() - start;
+}
+
+static double bench_arena(const char* text, int iterations, const bool zero_copy) {
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = zero_copy;
+
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    ParseError error;
+    if (!parse_json_document(&document, text, &error)) {
+      print_error(&error, false);
+      return -1;
+    }
+    reset_json_document(&document);
+  }
+  double elapsed = now_seconds() - start;
+
+  free_json_document(&document);
+  return elapsed;
+}
+
+int main(int argc, char** argv) {
+  int records = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  char* text = generate_document(records);
+  if (!text) {
+    return 1;
+  }
+
+  double megabytes = strlen(text) * (double)iterations / (1024 * 1024);
+  double heap = bench_heap(text, iterations);
+  double arena = bench_arena(text, iterations, false);
+  double zero_copy = bench_arena(text, iterations, true);
+  if (heap < 0 || arena < 0 || zero_copy < 0) {
+    free(text);
+    return 1;
+  }
+
+  printf("records: %d, iterations: %d, document: %zu bytes\n", records, iterations, strlen(text));
+  printf("%-17s %10.3f s %10.1f MB/s %12.0f docs/s\n", "heap", heap, megabytes / heap, iterations / heap);
+  printf("%-17s %10.3f s %10.1f MB/s %12.0f docs/s\n", "arena", arena, megabytes / arena, iterations / arena);
+  printf("%-17s %10.3f s %10.1f MB/s %12.0f docs/s\n", "arena (zero-copy)", zero_copy, megabytes / zero_copy, iterations / zero_copy);
+  printf("speedup: %.2fx (zero-copy: %.2fx)\n", heap / arena, heap / zero_copy);
+
+  free(text);
+  return 0;
+}
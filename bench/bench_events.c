@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "document.h"
+#include "events.h"
+
+// Sums the "price" of every record of a large array and counts the keys, from
+// a tree (heap and arena) and from parse events with a handler that only
+// looks at the numbers following a "price" key: nothing is allocated for the
+// values it ignores.
+
+#define DEFAULT_RECORDS 20000
+#define DEFAULT_ITERATIONS 20
+#define RECORD_SIZE 256
+
+typedef struct totals {
+  double price;
+  long keys;
+} Totals;
+
+typedef struct priceCounter {
+  Totals totals;
+  bool at_price; // the last key read was "price"
+} PriceCounter;
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_document(int records) {
+  size_t capacity = (size_t)records * RECORD_SIZE + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  length += snprintf(text + length, capacity - length, "[");
+  for (int i = 0; i < records; ++i) {
+    length += snprintf(text + length, capacity - length,
+      "{\"id\": %d, \"name\": \"item %d\", \"price\": %d.%02d, \"active\": %s, "
+      "\"tags\": [\"alpha\", \"beta\"], \"note\": \"escaped \\\"quote\\\"\"}%s",
+      i, i, i % 1000, i % 100, i % 2 ? "true" : "false", i + 1 < records ? ", " : "");
+  }
+  length += snprintf(text + length, capacity - length, "]");
+
+  return text;
+}
+
+// Same walk for both trees: every record's keys, and its price
+static void sum_tree(const JsonValue* root, Totals* totals) {
+  *totals = (Totals){ 0 };
+  for (int i = 0; i < root->array->count; ++i) {
+    const JsonObject* record = root->array->elements[i]->object;
+    totals->keys += record->count;
+    int position = json_object_find(record, "price", 5);
+    if (position >= 0) {
+      totals->price += json_number_as_double(record->pairs[position]->value);
+    }
+  }
+}
+
+static bool count_key(void* context, const char* text, const int length, const bool has_escapes) {
+  (void)has_escapes;
+  PriceCounter* counter = context;
+  counter->totals.keys += 1;
+  counter->at_price = length == 5 && memcmp(text, "price", 5) == 0;
+  return true;
+}
+
+static bool sum_price(void* context, const char* text, const int length) {
+  (void)length; // strtod() stops at the end of the lexeme
+  PriceCounter* counter = context;
+  if (counter->at_price) {
+    counter->totals.price += strtod(text, NULL);
+    counter->at_price = false;
+  }
+  return true;
+}
+
+static double bench_tree(const char* text, const int iterations, Totals* totals) {
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    TokenizerState tokenizer = init_tokenizer(text);
+    ParserState state = init_pull_parser(&tokenizer);
+    ParseError error;
+    JsonValue* root = parse_json_text(&state, &error);
+    free_parser_state(&state);
+    if (!root) {
+      print_error(&error, false);
+      return -1;
+    }
+    sum_tree(root, totals);
+    free_json_value(root);
+  }
+  return now_seconds() - start;
+}
+
+static double bench_document(const char* text, const int iterations, Totals* totals) {
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = true;
+
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    ParseError error;
+    JsonValue* root = parse_json_document(&document, text, &error);
+    if (!root) {
+      print_error(&error, false);
+      free_json_document(&document);
+      return -1;
+    }
+    sum_tree(root, totals);
+  }
+  double elapsed = now_seconds() - start;
+
+  free_json_document(&document);
+  return elapsed;
+}
+
+static double bench_events(const char* text, const int iterations, Totals* totals) {
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    PriceCounter counter = { .totals = { 0 }, .at_price = false };
+    JsonEventHandler handler = { .context = &counter, .on_key = count_key, .on_number = sum_price };
+
+    TokenizerState tokenizer = init_tokenizer(text);
+    ParserState state = init_pull_parser(&tokenizer);
+    ParseError error;
+    bool parsed = parse_json_text_events(&state, &handler, &error);
+    free_parser_state(&state);
+    if (!parsed) {
+      print_error(&error, false);
+      return -1;
+    }
+    *totals = counter.totals;
+  }
+  return now_seconds() - start;
+}
+
+int main(int argc, char** argv) {
+  int records = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  char* text = generate_document(records);
+  if (!text) {
+    return 1;
+  }
+
+  Totals totals[3];
+  double tree = bench_tree(text, iterations, &totals[0]);
+  double document = bench_document(text, iterations, &totals[1]);
+  double events = bench_events(text, iterations, &totals[2]);
+  if (tree < 0 || document < 0 || events < 0) {
+    free(text);
+    return 1;
+  }
+
+  for (int i = 1; i < 3; ++i) {
+    if (totals[i].keys != totals[0].keys || totals[i].price != totals[0].price) {
+      fprintf(stderr, "Error: results differ (%ld keys, %.2f vs %ld keys, %.2f)!\n",
+        totals[0].keys, totals[0].price, totals[i].keys, totals[i].price);
+      free(text);
+      return 1;
+    }
+  }
+
+  size_t length = strlen(text);
+  double megabytes = length * (double)iterations / (1024 * 1024);
+  printf("document: %zu bytes, %d records, %ld keys, price total %.2f, iterations: %d\n",
+    length, records, totals[0].keys, totals[0].price, iterations);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "full tree", tree, megabytes / tree);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "arena, zero-copy", document, megabytes / document);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "events", events, megabytes / events);
+  printf("speedup over full tree: %.2fx events\n", tree / events);
+
+  free(text);
+  return 0;
+}
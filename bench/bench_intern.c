@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "document.h"
+#include "key_table.h"
+
+// Parses a large array of records whose keys all come from a vocabulary of
+// 200, into heap trees and arena documents, with and without a KeyTable kept
+// across iterations. Reports time, allocations and arena bytes per parse,
+// then times looking up fields of every record by bytes and by interned key.
+// Allocations are counted by wrapping the allocator at link time (see the
+// Makefile).
+
+#define DEFAULT_RECORDS 50000
+#define DEFAULT_ITERATIONS 5
+#define VOCABULARY 200
+#define KEYS_PER_RECORD 24
+#define LOOKUPS 4
+#define RECORD_SIZE 768
+
+static size_t allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void __real_free(void* pointer);
+char* __real_strdup(const char* text);
+
+void* __wrap_malloc(size_t size) {
+  allocations += 1;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  allocations += 1;
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+  allocations += 1;
+  return __real_realloc(pointer, size);
+}
+
+void __wrap_free(void* pointer) {
+  __real_free(pointer);
+}
+
+char* __wrap_strdup(const char* text) {
+  allocations += 1;
+  return __real_strdup(text);
+}
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void field_name(char* name, const size_t size, const int field) {
+  snprintf(name, size, "field_%03d_%s", field, field % 3 ? "value" : "identifier");
+}
+
+// Record i has KEYS_PER_RECORD consecutive fields of the vocabulary from i % VOCABULARY on
+static char* generate_document(int records) {
+  size_t capacity = (size_t)records * RECORD_SIZE + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  length += snprintf(text + length, capacity - length, "[");
+  for (int i = 0; i < records; ++i) {
+    length += snprintf(text + length, capacity - length, "{");
+    for (int k = 0; k < KEYS_PER_RECORD; ++k) {
+      char name[32];
+      field_name(name, sizeof(name), (i + k) % VOCABULARY);
+      length += snprintf(text + length, capacity - length, "\"%s\": %d%s", name, i + k, k + 1 < KEYS_PER_RECORD ? ", " : "");
+    }
+    length += snprintf(text + length, capacity - length, "}%s", i + 1 < records ? ", " : "");
+  }
+  length += snprintf(text + length, capacity - length, "]");
+
+  return text;
+}
+
+static size_t arena_used(const Arena* arena) {
+  size_t used = 0;
+  for (const ArenaBlock* block = arena->first; block; block = block->next) {
+    used += block->used;
+  }
+  return used;
+}
+
+static bool bench_heap(const char* label, const char* text, KeyTable* keys, const int iterations) {
+  size_t before = allocations;
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    TokenizerState tokenizer = init_tokenizer(text);
+    ParserState state = init_pull_parser(&tokenizer);
+    state.keys = keys;
+    ParseError error;
+    JsonValue* root = parse_json_text(&state, &error);
+    free_parser_state(&state);
+    if (!root) {
+      print_error(&error, false);
+      return false;
+    }
+    free_json_value(root);
+  }
+  double elapsed = now_seconds() - start;
+
+  printf("%-24s %10.3f s %12.0f allocations/parse\n", label, elapsed, (double)(allocations - before) / iterations);
+  return true;
+}
+
+static bool bench_document(const char* label, const char* text, KeyTable* keys, const int iterations) {
+  JsonDocument document;
+  init_json_document(&document);
+  document.keys = keys;
+
+  size_t used = 0;
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    ParseError error;
+    if (!parse_json_document(&document, text, &error)) {
+      print_error(&error, false);
+      free_json_document(&document);
+      return false;
+    }
+    used = arena_used(&document.arena);
+  }
+  double elapsed = now_seconds() - start;
+
+  free_json_document(&document);
+  printf("%-24s %10.3f s %12.1f MB of arena/parse\n", label, elapsed, used / (1024.0 * 1024));
+  return true;
+}
+
+// Looks up LOOKUPS fields in every record, by bytes or by interned key
+static bool bench_lookups(const char* text, KeyTable* keys, const int iterations) {
+  JsonDocument document;
+  init_json_document(&document);
+  document.keys = keys;
+
+  ParseError error;
+  JsonValue* root = parse_json_document(&document, text, &error);
+  if (!root) {
+    print_error(&error, false);
+    free_json_document(&document);
+    return false;
+  }
+
+  char names[LOOKUPS][32];
+  const InternedKey* interned[LOOKUPS];
+  for (int k = 0; k < LOOKUPS; ++k) {
+    field_name(names[k], sizeof(names[k]), k * 50);
+    interned[k] = key_table_intern(keys, names[k], (int)strlen(names[k]));
+  }
+
+  long found[2] = { 0, 0 };
+  double elapsed[2];
+  for (int mode = 0; mode < 2; ++mode) {
+    double start = now_seconds();
+    for (int i = 0; i < iterations; ++i) {
+      for (int r = 0; r < root->array->count; ++r) {
+        const JsonObject* record = root->array->elements[r]->object;
+        for (int k = 0; k < LOOKUPS; ++k) {
+          int position = mode == 0 ? json_object_find(record, names[k], (int)strlen(names[k]))
+            : json_object_find_interned(record, interned[k]);
+          found[mode] += position >= 0;
+        }
+      }
+    }
+    elapsed[mode] = now_seconds() - start;
+  }
+
+  free_json_document(&document);
+  if (found[0] != found[1]) {
+    fprintf(stderr, "Error: lookups differ (%ld vs %ld found)!\n", found[0], found[1]);
+    return false;
+  }
+
+  long lookups = (long)iterations * root->array->count * LOOKUPS;
+  printf("%-24s %10.3f s %12.1f ns/lookup\n", "lookup by bytes", elapsed[0], elapsed[0] * 1e9 / lookups);
+  printf("%-24s %10.3f s %12.1f ns/lookup (%ld found)\n", "lookup by interned key", elapsed[1], elapsed[1] * 1e9 / lookups, found[1]);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int records = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  char* text = generate_document(records);
+  if (!text) {
+    return 1;
+  }
+
+  KeyTable keys;
+  init_key_table(&keys);
+
+  printf("document: %zu bytes, %d records of %d keys out of %d, iterations: %d\n",
+    strlen(text), records, KEYS_PER_RECORD, VOCABULARY, iterations);
+  bool ok = bench_heap("heap tree", text, NULL, iterations)
+    && bench_heap("heap tree, interned", text, &keys, iterations)
+    && bench_document("arena", text, NULL, iterations)
+    && bench_document("arena, interned", text, &keys, iterations)
+    && bench_lookups(text, &keys, iterations);
+
+  if (ok) {
+    printf("interned keys: %d\n", key_table_count(&keys));
+  }
+
+  free_key_table(&keys);
+  free(text);
+  return ok ? 0 : 1;
+}
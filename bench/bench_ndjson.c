@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "ndjson.h"
+#include "batch.h"
+
+// Validates a generated log of newline-delimited records: one record at a time
+// into a heap tree freed after each, then with parse_ndjson() (arena per
+// thread) on 1, 2, 4... threads up to the number of CPUs.
+
+#define DEFAULT_RECORDS 200000
+#define DEFAULT_ITERATIONS 3
+#define RECORD_SIZE 256
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_log(int records, size_t* length) {
+  size_t capacity = (size_t)records * RECORD_SIZE + 1;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark log!\n");
+    return NULL;
+  }
+
+  static const char* levels[] = { "debug", "info", "warn", "error" };
+  *length = 0;
+  for (int i = 0; i < records; ++i) {
+    *length += snprintf(text + *length, capacity - *length,
+      "{\"ts\": %d, \"level\": \"%s\", \"service\": \"api-%d\", \"latency_ms\": %d.%d, "
+      "\"message\": \"request %d served\", \"tags\": [\"http\", \"v%d\"]}\n",
+      1700000000 + i, levels[i % 4], i % 16, i % 500, i % 10, i, i % 3);
+  }
+  return text;
+}
+
+// The straightforward loop: cut at newlines, parse each record on its own
+static double bench_sequential(char* text, const size_t length, const int iterations, long* records) {
+  double start = now_seconds();
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    *records = 0;
+    char* line = text;
+    while (line < text + length) {
+      char* newline = memchr(line, '\n', text + length - line);
+      *newline = '\0';
+
+      TokenizerState tokenizer = init_tokenizer(line);
+      ParserState state = init_pull_parser(&tokenizer);
+      ParseError error;
+      JsonValue* root = parse_json_text(&state, &error);
+      free_parser_state(&state);
+      *newline = '\n';
+      if (!root) {
+        print_error(&error, false);
+        return -1;
+      }
+      free_json_value(root);
+
+      *records += 1;
+      line = newline + 1;
+    }
+  }
+  return now_seconds() - start;
+}
+
+static double bench_parallel(const char* text, const size_t length, const int threads, const int iterations, long* records) {
+  NdjsonOptions options = { .threads = threads, .max_depth = 0, .chunk_size = 0, .color_enabled = false };
+
+  double start = now_seconds();
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    NdjsonSummary summary;
+    if (!parse_ndjson(text, length, &options, &summary) || summary.failed > 0) {
+      return -1;
+    }
+    *records = summary.records;
+  }
+  return now_seconds() - start;
+}
+
+int main(int argc, char** argv) {
+  int record_count = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  size_t length;
+  char* text = generate_log(record_count, &length);
+  if (!text) {
+    return 1;
+  }
+
+  long records = 0;
+  double sequential = bench_sequential(text, length, iterations, &records);
+  if (sequential < 0) {
+    free(text);
+    return 1;
+  }
+
+  double megabytes = length * (double)iterations / (1024 * 1024);
+  printf("log: %zu bytes, %ld records, iterations: %d\n", length, records, iterations);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "heap tree per record", sequential, megabytes / sequential);
+
+  int cpus = online_cpus();
+  for (int threads = 1; ; threads *= 2) {
+    if (threads > cpus) {
+      threads = cpus;
+    }
+
+    long parsed = 0;
+    double elapsed = bench_parallel(text, length, threads, iterations, &parsed);
+    if (elapsed < 0 || parsed != records) {
+      fprintf(stderr, "Error: parse_ndjson() failed on %d threads!\n", threads);
+      free(text);
+      return 1;
+    }
+
+    char label[32];
+    snprintf(label, sizeof(label), "parse_ndjson, %d thread%s", threads, threads == 1 ? "" : "s");
+    printf("%-24s %10.3f s %10.1f MB/s %6.2fx\n", label, elapsed, megabytes / elapsed, sequential / elapsed);
+
+    if (threads == cpus) {
+      break;
+    }
+  }
+
+  free(text);
+  return 0;
+}
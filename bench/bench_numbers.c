@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+
+// Sums a numeric array several times, once by re-running strtod() on each
+// lexeme (what consumers had to do when numbers were kept as text) and once
+// through the values decoded by the tokenizer.
+
+#define DEFAULT_ELEMENTS 1000000
+#define DEFAULT_PASSES 10
+#define CHARS_PER_ELEMENT 24
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Half integers, half decimals with a few digits of fraction
+static char* generate_array(long elements) {
+  size_t capacity = (size_t)elements * CHARS_PER_ELEMENT + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  unsigned int seed = 42;
+  size_t length = 0;
+  text[length++] = '[';
+  for (long i = 0; i < elements; ++i) {
+    seed = seed * 1103515245 + 12345;
+    if (i % 2) {
+      length += snprintf(text + length, capacity - length, "%s%u.%03u", i > 0 ? "," : "", seed >> 12, seed % 1000);
+    } else {
+      length += snprintf(text + length, capacity - length, "%s%u", i > 0 ? "," : "", seed);
+    }
+  }
+  text[length++] = ']';
+  text[length] = '\0';
+
+  return text;
+}
+
+static double sum_text(const JsonArray* array) {
+  double sum = 0;
+  for (int i = 0; i < array->count; ++i) {
+    sum += strtod(array->elements[i]->number, NULL);
+  }
+  return sum;
+}
+
+static double sum_decoded(const JsonArray* array) {
+  double sum = 0;
+  for (int i = 0; i < array->count; ++i) {
+    sum += json_number_as_double(array->elements[i]);
+  }
+  return sum;
+}
+
+int main(int argc, char** argv) {
+  long elements = argc > 1 ? atol(argv[1]) : DEFAULT_ELEMENTS;
+  int passes = argc > 2 ? atoi(argv[2]) : DEFAULT_PASSES;
+
+  char* text = generate_array(elements);
+  if (!text) {
+    return 1;
+  }
+
+  TokenizerState tokenizer = init_tokenizer(text);
+  ParserState parser_state = init_pull_parser(&tokenizer);
+  ParseError error;
+  JsonValue* root = parse_json_text(&parser_state, &error);
+  if (!root) {
+    print_error(&error, false);
+    free(text);
+    return 1;
+  }
+
+  double start = now_seconds();
+  double text_sum = 0;
+  for (int i = 0; i < passes; ++i) {
+    text_sum += sum_text(root->array);
+  }
+  double text_time = now_seconds() - start;
+
+  start = now_seconds();
+  double decoded_sum = 0;
+  for (int i = 0; i < passes; ++i) {
+    decoded_sum += sum_decoded(root->array);
+  }
+  double decoded_time = now_seconds() - start;
+
+  printf("numbers: %ld, passes: %d\n", elements, passes);
+  printf("%-8s %10.3f s %10.1f ns/number (sum %.6g)\n", "strtod", text_time, text_time * 1e9 / ((double)elements * passes), text_sum);
+  printf("%-8s %10.3f s %10.1f ns/number (sum %.6g)\n", "decoded", decoded_time, decoded_time * 1e9 / ((double)elements * passes), decoded_sum);
+  printf("speedup: %.1fx\n", text_time / decoded_time);
+
+  free_json_value(root);
+  free_parser_state(&parser_state);
+  free(text);
+  return 0;
+}
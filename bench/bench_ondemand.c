@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "document.h"
+#include "ondemand.h"
+#include "path.h"
+
+// Reads five fields out of a large API response: by parsing the whole tree
+// (heap and arena) and with the on-demand cursor, skipping the rest of the
+// document either by counting brackets or by validating it.
+
+#define DEFAULT_RECORDS 1000
+#define DEFAULT_ITERATIONS 200
+#define RECORD_SIZE 256
+
+static const char* queries[] = {
+  "/status",
+  "/meta/request_id",
+  "/items/0/name",
+  "/items/499/tags/1",
+  "/paging/next",
+};
+
+#define QUERY_COUNT ((int)(sizeof(queries) / sizeof(queries[0])))
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_document(int records) {
+  size_t capacity = (size_t)records * RECORD_SIZE + 256;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  length += snprintf(text + length, capacity - length,
+    "{\"status\": \"ok\", \"meta\": {\"request_id\": \"r-1234\", \"elapsed_ms\": 12.5}, \"items\": [");
+  for (int i = 0; i < records; ++i) {
+    length += snprintf(text + length, capacity - length,
+      "{\"id\": %d, \"name\": \"item %d\", \"price\": %d.%02d, \"active\": %s, "
+      "\"tags\": [\"alpha\", \"beta\", \"gamma\"], \"note\": \"escaped \\\"quote\\\" and \\u00e9\"}%s",
+      i, i, i * 3, i % 100, i % 2 ? "true" : "false", i + 1 < records ? ", " : "");
+  }
+  length += snprintf(text + length, capacity - length, "], \"paging\": {\"next\": \"/items?page=2\"}}");
+
+  return text;
+}
+
+static int count_found(JsonValue* root, const JsonPath* paths) {
+  int found = 0;
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    found += json_path_get(&paths[i], root) != NULL;
+  }
+  return found;
+}
+
+static double bench_tree(const char* text, const JsonPath* paths, const int iterations, int* found) {
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    TokenizerState tokenizer = init_tokenizer(text);
+    ParserState state = init_pull_parser(&tokenizer);
+    ParseError error;
+    JsonValue* root = parse_json_text(&state, &error);
+    free_parser_state(&state);
+    if (!root) {
+      print_error(&error, false);
+      return -1;
+    }
+    *found = count_found(root, paths);
+    free_json_value(root);
+  }
+  return now_seconds() - start;
+}
+
+static double bench_document(const char* text, const JsonPath* paths, const int iterations, int* found) {
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = true;
+
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    ParseError error;
+    JsonValue* root = parse_json_document(&document, text, &error);
+    if (!root) {
+      print_error(&error, false);
+      free_json_document(&document);
+      return -1;
+    }
+    *found = count_found(root, paths);
+  }
+  double elapsed = now_seconds() - start;
+
+  free_json_document(&document);
+  return elapsed;
+}
+
+static double bench_ondemand(const char* text, const JsonPath* paths, const bool validate, const int iterations, int* found) {
+  OnDemandDocument document;
+  init_ondemand_document(&document);
+  document.zero_copy = true;
+  document.validate = validate;
+
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    ParseError error;
+    JsonCursor root;
+    if (!ondemand_root(&document, text, &root, &error)) {
+      print_error(&error, false);
+      free_ondemand_document(&document);
+      return -1;
+    }
+
+    *found = 0;
+    for (int q = 0; q < QUERY_COUNT; ++q) {
+      JsonCursor cursor;
+      CursorResult result = json_cursor_path(&root, &paths[q], &cursor, &error);
+      if (result == CURSOR_ERROR || (result == CURSOR_FOUND && !json_cursor_value(&cursor, &error))) {
+        print_error(&error, false);
+        free_ondemand_document(&document);
+        return -1;
+      }
+      *found += result == CURSOR_FOUND;
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  free_ondemand_document(&document);
+  return elapsed;
+}
+
+int main(int argc, char** argv) {
+  int records = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  char* text = generate_document(records);
+  if (!text) {
+    return 1;
+  }
+
+  JsonPath paths[QUERY_COUNT];
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    ParseError error;
+    if (!compile_json_pointer(&paths[i], queries[i], &error)) {
+      print_error(&error, false);
+      return 1;
+    }
+  }
+
+  int found[4] = { 0 };
+  double tree = bench_tree(text, paths, iterations, &found[0]);
+  double document = bench_document(text, paths, iterations, &found[1]);
+  double lazy = bench_ondemand(text, paths, false, iterations, &found[2]);
+  double checked = bench_ondemand(text, paths, true, iterations, &found[3]);
+  if (tree < 0 || document < 0 || lazy < 0 || checked < 0) {
+    free(text);
+    return 1;
+  }
+
+  if (found[0] != found[1] || found[1] != found[2] || found[2] != found[3]) {
+    fprintf(stderr, "Error: results differ (%d, %d, %d, %d)!\n", found[0], found[1], found[2], found[3]);
+    free(text);
+    return 1;
+  }
+
+  size_t length = strlen(text);
+  double megabytes = length * (double)iterations / (1024 * 1024);
+  printf("document: %zu bytes, %d of %d paths found, iterations: %d\n", length, found[0], QUERY_COUNT, iterations);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "full tree", tree, megabytes / tree);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "arena, zero-copy", document, megabytes / document);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "on demand", lazy, megabytes / lazy);
+  printf("%-24s %10.3f s %10.1f MB/s\n", "on demand, validated", checked, megabytes / checked);
+  printf("speedup over full tree: %.2fx on demand, %.2fx validated\n", tree / lazy, tree / checked);
+
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    free_json_path(&paths[i]);
+  }
+  free(text);
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "path.h"
+
+// Pulls a handful of fields out of many parsed documents three ways: walking
+// the pairs by hand with strcmp, evaluating each compiled path on its own, and
+// evaluating all of them at once through a JsonPathSet. Each document is an API
+// response with a wide top-level object (hashed lookup) and nested records.
+
+#define DEFAULT_DOCUMENTS 2000
+#define DEFAULT_ITERATIONS 200
+#define WIDE_FIELDS 64
+#define RECORDS 8
+#define DOCUMENT_SIZE 8192
+
+static const char* queries[] = {
+  "/status",
+  "/field63",
+  "/field07",
+  "/user/id",
+  "/user/name",
+  "/user/address/city",
+  "/records/0/id",
+  "/records/0/tags/1",
+  "/records/7/id",
+  "/records/7/score",
+  "/paging/next",
+  "/missing/key",
+};
+
+#define QUERY_COUNT ((int)(sizeof(queries) / sizeof(queries[0])))
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_document(int seed) {
+  char* text = malloc(DOCUMENT_SIZE);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  length += snprintf(text + length, DOCUMENT_SIZE - length, "{\"status\": \"ok\", ");
+  for (int i = 0; i < WIDE_FIELDS; ++i) {
+    length += snprintf(text + length, DOCUMENT_SIZE - length, "\"field%02d\": %d, ", i, seed + i);
+  }
+  length += snprintf(text + length, DOCUMENT_SIZE - length,
+    "\"user\": {\"id\": %d, \"name\": \"user %d\", \"address\": {\"city\": \"Jakarta\", \"zip\": \"%05d\"}}, "
+    "\"records\": [", seed, seed, seed % 100000);
+  for (int i = 0; i < RECORDS; ++i) {
+    length += snprintf(text + length, DOCUMENT_SIZE - length,
+      "{\"id\": %d, \"score\": %d.5, \"tags\": [\"alpha\", \"beta\"]}%s", seed * RECORDS + i, i, i + 1 < RECORDS ? ", " : "");
+  }
+  length += snprintf(text + length, DOCUMENT_SIZE - length, "], \"paging\": {\"next\": \"/page/%d\"}}", seed + 1);
+
+  return text;
+}
+
+static JsonValue* parse_document(const char* text) {
+  TokenizerState tokenizer = init_tokenizer(text);
+  ParserState state = init_pull_parser(&tokenizer);
+  ParseError error;
+  JsonValue* root = parse_json_text(&state, &error);
+  if (!root) {
+    print_error(&error, false);
+  }
+  free_parser_state(&state);
+  return root;
+}
+
+// The pre-existing way: split the pointer on every call and compare each key
+static JsonValue* walk_by_hand(JsonValue* value, const char* pointer) {
+  char key[64];
+  while (value && *pointer == '/') {
+    pointer += 1;
+    size_t length = strcspn(pointer, "/");
+    memcpy(key, pointer, length);
+    key[length] = '\0';
+    pointer += length;
+
+    JsonValue* next = NULL;
+    if (value->type == JSON_OBJECT) {
+      for (int i = 0; i < value->object->count; ++i) {
+        if (strcmp(value->object->pairs[i]->key, key) == 0) {
+          next = value->object->pairs[i]->value;
+          break;
+        }
+      }
+    } else if (value->type == JSON_ARRAY) {
+      int index = atoi(key);
+      next = index < value->array->count ? value->array->elements[index] : NULL;
+    }
+    value = next;
+  }
+  return value;
+}
+
+int main(int argc, char** argv) {
+  int documents = argc > 1 ? atoi(argv[1]) : DEFAULT_DOCUMENTS;
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  JsonValue** roots = malloc(sizeof(JsonValue*) * documents);
+  JsonPath* paths = malloc(sizeof(JsonPath) * QUERY_COUNT);
+  if (!roots || !paths) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark!\n");
+    return 1;
+  }
+
+  for (int i = 0; i < documents; ++i) {
+    char* text = generate_document(i);
+    roots[i] = text ? parse_document(text) : NULL;
+    free(text);
+    if (!roots[i]) {
+      return 1;
+    }
+  }
+
+  JsonPathSet set;
+  init_json_path_set(&set);
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    ParseError error;
+    if (!compile_json_pointer(&paths[i], queries[i], &error)) {
+      print_error(&error, false);
+      return 1;
+    }
+    json_path_set_add(&set, &paths[i]);
+  }
+
+  JsonValue* results[QUERY_COUNT];
+  long found[3] = { 0 };
+
+  double start = now_seconds();
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    for (int d = 0; d < documents; ++d) {
+      for (int q = 0; q < QUERY_COUNT; ++q) {
+        found[0] += walk_by_hand(roots[d], queries[q]) != NULL;
+      }
+    }
+  }
+  double by_hand = now_seconds() - start;
+
+  start = now_seconds();
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    for (int d = 0; d < documents; ++d) {
+      for (int q = 0; q < QUERY_COUNT; ++q) {
+        found[1] += json_path_get(&paths[q], roots[d]) != NULL;
+      }
+    }
+  }
+  double compiled = now_seconds() - start;
+
+  start = now_seconds();
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    for (int d = 0; d < documents; ++d) {
+      json_path_set_eval(&set, roots[d], results);
+      for (int q = 0; q < QUERY_COUNT; ++q) {
+        found[2] += results[q] != NULL;
+      }
+    }
+  }
+  double batched = now_seconds() - start;
+
+  if (found[0] != found[1] || found[1] != found[2]) {
+    fprintf(stderr, "Error: results differ (%ld, %ld, %ld)!\n", found[0], found[1], found[2]);
+    return 1;
+  }
+
+  double lookups = (double)documents * iterations * QUERY_COUNT / 1e6;
+  printf("documents: %d, paths: %d, iterations: %d\n", documents, QUERY_COUNT, iterations);
+  printf("%-16s %10.3f s %10.1f M lookups/s\n", "by hand", by_hand, lookups / by_hand);
+  printf("%-16s %10.3f s %10.1f M lookups/s\n", "compiled", compiled, lookups / compiled);
+  printf("%-16s %10.3f s %10.1f M lookups/s\n", "path set", batched, lookups / batched);
+  printf("speedup: %.2fx compiled, %.2fx path set\n", by_hand / compiled, by_hand / batched);
+
+  for (int i = 0; i < QUERY_COUNT; ++i) {
+    free_json_path(&paths[i]);
+  }
+  free_json_path_set(&set);
+  for (int i = 0; i < documents; ++i) {
+    free_json_value(roots[i]);
+  }
+  free(paths);
+  free(roots);
+  return 0;
+}
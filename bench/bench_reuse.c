@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "document.h"
+
+// Parses a stream of small API requests (1-4 KB) the way a service would:
+// from scratch for every request (token array, heap tree, a new document each
+// time) and with one JsonDocument kept for all of them. Allocations are
+// counted by wrapping the allocator at link time (see the Makefile), so the
+// steady state of a reused document can be checked to be allocation-free.
+
+#define DEFAULT_REQUESTS 200000
+#define VARIANTS 64
+#define REQUEST_SIZE 8192
+
+static size_t allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void __real_free(void* pointer);
+char* __real_strdup(const char* text);
+
+void* __wrap_malloc(size_t size) {
+  allocations += 1;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  allocations += 1;
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+  allocations += 1;
+  return __real_realloc(pointer, size);
+}
+
+void __wrap_free(void* pointer) {
+  __real_free(pointer);
+}
+
+char* __wrap_strdup(const char* text) {
+  allocations += 1;
+  return __real_strdup(text);
+}
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Between 1 and 4 KB: a few header fields and 8 to 47 line items
+static char* generate_request(int seed) {
+  char* text = malloc(REQUEST_SIZE);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark request!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  length += snprintf(text + length, REQUEST_SIZE - length,
+    "{\"id\": \"req-%06d\", \"user\": {\"id\": %d, \"name\": \"user %d\", \"roles\": [\"reader\", \"writer\"]}, "
+    "\"note\": \"line\\nbreak \\\"quoted\\\"\", \"items\": [", seed, seed * 7, seed);
+  int items = 8 + seed % 40;
+  for (int i = 0; i < items; ++i) {
+    length += snprintf(text + length, REQUEST_SIZE - length,
+      "{\"sku\": \"SKU-%05d\", \"qty\": %d, \"price\": %d.%02d, \"gift\": %s}%s",
+      seed * 31 + i, 1 + i % 5, 3 + i, i % 100, i % 3 ? "false" : "true", i + 1 < items ? ", " : "");
+  }
+  length += snprintf(text + length, REQUEST_SIZE - length, "], \"total\": %d.50}", seed % 1000);
+
+  return text;
+}
+
+typedef enum reuseMode {
+  MODE_TOKENIZED,     // tokenize(), parse the token array into a heap tree, free both
+  MODE_PULLED,        // pull tokens into a heap tree, free it
+  MODE_NEW_DOCUMENT,  // a new JsonDocument per request
+  MODE_KEPT_DOCUMENT, // one JsonDocument for every request
+} ReuseMode;
+
+static bool parse_request(const ReuseMode mode, JsonDocument* document, const char* text) {
+  ParseError error;
+  JsonValue* root = NULL;
+
+  switch (mode) {
+    case MODE_TOKENIZED: {
+      TokenList tokens;
+      if (!tokenize(text, &tokens)) {
+        return false;
+      }
+      ParserState state = { .tokens = &tokens, .current_index = 0 };
+      root = parse_json_text(&state, &error);
+      free_json_value(root);
+      free_token_list(&tokens);
+      break;
+    }
+
+    case MODE_PULLED: {
+      TokenizerState tokenizer = init_tokenizer(text);
+      ParserState state = init_pull_parser(&tokenizer);
+      root = parse_json_text(&state, &error);
+      free_parser_state(&state);
+      free_json_value(root);
+      break;
+    }
+
+    case MODE_NEW_DOCUMENT: {
+      JsonDocument fresh;
+      init_json_document(&fresh);
+      root = parse_json_document(&fresh, text, &error);
+      free_json_document(&fresh);
+      break;
+    }
+
+    case MODE_KEPT_DOCUMENT: {
+      root = parse_json_document(document, text, &error);
+      break;
+    }
+  }
+
+  if (!root) {
+    print_error(&error, false);
+  }
+  return root != NULL;
+}
+
+static bool bench_mode(const char* label, const ReuseMode mode, char** requests, const int count) {
+  JsonDocument document;
+  init_json_document(&document);
+
+  // One pass to warm up, so a kept document has grown to fit every request
+  for (int i = 0; i < VARIANTS; ++i) {
+    if (!parse_request(mode, &document, requests[i])) {
+      free_json_document(&document);
+      return false;
+    }
+  }
+
+  size_t before = allocations;
+  double start = now_seconds();
+  for (int i = 0; i < count; ++i) {
+    if (!parse_request(mode, &document, requests[i % VARIANTS])) {
+      free_json_document(&document);
+      return false;
+    }
+  }
+  double elapsed = now_seconds() - start;
+  size_t allocated = allocations - before;
+
+  free_json_document(&document);
+  printf("%-28s %10.3f s %12.0f req/s %10.1f allocations/req\n", label, elapsed, count / elapsed, (double)allocated / count);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : DEFAULT_REQUESTS;
+
+  char* requests[VARIANTS];
+  size_t bytes = 0;
+  for (int i = 0; i < VARIANTS; ++i) {
+    requests[i] = generate_request(i);
+    if (!requests[i]) {
+      return 1;
+    }
+    bytes += strlen(requests[i]);
+  }
+
+  printf("requests: %d, %d variants of %zu bytes on average\n", count, VARIANTS, bytes / VARIANTS);
+  bool ok = bench_mode("token array, heap tree", MODE_TOKENIZED, requests, count)
+    && bench_mode("pulled, heap tree", MODE_PULLED, requests, count)
+    && bench_mode("new document per request", MODE_NEW_DOCUMENT, requests, count)
+    && bench_mode("kept document", MODE_KEPT_DOCUMENT, requests, count);
+
+  for (int i = 0; i < VARIANTS; ++i) {
+    free(requests[i]);
+  }
+  return ok ? 0 : 1;
+}
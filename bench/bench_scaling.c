@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+
+// Parses flat arrays of 1K..10M numbers and objects of 1K..1M keys and reports
+// the cost per element, which stays flat when container growth is amortized
+// O(1) and duplicate-key detection is hashed.
+
+#define MIN_ELEMENTS 1000
+#define DEFAULT_MAX_ELEMENTS 10000000
+#define DEFAULT_MAX_KEYS 1000000
+#define DIGITS_PER_ELEMENT 12
+#define CHARS_PER_KEY 32
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_array(long elements) {
+  size_t capacity = (size_t)elements * DIGITS_PER_ELEMENT + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  text[length++] = '[';
+  for (long i = 0; i < elements; ++i) {
+    length += snprintf(text + length, capacity - length, "%s%ld", i > 0 ? "," : "", i);
+  }
+  text[length++] = ']';
+  text[length] = '\0';
+
+  return text;
+}
+
+static char* generate_object(long keys) {
+  size_t capacity = (size_t)keys * CHARS_PER_KEY + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  text[length++] = '{';
+  for (long i = 0; i < keys; ++i) {
+    length += snprintf(text + length, capacity - length, "%s\"key%ld\":%ld", i > 0 ? "," : "", i, i);
+  }
+  text[length++] = '}';
+  text[length] = '\0';
+
+  return text;
+}
+
+static bool run_scaling(const char* label, char* (*generate)(long), const long max_elements) {
+  printf("%12s %12s %14s\n", label, "parse (s)", "ns/element");
+  for (long elements = MIN_ELEMENTS; elements <= max_elements; elements *= 10) {
+    char* text = generate(elements);
+    if (!text) {
+      return false;
+    }
+
+    TokenizerState tokenizer = init_tokenizer(text);
+    tokenizer.zero_copy = true;
+    ParserState parser_state = init_pull_parser(&tokenizer);
+    ParseError error;
+
+    double start = now_seconds();
+    JsonValue* root = parse_json_text(&parser_state, &error);
+    double elapsed = now_seconds() - start;
+
+    if (!root) {
+      print_error(&error, false);
+      free(text);
+      return false;
+    }
+
+    printf("%12ld %12.4f %14.1f\n", elements, elapsed, elapsed * 1e9 / elements);
+
+    free_json_value(root);
+    free_parser_state(&parser_state);
+    free(text);
+  }
+
+  printf("\n");
+  return true;
+}
+
+int main(int argc, char** argv) {
+  long max_elements = argc > 1 ? atol(argv[1]) : DEFAULT_MAX_ELEMENTS;
+  long max_keys = argc > 2 ? atol(argv[2]) : DEFAULT_MAX_KEYS;
+
+  if (!run_scaling("elements", generate_array, max_elements) ||
+    !run_scaling("keys", generate_object, max_keys)) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "document.h"
+#include "simd_scan.h"
+
+// Parses a string-heavy document with each string scanning implementation
+// available on this CPU and reports the throughput of each.
+
+#define DEFAULT_STRINGS 20000
+#define DEFAULT_STRING_LENGTH 1000
+#define DEFAULT_ITERATIONS 20
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_document(int strings, int string_length) {
+  size_t capacity = (size_t)strings * (string_length + 4) + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  unsigned int seed = 42;
+  size_t length = 0;
+  text[length++] = '[';
+  for (int i = 0; i < strings; ++i) {
+    if (i > 0) {
+      text[length++] = ',';
+    }
+    text[length++] = '"';
+    for (int j = 0; j < string_length; ++j) {
+      seed = seed * 1103515245 + 12345;
+      text[length++] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"[(seed >> 16) % 63];
+    }
+    text[length++] = '"';
+  }
+  text[length++] = ']';
+  text[length] = '\0';
+
+  return text;
+}
+
+static double bench_level(const char* text, const ScanLevel level, const int iterations) {
+  set_scan_level(level);
+
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = true;
+
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    ParseError error;
+    if (!parse_json_document(&document, text, &error)) {
+      print_error(&error, false);
+      free_json_document(&document);
+      return -1;
+    }
+    reset_json_document(&document);
+  }
+  double elapsed = now_seconds() - start;
+
+  free_json_document(&document);
+  return elapsed;
+}
+
+int main(int argc, char** argv) {
+  int strings = argc > 1 ? atoi(argv[1]) : DEFAULT_STRINGS;
+  int string_length = argc > 2 ? atoi(argv[2]) : DEFAULT_STRING_LENGTH;
+  int iterations = argc > 3 ? atoi(argv[3]) : DEFAULT_ITERATIONS;
+
+  char* text = generate_document(strings, string_length);
+  if (!text) {
+    return 1;
+  }
+
+  double megabytes = strlen(text) * (double)iterations / (1024 * 1024);
+  printf("strings: %d x %d bytes, iterations: %d\n", strings, string_length, iterations);
+
+  double scalar = 0;
+  for (ScanLevel level = SCAN_SCALAR; level <= detect_scan_level(); ++level) {
+    double elapsed = bench_level(text, level, iterations);
+    if (elapsed < 0) {
+      free(text);
+      return 1;
+    }
+
+    if (level == SCAN_SCALAR) {
+      scalar = elapsed;
+    }
+    printf("%-8s %10.3f s %10.1f MB/s %8.2fx\n",
+      scan_level_to_string(level), elapsed, megabytes / elapsed, scalar / elapsed);
+  }
+
+  free(text);
+  return 0;
+}
@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "tokenizer.h"
+#include "parser.h"
+#include "json.h"
+#include "writer.h"
+#include "simd_scan.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Regression suite: generates synthetic corpora from a fixed seed (deep
+// nesting, wide objects, long strings, number-heavy arrays, API and log
+// payloads) at sizes from 1 KB up to --max-size, and times tokenize, parse,
+// free and serialize separately on each. Reports MB/s, allocations per
+// document and peak RSS as JSON, so the output of two versions can be diffed.
+//
+// Allocations are counted by wrapping the allocator at link time:
+//   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free,--wrap=strdup
+// (see the bench_suite rule in the Makefile). strndup() is ours (helper.c) and
+// allocates through malloc(), so it is counted without a wrapper.
+
+#define SEED 0x4A534F4E5041ULL
+#define MIN_SIZE 1024
+#define SIZE_STEP 32
+#define DEFAULT_MAX_SIZE (32 * 1024 * 1024)
+#define DEFAULT_MIN_TIME 0.5
+#define MAX_ITERATIONS 100000
+#define DEEP_LEVELS 200
+#define PATH_SIZE 512
+
+// ---- allocation counting ----
+
+typedef struct allocationCount {
+  size_t allocations;
+  size_t frees;
+} AllocationCount;
+
+static AllocationCount counted = { 0, 0 };
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void __real_free(void* pointer);
+char* __real_strdup(const char* text);
+
+void* __wrap_malloc(size_t size) {
+  counted.allocations += 1;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  counted.allocations += 1;
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+  counted.allocations += 1;
+  return __real_realloc(pointer, size);
+}
+
+void __wrap_free(void* pointer) {
+  if (pointer) {
+    counted.frees += 1;
+  }
+  __real_free(pointer);
+}
+
+char* __wrap_strdup(const char* text) {
+  counted.allocations += 1;
+  return __real_strdup(text);
+}
+
+// ---- measurements ----
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Linux can reset the high-water mark between cases; elsewhere the peak only grows
+static void reset_peak_rss() {
+#ifdef __linux__
+  FILE* file = fopen("/proc/self/clear_refs", "w");
+  if (file) {
+    fputs("5", file);
+    fclose(file);
+  }
+#endif
+}
+
+static size_t peak_rss_bytes() {
+#ifdef __linux__
+  FILE* file = fopen("/proc/self/status", "r");
+  if (file) {
+    char line[256];
+    size_t kilobytes = 0;
+    while (fgets(line, sizeof(line), file)) {
+      if (sscanf(line, "VmHWM: %zu kB", &kilobytes) == 1) {
+        break;
+      }
+    }
+    fclose(file);
+    if (kilobytes > 0) {
+      return kilobytes * 1024;
+    }
+  }
+#endif
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    return (size_t)usage.ru_maxrss * 1024;
+  }
+#endif
+  return 0;
+}
+
+// ---- corpus generation ----
+
+typedef struct textBuffer {
+  char* data;
+  size_t length;
+  size_t capacity;
+} TextBuffer;
+
+static uint64_t random_state = SEED;
+
+// xorshift64*: same sequence on every platform for a given seed
+static uint64_t next_random() {
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned int random_below(const unsigned int bound) {
+  return (unsigned int)(next_random() >> 32) % bound;
+}
+
+static bool reserve_text(TextBuffer* buffer, const size_t extra) {
+  if (buffer->length + extra + 1 <= buffer->capacity) {
+    return true;
+  }
+
+  size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+  while (capacity < buffer->length + extra + 1) {
+    capacity *= 2;
+  }
+
+  char* data = realloc(buffer->data, capacity);
+  if (!data) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark corpus!\n");
+    return false;
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return true;
+}
+
+static bool append(TextBuffer* buffer, const char* text) {
+  size_t length = strlen(text);
+  if (!reserve_text(buffer, length)) {
+    return false;
+  }
+  memcpy(buffer->data + buffer->length, text, length + 1);
+  buffer->length += length;
+  return true;
+}
+
+static bool append_format(TextBuffer* buffer, const char* format, ...) {
+  char text[1024];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  return append(buffer, text);
+}
+
+static const char* words[] = {
+  "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+  "india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static const char* word() {
+  return words[random_below(WORD_COUNT)];
+}
+
+// Prose with the occasional escape and multi-byte UTF-8 character
+static bool append_text(TextBuffer* buffer, const int word_count) {
+  bool ok = true;
+  for (int i = 0; ok && i < word_count; ++i) {
+    unsigned int roll = random_below(32);
+    const char* separator = i == 0 ? "" : " ";
+    if (roll == 0) {
+      ok = append_format(buffer, "%s\\\"%s\\\"", separator, word());
+    } else if (roll == 1) {
+      ok = append_format(buffer, "%s%s\\n", separator, word());
+    } else if (roll == 2) {
+      ok = append_format(buffer, "%scaf\xC3\xA9 \\u00e9t\\u00e9", separator);
+    } else if (roll == 3) {
+      ok = append_format(buffer, "%s\xE2\x82\xAC%u", separator, random_below(1000));
+    } else {
+      ok = append_format(buffer, "%s%s", separator, word());
+    }
+  }
+  return ok;
+}
+
+static bool append_double(TextBuffer* buffer) {
+  switch (random_below(4)) {
+    case 0: return append_format(buffer, "%u.%02u", random_below(100000), random_below(100));
+    case 1: return append_format(buffer, "-%u.%06u", random_below(1000), random_below(1000000));
+    case 2: return append_format(buffer, "%u.%ue%d", random_below(10), random_below(1000), (int)random_below(40) - 20);
+    default: return append_format(buffer, "%.17g", (double)(next_random() >> 11) / 9007199254740992.0);
+  }
+}
+
+static bool append_deep(TextBuffer* buffer, const size_t element) {
+  bool ok = true;
+  for (int level = 0; ok && level < DEEP_LEVELS; ++level) {
+    ok = append(buffer, level % 2 == 0 ? "{\"level\":[" : "[");
+  }
+  ok = ok && append_format(buffer, "%zu", element);
+  for (int level = DEEP_LEVELS - 1; ok && level >= 0; --level) {
+    ok = append(buffer, level % 2 == 0 ? "]}" : "]");
+  }
+  return ok;
+}
+
+static bool append_wide_member(TextBuffer* buffer, const size_t element) {
+  if (!append_format(buffer, "\"key_%08zu\":", element)) {
+    return false;
+  }
+  switch (random_below(4)) {
+    case 0: return append_format(buffer, "%u", random_below(1000000));
+    case 1: return append_format(buffer, "\"%s\"", word());
+    case 2: return append(buffer, random_below(2) ? "true" : "false");
+    default: return append(buffer, "null");
+  }
+}
+
+static bool append_long_string(TextBuffer* buffer) {
+  return append(buffer, "\"") && append_text(buffer, 150 + random_below(500)) && append(buffer, "\"");
+}
+
+static bool append_number(TextBuffer* buffer) {
+  switch (random_below(3)) {
+    case 0: return append_format(buffer, "%u", random_below(1000000));
+    case 1: return append_format(buffer, "-%llu", (unsigned long long)(next_random() >> 1));
+    default: return append_double(buffer);
+  }
+}
+
+static bool append_api_record(TextBuffer* buffer, const size_t element) {
+  uint64_t id = next_random();
+  bool ok = append_format(buffer,
+    "{\"id\":%zu,\"uuid\":\"%08x-%04x-%04x-%04x-%012llx\",\"name\":\"%s %s\",\"email\":\"%s.%s@example.com\","
+    "\"active\":%s,\"balance\":",
+    element, (unsigned int)id, (unsigned int)(id >> 32) & 0xFFFF, random_below(0x10000), random_below(0x10000),
+    (unsigned long long)(next_random() & 0xFFFFFFFFFFFFULL), word(), word(), word(), word(),
+    random_below(2) ? "true" : "false");
+  ok = ok && append_double(buffer) && append(buffer, ",\"tags\":[");
+  int tags = random_below(5);
+  for (int i = 0; ok && i < tags; ++i) {
+    ok = append_format(buffer, "%s\"%s\"", i > 0 ? "," : "", word());
+  }
+  ok = ok && append_format(buffer,
+    "],\"address\":{\"street\":\"%u %s street\",\"city\":\"%s\",\"zip\":\"%05u\",\"geo\":{\"lat\":",
+    random_below(9999), word(), word(), random_below(100000));
+  ok = ok && append_double(buffer) && append(buffer, ",\"lng\":") && append_double(buffer);
+  ok = ok && append(buffer, "}},\"friends\":[");
+  int friends = random_below(4);
+  for (int i = 0; ok && i < friends; ++i) {
+    ok = append_format(buffer, "%s{\"id\":%u,\"name\":\"%s\"}", i > 0 ? "," : "", random_below(1000000), word());
+  }
+  ok = ok && append(buffer, "],\"bio\":\"") && append_text(buffer, 5 + random_below(20));
+  ok = ok && append_format(buffer, "\",\"created\":\"20%02u-%02u-%02uT%02u:%02u:%02uZ\",\"manager\":null}",
+    random_below(30), 1 + random_below(12), 1 + random_below(28), random_below(24), random_below(60), random_below(60));
+  return ok;
+}
+
+static bool append_log_event(TextBuffer* buffer) {
+  static const char* levels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+  static const int statuses[] = { 200, 200, 200, 201, 204, 301, 400, 404, 500 };
+  bool ok = append_format(buffer,
+    "{\"ts\":\"2024-%02u-%02uT%02u:%02u:%02u.%03uZ\",\"level\":\"%s\",\"service\":\"%s\",\"status\":%d,"
+    "\"latency_ms\":%u.%u,\"trace\":\"%016llx\",\"msg\":\"",
+    1 + random_below(12), 1 + random_below(28), random_below(24), random_below(60), random_below(60), random_below(1000),
+    levels[random_below(6)], word(), statuses[random_below(9)], random_below(2000), random_below(10),
+    (unsigned long long)next_random());
+  ok = ok && append_text(buffer, 4 + random_below(12));
+  ok = ok && append_format(buffer, "\",\"user\":{\"id\":%u,\"ip\":\"10.%u.%u.%u\"},\"retries\":%u}",
+    random_below(100000), random_below(256), random_below(256), random_below(256), random_below(4));
+  return ok;
+}
+
+typedef enum corpusKind {
+  CORPUS_DEEP,
+  CORPUS_WIDE,
+  CORPUS_STRINGS,
+  CORPUS_NUMBERS,
+  CORPUS_API,
+  CORPUS_LOGS,
+  CORPUS_COUNT,
+} CorpusKind;
+
+static const char* corpus_names[CORPUS_COUNT] = { "deep", "wide", "strings", "numbers", "api", "logs" };
+
+static bool append_element(TextBuffer* buffer, const CorpusKind kind, const size_t element) {
+  switch (kind) {
+    case CORPUS_DEEP: return append_deep(buffer, element);
+    case CORPUS_WIDE: return append_wide_member(buffer, element);
+    case CORPUS_STRINGS: return append_long_string(buffer);
+    case CORPUS_NUMBERS: return append_number(buffer);
+    case CORPUS_API: return append_api_record(buffer, element);
+    default: return append_log_event(buffer);
+  }
+}
+
+// Elements are added until the text reaches `size` bytes. The seed is reset
+// for every corpus, so a corpus of a given kind and size is always the same.
+static char* generate_corpus(const CorpusKind kind, const size_t size, size_t* length) {
+  random_state = SEED + kind;
+  TextBuffer buffer = { NULL, 0, 0 };
+  if (!reserve_text(&buffer, size + size / 8)) {
+    return NULL;
+  }
+
+  bool ok = append(&buffer, kind == CORPUS_WIDE ? "{" : "[");
+  for (size_t element = 0; ok && (element == 0 || buffer.length < size); ++element) {
+    ok = (element == 0 || append(&buffer, ",")) && append_element(&buffer, kind, element);
+  }
+  ok = ok && append(&buffer, kind == CORPUS_WIDE ? "}" : "]");
+
+  if (!ok) {
+    free(buffer.data);
+    return NULL;
+  }
+  *length = buffer.length;
+  return buffer.data;
+}
+
+static bool write_corpus(const char* folder, const char* name, const size_t size, const char* text, const size_t length) {
+  char path[PATH_SIZE];
+  snprintf(path, sizeof(path), "%s/%s_%zu.json", folder, name, size);
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "Error: Can't create '%s'!\n", path);
+    return false;
+  }
+  bool ok = fwrite(text, 1, length, file) == length;
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "Error: Can't write '%s'!\n", path);
+  }
+  return ok;
+}
+
+// ---- phases ----
+
+typedef enum phase {
+  PHASE_TOKENIZE,
+  PHASE_PARSE,
+  PHASE_FREE,
+  PHASE_SERIALIZE,
+  PHASE_COUNT,
+} Phase;
+
+static const char* phase_names[PHASE_COUNT] = { "tokenize", "parse", "free", "serialize" };
+
+typedef struct phaseResult {
+  double best_seconds;
+  double total_seconds;
+  AllocationCount per_document; // of the first iteration, which is what a one-shot caller pays
+} PhaseResult;
+
+typedef struct caseResult {
+  CorpusKind kind;
+  size_t size;
+  size_t bytes;
+  size_t output_bytes;
+  int iterations;
+  PhaseResult phases[PHASE_COUNT];
+  size_t peak_rss;
+  bool ok;
+} CaseResult;
+
+static void record(PhaseResult* result, const int iteration, const double seconds, const AllocationCount* before) {
+  if (iteration == 0 || seconds < result->best_seconds) {
+    result->best_seconds = seconds;
+  }
+  result->total_seconds += seconds;
+  if (iteration == 0) {
+    result->per_document.allocations = counted.allocations - before->allocations;
+    result->per_document.frees = counted.frees - before->frees;
+  }
+}
+
+static bool tokenize_all(const char* text) {
+  TokenizerState tokenizer = init_tokenizer(text);
+  while (true) {
+    Token token = next_token(&tokenizer);
+    if (token.type == TOKEN_EOF) {
+      return true;
+    }
+    if (token.type >= TOKEN_INVALID) {
+      return false;
+    }
+  }
+}
+
+static JsonValue* parse_tree(const char* text) {
+  TokenizerState tokenizer = init_tokenizer(text);
+  ParserState parser = init_pull_parser(&tokenizer);
+  ParseError error;
+  JsonValue* root = parse_json_text(&parser, &error);
+  free_parser_state(&parser);
+  if (!root) {
+    print_error(&error, false);
+  }
+  return root;
+}
+
+static bool run_iteration(CaseResult* result, const char* text, const int iteration, JsonWriter* writer) {
+  AllocationCount before = counted;
+  double start = now_seconds();
+  bool ok = tokenize_all(text);
+  record(&result->phases[PHASE_TOKENIZE], iteration, now_seconds() - start, &before);
+  if (!ok) {
+    fprintf(stderr, "Error: tokenizer rejected the %s corpus!\n", corpus_names[result->kind]);
+    return false;
+  }
+
+  before = counted;
+  start = now_seconds();
+  JsonValue* root = parse_tree(text);
+  record(&result->phases[PHASE_PARSE], iteration, now_seconds() - start, &before);
+  if (!root) {
+    return false;
+  }
+
+  writer->length = 0;
+  before = counted;
+  start = now_seconds();
+  ok = write_json_value(writer, root);
+  record(&result->phases[PHASE_SERIALIZE], iteration, now_seconds() - start, &before);
+  result->output_bytes = writer->length;
+
+  before = counted;
+  start = now_seconds();
+  free_json_value(root);
+  record(&result->phases[PHASE_FREE], iteration, now_seconds() - start, &before);
+
+  return ok;
+}
+
+// Repeats the phases until `min_time` has passed; every phase runs at least once
+static CaseResult run_case(const CorpusKind kind, const size_t size, const double min_time, const char* corpus_folder) {
+  CaseResult result;
+  memset(&result, 0, sizeof(result));
+  result.kind = kind;
+  result.size = size;
+
+  reset_peak_rss();
+  char* text = generate_corpus(kind, size, &result.bytes);
+  if (!text) {
+    return result;
+  }
+
+  if (corpus_folder && !write_corpus(corpus_folder, corpus_names[kind], size, text, result.bytes)) {
+    free(text);
+    return result;
+  }
+
+  JsonWriter writer;
+  init_json_writer(&writer, WRITER_COMPACT);
+
+  result.ok = true;
+  double start = now_seconds();
+  while (result.ok && result.iterations < MAX_ITERATIONS &&
+    (result.iterations == 0 || now_seconds() - start < min_time)) {
+    result.ok = run_iteration(&result, text, result.iterations, &writer);
+    result.iterations += 1;
+  }
+
+  result.peak_rss = peak_rss_bytes();
+  free_json_writer(&writer);
+  free(text);
+  return result;
+}
+
+// ---- reporting ----
+
+static double megabytes_per_second(const size_t bytes, const double seconds) {
+  return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+static void print_summary_line(const CaseResult* result) {
+  fprintf(stderr, "%-8s %11zu B %6d it ", corpus_names[result->kind], result->bytes, result->iterations);
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    fprintf(stderr, " %s %8.1f MB/s", phase_names[phase],
+      megabytes_per_second(result->bytes, result->phases[phase].best_seconds));
+  }
+  fprintf(stderr, "  rss %.1f MB%s\n", result->peak_rss / (1024.0 * 1024.0), result->ok ? "" : "  FAILED");
+}
+
+static void print_json_report(FILE* out, const CaseResult* results, const int count, const size_t max_size, const double min_time) {
+  fprintf(out, "{\n  \"suite\": \"json_parser\",\n  \"version\": 1,\n  \"seed\": %llu,\n",
+    (unsigned long long)SEED);
+  fprintf(out, "  \"scan_level\": \"%s\",\n  \"max_size\": %zu,\n  \"min_time\": %g,\n  \"results\": [\n",
+    scan_level_to_string(get_scan_level()), max_size, min_time);
+
+  for (int i = 0; i < count; ++i) {
+    const CaseResult* result = &results[i];
+    fprintf(out, "    {\"corpus\": \"%s\", \"size\": %zu, \"bytes\": %zu, \"output_bytes\": %zu, "
+      "\"iterations\": %d, \"ok\": %s, \"peak_rss_bytes\": %zu,\n      \"phases\": {",
+      corpus_names[result->kind], result->size, result->bytes, result->output_bytes,
+      result->iterations, result->ok ? "true" : "false", result->peak_rss);
+
+    for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+      const PhaseResult* timing = &result->phases[phase];
+      double mean = result->iterations > 0 ? timing->total_seconds / result->iterations : 0;
+      fprintf(out, "%s\n        \"%s\": {\"best_seconds\": %.9f, \"mean_seconds\": %.9f, \"mb_per_s\": %.2f, "
+        "\"allocations_per_document\": %zu, \"frees_per_document\": %zu}",
+        phase > 0 ? "," : "", phase_names[phase], timing->best_seconds, mean,
+        megabytes_per_second(result->bytes, timing->best_seconds),
+        timing->per_document.allocations, timing->per_document.frees);
+    }
+    fprintf(out, "\n      }}%s\n", i + 1 < count ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+static size_t parse_size(const char* text) {
+  char* end;
+  double value = strtod(text, &end);
+  switch (*end) {
+    case 'k': case 'K': value *= 1024; break;
+    case 'm': case 'M': value *= 1024 * 1024; break;
+    case 'g': case 'G': value *= 1024.0 * 1024 * 1024; break;
+  }
+  return value > 0 ? (size_t)value : 0;
+}
+
+static void print_usage(const char* program) {
+  fprintf(stderr, "Usage: %s [--max-size N[K|M|G]] [--min-time SECONDS] [--corpus deep|wide|strings|numbers|api|logs] "
+    "[--output FILE] [--write-corpus FOLDER]\n", program);
+}
+
+int main(int argc, char** argv) {
+  size_t max_size = DEFAULT_MAX_SIZE;
+  double min_time = DEFAULT_MIN_TIME;
+  int only = -1;
+  const char* output_path = NULL;
+  const char* corpus_folder = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--max-size") == 0 && has_value) {
+      max_size = parse_size(argv[++i]);
+    } else if (strcmp(argv[i], "--min-time") == 0 && has_value) {
+      min_time = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--corpus") == 0 && has_value) {
+      const char* name = argv[++i];
+      for (int kind = 0; kind < CORPUS_COUNT; ++kind) {
+        if (strcmp(name, corpus_names[kind]) == 0) {
+          only = kind;
+        }
+      }
+      if (only < 0) {
+        print_usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+      output_path = argv[++i];
+    } else if (strcmp(argv[i], "--write-corpus") == 0 && has_value) {
+      corpus_folder = argv[++i];
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (max_size < MIN_SIZE) {
+    max_size = MIN_SIZE;
+  }
+
+  int capacity = 0;
+  for (size_t size = MIN_SIZE; size <= max_size; size *= SIZE_STEP) {
+    capacity += CORPUS_COUNT;
+  }
+  CaseResult* results = malloc(sizeof(CaseResult) * capacity);
+  if (!results) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark results!\n");
+    return 1;
+  }
+
+  int count = 0;
+  bool ok = true;
+  for (size_t size = MIN_SIZE; size <= max_size; size *= SIZE_STEP) {
+    for (int kind = 0; kind < CORPUS_COUNT; ++kind) {
+      if (only >= 0 && kind != only) {
+        continue;
+      }
+      results[count] = run_case(kind, size, min_time, corpus_folder);
+      print_summary_line(&results[count]);
+      ok = ok && results[count].ok;
+      count += 1;
+    }
+  }
+
+  FILE* out = output_path ? fopen(output_path, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Error: Can't create '%s'!\n", output_path);
+    free(results);
+    return 1;
+  }
+  print_json_report(out, results, count, max_size, min_time);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  free(results);
+  return ok ? 0 : 1;
+}
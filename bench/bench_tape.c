@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "parser.h"
+#include "json.h"
+#include "document.h"
+#include "tape.h"
+
+// Parses a large array of records into a heap tree, an arena tree and a tape,
+// then walks each of them a number of times (every number summed, every string
+// counted). Parse and walk are timed apart: the walk is where the tape, read
+// front to back, should beat chasing the tree's pointers.
+
+#define DEFAULT_RECORDS 100000
+#define DEFAULT_WALKS 20
+#define RECORD_SIZE 256
+
+typedef struct totals {
+  double sum;
+  long strings;
+  long values;
+} Totals;
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_document(int records) {
+  size_t capacity = (size_t)records * RECORD_SIZE + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  length += snprintf(text + length, capacity - length, "[");
+  for (int i = 0; i < records; ++i) {
+    length += snprintf(text + length, capacity - length,
+      "{\"id\": %d, \"name\": \"item %d\", \"price\": %d.%02d, \"active\": %s, "
+      "\"tags\": [\"alpha\", \"beta\"], \"size\": {\"w\": %d, \"h\": %d}}%s",
+      i, i, i % 1000, i % 100, i % 2 ? "true" : "false", i % 40, i % 30, i + 1 < records ? ", " : "");
+  }
+  length += snprintf(text + length, capacity - length, "]");
+
+  return text;
+}
+
+static double number_value(const JsonNumber number) {
+  switch (number.kind) {
+    case NUMBER_INT64: return (double)number.value.integer;
+    case NUMBER_UINT64: return (double)number.value.unsigned_integer;
+    default: return number.value.real;
+  }
+}
+
+// Recursion is fine here: the generated document is three levels deep
+static void walk_tree(const JsonValue* value, Totals* totals) {
+  totals->values += 1;
+  switch (value->type) {
+    case JSON_NUMBER: totals->sum += number_value(json_number(value)); break;
+    case JSON_STRING: totals->strings += 1; break;
+    case JSON_ARRAY:
+      for (int i = 0; i < value->array->count; ++i) {
+        walk_tree(value->array->elements[i], totals);
+      }
+      break;
+    case JSON_OBJECT:
+      for (int i = 0; i < value->object->count; ++i) {
+        walk_tree(value->object->pairs[i]->value, totals);
+      }
+      break;
+    default: break;
+  }
+}
+
+static void walk_tape(const JsonTapeValue value, Totals* totals) {
+  totals->values += 1;
+  switch (json_tape_type(value)) {
+    case JSON_NUMBER: totals->sum += number_value(json_tape_number(value)); break;
+    case JSON_STRING: totals->strings += 1; break;
+    case JSON_ARRAY:
+    case JSON_OBJECT: {
+      JsonTapeIterator iterator = json_tape_iterate(value);
+      JsonTapeValue child;
+      while (json_tape_next(&iterator, &child)) {
+        walk_tape(child, totals);
+      }
+      break;
+    }
+    default: break;
+  }
+}
+
+static void report(const char* label, const double parse, const double walk, const double megabytes, const int walks) {
+  printf("%-20s parse %8.3f s %8.1f MB/s   walk %8.3f ms/walk\n", label, parse, megabytes / parse, walk * 1000 / walks);
+}
+
+static bool bench_heap(const char* text, const int walks, const double megabytes, Totals* totals) {
+  TokenizerState tokenizer = init_tokenizer(text);
+  ParserState state = init_pull_parser(&tokenizer);
+  ParseError error;
+  double start = now_seconds();
+  JsonValue* root = parse_json_text(&state, &error);
+  double parse = now_seconds() - start;
+  free_parser_state(&state);
+  if (!root) {
+    print_error(&error, false);
+    return false;
+  }
+
+  start = now_seconds();
+  for (int i = 0; i < walks; ++i) {
+    *totals = (Totals){ 0 };
+    walk_tree(root, totals);
+  }
+  report("heap tree", parse, now_seconds() - start, megabytes, walks);
+
+  free_json_value(root);
+  return true;
+}
+
+static bool bench_arena(const char* text, const int walks, const double megabytes, Totals* totals) {
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = true;
+
+  ParseError error;
+  double start = now_seconds();
+  JsonValue* root = parse_json_document(&document, text, &error);
+  double parse = now_seconds() - start;
+  if (!root) {
+    print_error(&error, false);
+    free_json_document(&document);
+    return false;
+  }
+
+  start = now_seconds();
+  for (int i = 0; i < walks; ++i) {
+    *totals = (Totals){ 0 };
+    walk_tree(root, totals);
+  }
+  report("arena tree", parse, now_seconds() - start, megabytes, walks);
+
+  free_json_document(&document);
+  return true;
+}
+
+static bool bench_tape(const char* text, const int walks, const double megabytes, Totals* totals) {
+  JsonTape tape;
+  init_json_tape(&tape);
+
+  ParseError error;
+  double start = now_seconds();
+  bool parsed = parse_json_tape(&tape, text, &error);
+  double parse = now_seconds() - start;
+  if (!parsed) {
+    print_error(&error, false);
+    free_json_tape(&tape);
+    return false;
+  }
+
+  start = now_seconds();
+  for (int i = 0; i < walks; ++i) {
+    *totals = (Totals){ 0 };
+    walk_tape(json_tape_root(&tape), totals);
+  }
+  report("tape", parse, now_seconds() - start, megabytes, walks);
+
+  printf("tape: %d entries (%.1f MB), %.1f MB of strings\n", tape.count,
+    tape.count * sizeof(uint64_t) / (1024.0 * 1024), tape.string_length / (1024.0 * 1024));
+  free_json_tape(&tape);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int records = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+  int walks = argc > 2 ? atoi(argv[2]) : DEFAULT_WALKS;
+
+  char* text = generate_document(records);
+  if (!text) {
+    return 1;
+  }
+
+  size_t length = strlen(text);
+  double megabytes = length / (1024.0 * 1024);
+  printf("document: %zu bytes, %d records, walks: %d\n", length, records, walks);
+
+  Totals totals[3];
+  bool ok = bench_heap(text, walks, megabytes, &totals[0])
+    && bench_arena(text, walks, megabytes, &totals[1])
+    && bench_tape(text, walks, megabytes, &totals[2]);
+
+  for (int i = 1; ok && i < 3; ++i) {
+    if (totals[i].values != totals[0].values || totals[i].strings != totals[0].strings || totals[i].sum != totals[0].sum) {
+      fprintf(stderr, "Error: walks differ (%ld values, %.2f vs %ld values, %.2f)!\n",
+        totals[0].values, totals[0].sum, totals[i].values, totals[i].sum);
+      ok = false;
+    }
+  }
+
+  if (ok) {
+    printf("values: %ld, strings: %ld, number total %.2f\n", totals[0].values, totals[0].strings, totals[0].sum);
+  }
+
+  free(text);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include "parser.h"
+#include "json.h"
+#include "writer.h"
+#include "document.h"
+
+// Parses a synthetic document once, then serializes the tree many times into
+// a growing buffer (compact and pretty) and to the null device through a file
+// descriptor, and reports the output throughput of each.
+
+#define DEFAULT_RECORDS 20000
+#define DEFAULT_ITERATIONS 50
+#define RECORD_SIZE 256
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* generate_document(int records) {
+  size_t capacity = (size_t)records * RECORD_SIZE + 16;
+  char* text = malloc(capacity);
+  if (!text) {
+    fprintf(stderr, "Error: Can't allocate memory for benchmark document!\n");
+    return NULL;
+  }
+
+  size_t length = 0;
+  text[length++] = '[';
+  for (int i = 0; i < records; ++i) {
+    length += snprintf(text + length, capacity - length,
+      "%s{\"id\": %d, \"name\": \"user%d\", \"active\": %s, \"score\": %d.%02d, "
+      "\"bio\": \"line one\\nline \\\"two\\\" with a longer plain text run\", "
+      "\"tags\": [\"a\", \"b\", \"c\"], \"parent\": null}",
+      i > 0 ? ", " : "", i, i, i % 2 ? "true" : "false", i % 100, i % 97);
+  }
+  text[length++] = ']';
+  text[length] = '\0';
+
+  return text;
+}
+
+static double bench_buffer(const JsonValue* root, const WriterStyle style, const int iterations, size_t* output) {
+  JsonWriter writer;
+  init_json_writer(&writer, style);
+
+  double start = now_seconds();
+  for (int i = 0; i < iterations; ++i) {
+    writer.length = 0;
+    if (!write_json_value(&writer, root)) {
+      free_json_writer(&writer);
+      return -1;
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  *output = writer.length;
+  free_json_writer(&writer);
+  return elapsed;
+}
+
+static double bench_fd(const JsonValue* root, const int iterations) {
+  int fd = open(NULL_DEVICE, O_WRONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Can't open %s!\n", NULL_DEVICE);
+    return -1;
+  }
+
+  JsonWriter writer;
+  init_json_writer_fd(&writer, WRITER_COMPACT, fd);
+
+  double start = now_seconds();
+  bool ok = true;
+  for (int i = 0; ok && i < iterations; ++i) {
+    ok = write_json_value(&writer, root);
+  }
+  ok = ok && json_writer_flush(&writer);
+  double elapsed = now_seconds() - start;
+
+  free_json_writer(&writer);
+  return ok ? elapsed : -1;
+}
+
+int main(int argc, char** argv) {
+  int records = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  char* text = generate_document(records);
+  if (!text) {
+    return 1;
+  }
+
+  JsonDocument document;
+  init_json_document(&document);
+  ParseError error;
+  JsonValue* root = parse_json_document(&document, text, &error);
+  if (!root) {
+    print_error(&error, false);
+    free_json_document(&document);
+    free(text);
+    return 1;
+  }
+
+  size_t compact_size = 0;
+  size_t pretty_size = 0;
+  double compact = bench_buffer(root, WRITER_COMPACT, iterations, &compact_size);
+  double pretty = bench_buffer(root, WRITER_PRETTY, iterations, &pretty_size);
+  double fd = bench_fd(root, iterations);
+
+  free_json_document(&document);
+  free(text);
+
+  if (compact < 0 || pretty < 0 || fd < 0) {
+    return 1;
+  }
+
+  double megabytes = iterations / (1024.0 * 1024.0);
+  printf("records: %d, iterations: %d, compact: %zu bytes, pretty: %zu bytes\n", records, iterations, compact_size, pretty_size);
+  printf("%-17s %10.3f s %10.1f MB/s\n", "buffer (compact)", compact, compact_size * megabytes / compact);
+  printf("%-17s %10.3f s %10.1f MB/s\n", "buffer (pretty)", pretty, pretty_size * megabytes / pretty);
+  printf("%-17s %10.3f s %10.1f MB/s\n", "fd (compact)", fd, compact_size * megabytes / fd);
+
+  return 0;
+}
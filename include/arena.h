@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+typedef struct arenaBlock ArenaBlock;
+
+struct arenaBlock {
+  ArenaBlock* next;
+  size_t capacity;
+  size_t used;
+  _Alignas(ARENA_ALIGNMENT) char data[];
+};
+
+// Bump allocator: allocations are carved out of large blocks and released all
+// at once. Blocks are kept across arena_reset() so steady-state parsing does
+// not touch malloc at all.
+typedef struct arena {
+  ArenaBlock* first;
+  ArenaBlock* current;
+} Arena;
+
+void init_arena(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+char* arena_strdup(Arena* arena, const char* s);
+char* arena_strndup(Arena* arena, const char* s, size_t n);
+void arena_reset(Arena* arena);
+void free_arena(Arena* arena);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "key_table.h"
+
+#define MAX_THREADS 256
+
+// Validates every .json file under a folder (subfolders included) with a pool
+// of worker threads. The folder scan feeds a shared queue; each worker keeps
+// its own read buffer and JsonDocument arena, so files are parsed without any
+// shared allocator. Failures are printed in scan order whatever thread
+// finished them first, so the output is the same for any thread count.
+typedef struct batchOptions {
+  int threads;   // 0 for one per online CPU
+  int max_depth; // 0 for DEFAULT_MAX_DEPTH
+  bool color_enabled;
+  KeyTable* keys; // optional: a key table shared by the workers
+} BatchOptions;
+
+typedef struct batchSummary {
+  long files;
+  long failed;
+  size_t bytes;
+  double seconds;
+  int threads;
+} BatchSummary;
+
+bool run_batch(const char* folder_path, const BatchOptions* options, BatchSummary* summary);
+void print_batch_summary(const BatchSummary* summary);
+int online_cpus();
+
+#endif
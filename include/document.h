@@ -0,0 +1,27 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include "arena.h"
+#include "json.h"
+#include "parser.h"
+
+// A parsed JSON text whose whole tree lives in one arena. The tree is released
+// in O(1) by reset_json_document() (blocks are kept for the next parse) or
+// free_json_document() (blocks are returned to the heap). A document reused
+// for many texts also keeps the parser's work buffers, so once they fit the
+// largest text seen, parsing does not allocate.
+typedef struct jsonDocument {
+  Arena arena;
+  JsonValue* root;
+  bool zero_copy; // strings, numbers and keys borrow from the input, which must outlive the tree
+  int max_depth; // deepest container nesting accepted, 0 for DEFAULT_MAX_DEPTH
+  ParserScratch scratch;
+  KeyTable* keys; // optional: object keys are interned in it; may be shared with other documents and threads
+} JsonDocument;
+
+void init_json_document(JsonDocument* document);
+JsonValue* parse_json_document(JsonDocument* document, const char* input, ParseError* error);
+void reset_json_document(JsonDocument* document);
+void free_json_document(JsonDocument* document);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdbool.h>
+#include "error.h"
+
+// Callbacks for event-based parsing (parse_json_events() and the push parser
+// in stream.h). Text arguments point into the parser's buffer (the input
+// itself, from parse_json_events(), unless the text had escapes), are not
+// NUL-terminated and are only valid during the call. Strings
+// and keys arrive decoded (so they may contain NUL bytes); `has_escapes` tells
+// whether the source text used escape sequences. Returning false stops the
+// parse. Callbacks left NULL are skipped.
+typedef struct jsonEventHandler {
+  void* context;
+  bool (*on_null)(void* context);
+  bool (*on_bool)(void* context, const bool value);
+  bool (*on_number)(void* context, const char* text, const int length);
+  bool (*on_string)(void* context, const char* text, const int length, const bool has_escapes);
+  bool (*on_key)(void* context, const char* text, const int length, const bool has_escapes);
+  bool (*on_start_object)(void* context);
+  bool (*on_end_object)(void* context);
+  bool (*on_start_array)(void* context);
+  bool (*on_end_array)(void* context);
+} JsonEventHandler;
+
+// Something that reports one JSON value as events to `handler`, such as a
+// tape being replayed. Returns false with `error` set when it stops early.
+typedef bool (*JsonEventSource)(void* source, const JsonEventHandler* handler, ParseError* error);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include "tokenizer.h"
+#include "number.h"
 #include "parser.h"
 
 typedef enum jsonType {
@@ -14,16 +15,25 @@ typedef enum jsonType {
   JSON_OBJECT,
 } JsonType;
 
+#define KEY_INDEX_THRESHOLD 16
+
 typedef struct JsonValue JsonValue;
 typedef struct JsonObject JsonObject;
 typedef struct JsonArray JsonArray;
 typedef struct JsonPair JsonPair;
+typedef struct internedKey InternedKey;
 
 struct JsonValue {
   JsonType type;
+  bool borrowed; // string/number is a slice of the input buffer, not an owned NUL-terminated copy
+  unsigned char number_kind; // NumberKind of `numeric`
+  int length;    // byte length of string/number
   union {
     bool boolean;
-    char* number; // to keep the actual numbers format from the json file
+    struct {
+      char* number; // to keep the actual numbers format from the json file
+      NumberValue numeric; // decoded by the tokenizer
+    };
     char* string;
     JsonArray* array;
     JsonObject* object;
@@ -33,19 +43,38 @@ struct JsonValue {
 struct JsonArray {
   JsonValue** elements;
   int count;
+  int capacity;
 };
 
 struct JsonPair {
   char* key;
+  int key_length;
+  bool borrowed_key; // key is a slice of the input buffer (or interned): not freed with the pair
+  bool interned_key; // key is the canonical pointer of a KeyTable entry (see key_table.h)
   JsonValue* value;
 };
 
 struct JsonObject {
   JsonPair** pairs;
   int count;
+  int capacity;
+  int* index;         // open-addressing table of pair positions + 1 (0 = empty), built from KEY_INDEX_THRESHOLD pairs on
+  int index_capacity; // power of two, kept at most half full
 };
 
+unsigned int hash_key(const char* key, const int length);
+int json_object_find(const JsonObject* object, const char* key, const int length);
+int json_object_find_hashed(const JsonObject* object, const char* key, const int length, const unsigned int hash);
+int json_object_find_interned(const JsonObject* object, const InternedKey* key);
+JsonValue* json_object_get(const JsonObject* object, const char* key, const int length);
+void json_object_index_insert(JsonObject* object, const int position);
+JsonNumber json_number(const JsonValue* value);
+bool json_number_as_int64(const JsonValue* value, int64_t* result);
+bool json_number_as_uint64(const JsonValue* value, uint64_t* result);
+double json_number_as_double(const JsonValue* value);
 void free_json_value(JsonValue* value);
+void print_indent(int indent);
+void print_escaped(const char* text, const int length);
 void print_json_value(const JsonValue* value, const int indent, const bool color_enabled);
 
 #endif
\ No newline at end of file
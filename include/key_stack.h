@@ -0,0 +1,38 @@
+#ifndef KEY_STACK_H
+#define KEY_STACK_H
+
+#include <stdbool.h>
+
+// Keys of the objects currently open, for duplicate detection in the parsers
+// that don't build a tree. Keys are copied into one pool that is unwound when
+// their object closes, so memory follows the open objects, not the document.
+typedef struct stackedKey {
+  unsigned int hash;
+  int offset; // into the pool
+  int length;
+} StackedKey;
+
+typedef struct keyScope {
+  int first_key;      // this object's keys are keys[first_key..key_count)
+  int pool_start;
+  int* index;         // open-addressing table of key positions + 1, built from KEY_INDEX_THRESHOLD keys on
+  int index_capacity;
+} KeyScope;
+
+typedef struct keyStack {
+  StackedKey* keys;
+  int key_count;
+  int key_capacity;
+  char* pool;
+  int pool_length;
+  int pool_capacity;
+} KeyStack;
+
+void init_key_stack(KeyStack* stack);
+KeyScope open_key_scope(const KeyStack* stack);
+void close_key_scope(KeyStack* stack, KeyScope* scope);
+bool key_scope_contains(const KeyStack* stack, const KeyScope* scope, const unsigned int hash, const char* key, const int length);
+bool key_scope_add(KeyStack* stack, KeyScope* scope, const unsigned int hash, const char* key, const int length);
+void free_key_stack(KeyStack* stack);
+
+#endif
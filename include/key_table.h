@@ -0,0 +1,43 @@
+#ifndef KEY_TABLE_H
+#define KEY_TABLE_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "arena.h"
+
+// Object keys interned once and shared by every tree parsed with the table
+// (ParserState.keys, JsonDocument.keys). Each distinct key is stored a single
+// time, NUL-terminated, at an address that never changes, with a stable id:
+// two pairs of such trees have the same key exactly when their key pointers
+// are equal. Keys are only added, never removed, until free_key_table().
+//
+// Lookups don't lock: the hash table is published with atomic stores and a
+// grown table replaces the old one without freeing it, so any number of
+// threads can look keys up and intern them at once. Only adding a key that
+// isn't there yet takes the mutex.
+typedef struct internedKey {
+  unsigned int hash; // hash_key() of the text
+  int id;            // 0, 1, 2... in the order keys were added
+  int length;
+  char text[];       // the canonical pointer
+} InternedKey;
+
+typedef struct keySlots KeySlots;
+
+typedef struct keyTable {
+  _Atomic(KeySlots*) slots; // open-addressing table, kept at most half full
+  KeySlots* retired;        // smaller tables it replaced: readers may still be probing them
+  Arena keys;               // storage of the entries
+  atomic_int count;
+  pthread_mutex_t lock;     // held while adding a key
+} KeyTable;
+
+void init_key_table(KeyTable* table);
+const InternedKey* key_table_find(const KeyTable* table, const char* key, const int length);
+const InternedKey* key_table_intern(KeyTable* table, const char* key, const int length);
+const InternedKey* interned_key(const char* text);
+int key_table_count(const KeyTable* table);
+void free_key_table(KeyTable* table);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef NDJSON_H
+#define NDJSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "key_table.h"
+
+// Validates newline-delimited JSON (NDJSON / JSON Lines): one JSON text per
+// line, blank lines ignored, "\r\n" accepted. The input is cut at newlines into
+// chunks that a pool of worker threads parses in parallel; each worker parses
+// its records one at a time into its own JsonDocument arena, reset between
+// records. Failures are printed in input order with their record number, line
+// and byte offset, whatever thread finished them first.
+typedef struct ndjsonOptions {
+  int threads;       // 0 for one per online CPU
+  int max_depth;     // 0 for DEFAULT_MAX_DEPTH
+  size_t chunk_size; // 0 to pick one from the input size and the thread count
+  bool color_enabled;
+  KeyTable* keys;    // optional: a key table shared by the workers
+} NdjsonOptions;
+
+typedef struct ndjsonSummary {
+  long records;
+  long failed;
+  size_t bytes;
+  double seconds;
+  int threads;
+  long chunks;
+} NdjsonSummary;
+
+bool parse_ndjson(const char* input, const size_t length, const NdjsonOptions* options, NdjsonSummary* summary);
+bool run_ndjson(const char* path, const NdjsonOptions* options, NdjsonSummary* summary);
+void print_ndjson_summary(const NdjsonSummary* summary);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_MANTISSA_DIGITS 19 // every 19-digit decimal fits in a uint64_t
+#define MAX_EXPONENT 100000    // far beyond double range, keeps the accumulated exponent from overflowing
+
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
+
+typedef enum numberKind {
+  NUMBER_INT64,  // integer that fits int64_t
+  NUMBER_UINT64, // positive integer above INT64_MAX that fits uint64_t
+  NUMBER_DOUBLE, // has a fraction or an exponent
+  NUMBER_BIG,    // integer beyond 64 bits or double out of range: `real` is only the nearest double, the lexeme is exact
+} NumberKind;
+
+typedef union numberValue {
+  int64_t integer;
+  uint64_t unsigned_integer;
+  double real;
+} NumberValue;
+
+typedef struct jsonNumber {
+  NumberKind kind;
+  NumberValue value;
+} JsonNumber;
+
+// Digits gathered by the tokenizer while it validates a number lexeme
+typedef struct numberScan {
+  uint64_t mantissa; // integer and fraction digits, exact while digits <= MAX_MANTISSA_DIGITS
+  int digits;        // integer and fraction digits seen
+  int exponent;      // power of ten applied to mantissa
+  bool negative;
+  bool real;         // has a fraction or an exponent
+} NumberScan;
+
+void init_number_scan(NumberScan* scan);
+JsonNumber finish_number(const NumberScan* scan, const char* text, const int length);
+JsonNumber decode_number(const char* text, const int length);
+
+#endif
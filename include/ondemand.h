@@ -0,0 +1,58 @@
+#ifndef ONDEMAND_H
+#define ONDEMAND_H
+
+#include <stdbool.h>
+#include "arena.h"
+#include "error.h"
+#include "json.h"
+#include "parser.h"
+#include "path.h"
+#include "validate.h"
+
+// A JSON text parsed on demand: opening it only checks that it starts with an
+// object or an array. A cursor is the position of a value in the input; asking
+// an object for a field (or an array for an element) reads the keys in front
+// of it and skips the values in between, and only the values passed to
+// json_cursor_value() are built, in the document's arena. The input must
+// outlive the document, its cursors and the values built from it.
+//
+// Skipped values are by default only bracket-counted, jumping over strings,
+// so they may hide errors; with `validate` set they are checked in full and
+// fail with the same messages as parse_json_text(). Either way, nothing past
+// the last value read is looked at, and duplicate keys are not detected.
+typedef struct onDemandDocument {
+  const char* input;
+  bool validate;  // check skipped values instead of only counting brackets
+  bool zero_copy; // values built from the document borrow their strings from the input
+  int max_depth;  // 0 for DEFAULT_MAX_DEPTH
+  Arena arena;
+  JsonValidator validator;
+  char* scratch;  // decoded text of an escaped key
+  int scratch_capacity;
+  ParserScratch parser_scratch; // work buffers of json_cursor_value(), kept across values
+} OnDemandDocument;
+
+typedef struct jsonCursor {
+  OnDemandDocument* document;
+  int offset;       // first character of the value
+  int resume;       // where the next lookup starts: the member last found in an object, element `resume_index` of an array; 0 for none
+  int resume_index;
+} JsonCursor;
+
+typedef enum cursorResult {
+  CURSOR_FOUND,
+  CURSOR_MISSING,
+  CURSOR_ERROR, // the input is invalid where it was read, see the ParseError
+} CursorResult;
+
+void init_ondemand_document(OnDemandDocument* document);
+bool ondemand_root(OnDemandDocument* document, const char* input, JsonCursor* root, ParseError* error);
+void free_ondemand_document(OnDemandDocument* document);
+
+JsonType json_cursor_type(const JsonCursor* cursor);
+CursorResult json_cursor_field(JsonCursor* object, const char* key, const int length, JsonCursor* value, ParseError* error);
+CursorResult json_cursor_index(JsonCursor* array, const int index, JsonCursor* value, ParseError* error);
+CursorResult json_cursor_path(JsonCursor* root, const JsonPath* path, JsonCursor* value, ParseError* error);
+JsonValue* json_cursor_value(const JsonCursor* cursor, ParseError* error);
+
+#endif
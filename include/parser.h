@@ -2,25 +2,55 @@
 #define PARSER_H
 
 #include "error.h"
+#include "arena.h"
+#include "events.h"
+#include "key_stack.h"
+
+#define DEFAULT_MAX_DEPTH 1024
 
 typedef struct JsonValue JsonValue;
-typedef struct JsonObject JsonObject;
+typedef struct keyTable KeyTable;
+
+// Work buffers of parse_json_events() and the tree builder. A caller parsing
+// many documents keeps one and points ParserState.scratch at it: the buffers
+// are only ever grown, so once they fit the largest document seen, parsing
+// needs no heap allocation for them.
+typedef struct parserScratch {
+  struct parseFrame* frames; // containers being filled by the tree builder
+  int frame_capacity;
+  struct eventFrame* events; // open containers, once the parser's local stack is full
+  int event_capacity;
+  char* text;                // decoded escaped strings, once the parser's local buffer is too small
+  int text_capacity;
+  KeyStack keys;             // keys of the open objects, for duplicate detection
+} ParserScratch;
 
 typedef struct parserState {
-  Token* tokens;
+  const TokenList* tokens;
   int current_index;
+  TokenizerState* tokenizer; // pull mode: tokens are produced on demand instead of read from `tokens`
+  Token lookahead;
+  Arena* arena; // when set, the tree is allocated from it and must not be passed to free_json_value()
+  int max_depth; // nesting limit of parse_json_value_iterative(), 0 = DEFAULT_MAX_DEPTH
+  ParserScratch* scratch; // optional: work buffers kept across parses instead of freed
+  KeyTable* keys; // optional: object keys are interned in it instead of copied or borrowed
 } ParserState;
 
+ParserState init_pull_parser(TokenizerState* tokenizer);
+void free_parser_state(ParserState* state);
+void init_parser_scratch(ParserScratch* scratch);
+void free_parser_scratch(ParserScratch* scratch);
+
+JsonValue* parse_json_text(ParserState* state, ParseError* error);
 JsonValue* parse_json_value(ParserState* state, ParseError* error);
-JsonValue* parse_null(ParserState* state, ParseError* error);
-JsonValue* parse_bool(ParserState* state, Token* token, ParseError* error);
-JsonValue* parse_number(ParserState* state, Token* token, ParseError* error);
-JsonValue* parse_string(ParserState* state, Token* token, ParseError* error);
-JsonValue* parse_object(ParserState* state, ParseError* error);
-JsonValue* parse_array(ParserState* state, ParseError* error);
+JsonValue* parse_json_value_iterative(ParserState* state, ParseError* error);
+bool parse_json_events(ParserState* state, const JsonEventHandler* handler, ParseError* error);
+bool parse_json_text_events(ParserState* state, const JsonEventHandler* handler, ParseError* error);
+JsonValue* build_json_tree(Arena* arena, JsonEventSource produce, void* source, ParseError* error);
 bool parser_match(ParserState*, const TokenType expected);
 Token parser_peek(ParserState*);
 void parser_advance(ParserState*);
-bool key_exists(JsonObject* object, const char* key);
+void report_value_expected(ParseError* error, const Token* token);
+void peek_error(ParserState* state, ParseError* error, const char* message);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdbool.h>
+#include "arena.h"
+#include "error.h"
+#include "json.h"
+
+// One step of a path: an object key, which is also an array position when it
+// is a canonical non-negative integer ("0", "17", not "01" or "-1"). The hash
+// is computed once at compile time, so lookups in indexed objects don't rehash.
+typedef struct pathStep {
+  const char* key; // decoded, NUL-terminated
+  int length;
+  unsigned int hash;
+  int index; // -1 when the key can't address an array element
+  const InternedKey* interned; // set by intern_json_path(), NULL otherwise
+} PathStep;
+
+// A path compiled once and evaluated against any number of trees. Accepted
+// forms are JSON Pointers (RFC 6901: "", "/a/b/0", with ~0 for '~' and ~1 for
+// '/') and dotted paths ("a.b[0].c", "a.b.0"); the empty path is the root.
+typedef struct jsonPath {
+  PathStep* steps;
+  int count;
+  char* keys; // storage of the decoded keys
+} JsonPath;
+
+bool compile_json_pointer(JsonPath* path, const char* pointer, ParseError* error);
+bool compile_json_dotted_path(JsonPath* path, const char* text, ParseError* error);
+bool compile_json_path(JsonPath* path, const char* text, ParseError* error);
+bool intern_json_path(JsonPath* path, KeyTable* table);
+JsonValue* json_path_get(const JsonPath* path, JsonValue* root);
+void free_json_path(JsonPath* path);
+
+// Many paths merged into a trie, so one walk over a tree answers all of them:
+// shared prefixes are looked up once and subtrees no path reaches are never
+// visited.
+typedef struct pathNode {
+  PathStep step;     // the edge from the parent, unused for the root
+  int first_child;   // -1 when none
+  int next_sibling;  // -1 when none
+  int first_target;  // first path ending at this node, -1 when none
+} PathNode;
+
+typedef struct jsonPathSet {
+  Arena keys;
+  PathNode* nodes; // nodes[0] is the root
+  int node_count;
+  int node_capacity;
+  int* next_target; // per path: the next path ending at the same node, -1 when none
+  int path_count;
+  int path_capacity;
+} JsonPathSet;
+
+void init_json_path_set(JsonPathSet* set);
+int json_path_set_add(JsonPathSet* set, const JsonPath* path);
+bool intern_json_path_set(JsonPathSet* set, KeyTable* table);
+bool json_path_set_eval(const JsonPathSet* set, JsonValue* root, JsonValue** results);
+void free_json_path_set(JsonPathSet* set);
+
+#endif
@@ -1,8 +1,26 @@
 #ifndef READ_FILE_H
 #define READ_FILE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#define INPUT_PADDING 16
+
+// Contents of an input file, always followed by INPUT_PADDING '\0' bytes so the
+// tokenizer can scan it in place and look a few bytes ahead of any position. Regular files are memory-mapped; stdin
+// ("-"), pipes and other streams are read into a heap buffer.
+typedef struct mappedFile {
+  char* data;
+  size_t length;
+  size_t mapped_length; // size of the mapping, 0 when data is a heap buffer
+} MappedFile;
+
 char* read_file(const char* filename);
+bool read_file_into(const char* filename, char** buffer, size_t* capacity, size_t* length);
+bool map_file(const char* filename, MappedFile* file);
+void unmap_file(MappedFile* file);
 bool has_json_extension(const char* filename);
 bool is_regular_file(const char* path);
+bool is_directory(const char* path);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,18 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <stddef.h>
+
+typedef enum scanLevel {
+  SCAN_SCALAR,
+  SCAN_SSE2,
+  SCAN_AVX2,
+} ScanLevel;
+
+ScanLevel detect_scan_level();
+ScanLevel get_scan_level();
+void set_scan_level(ScanLevel level);
+const char* scan_level_to_string(ScanLevel level);
+size_t scan_string_run(const char* input);
+
+#endif
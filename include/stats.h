@@ -0,0 +1,68 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "token_type.h"
+
+#define STATS_TOKEN_TYPES (TOKEN_INVALID_UTF8 + 1)
+
+// Phases timed by the driver. In pull mode tokens are lexed while parsing, so
+// their time is part of STATS_PARSE.
+typedef enum statsPhase {
+  STATS_READ,
+  STATS_TOKENIZE,
+  STATS_PARSE,
+  STATS_FREE,
+  STATS_PRINT,
+  STATS_PHASE_COUNT,
+} StatsPhase;
+
+// Counters of the calling thread. Allocations are the heap calls made by the
+// library (arena blocks count, carving from a block does not); string lengths
+// are in the source, before escapes are decoded.
+typedef struct jsonStats {
+  bool enabled;
+  uint64_t phase_ns[STATS_PHASE_COUNT];
+  uint64_t tokens[STATS_TOKEN_TYPES];
+  uint64_t allocations;
+  uint64_t allocated_bytes;
+  int max_depth;
+  int longest_string;
+  int largest_array;
+  int largest_object;
+} JsonStats;
+
+extern _Thread_local JsonStats json_stats;
+
+bool json_stats_available();
+bool json_stats_enable(const bool enabled);
+void json_stats_reset();
+const JsonStats* json_stats_get();
+uint64_t json_stats_clock();
+const char* stats_phase_to_string(StatsPhase phase);
+void print_json_stats(FILE* out, const JsonStats* stats);
+
+// The hooks cost nothing unless the build defines JSON_STATS, and then a
+// single branch while json_stats.enabled is off.
+#ifdef JSON_STATS
+#define STATS_TOKEN(type) \
+  do { if (json_stats.enabled) json_stats.tokens[(type)] += 1; } while (0)
+#define STATS_ALLOC(bytes) \
+  do { if (json_stats.enabled) { json_stats.allocations += 1; json_stats.allocated_bytes += (bytes); } } while (0)
+#define STATS_MAX(field, value) \
+  do { if (json_stats.enabled && (value) > json_stats.field) json_stats.field = (value); } while (0)
+#define STATS_CLOCK() (json_stats.enabled ? json_stats_clock() : 0)
+#define STATS_PHASE_END(phase, started) \
+  do { if (json_stats.enabled) json_stats.phase_ns[(phase)] += json_stats_clock() - (started); } while (0)
+#else
+#define STATS_TOKEN(type) ((void)0)
+#define STATS_ALLOC(bytes) ((void)0)
+#define STATS_MAX(field, value) ((void)0)
+#define STATS_CLOCK() ((uint64_t)0)
+#define STATS_PHASE_END(phase, started) ((void)(started))
+#endif
+
+#endif
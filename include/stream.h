@@ -0,0 +1,62 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "events.h"
+#include "error.h"
+#include "key_stack.h"
+
+// Push parser: the input is fed in chunks of any size and reported through a
+// JsonEventHandler as soon as each token is complete. Only the bytes of a
+// token split across two chunks are buffered, plus the container stack and the
+// keys of the objects still open (for duplicate detection), so memory does not
+// grow with the size of the document. Setting max_token_length bounds what a
+// single long string or number can make the buffer grow to.
+typedef enum streamState {
+  STREAM_VALUE,        // top-level value or a value after ':'
+  STREAM_ARRAY_FIRST,  // after '[': a value or ']'
+  STREAM_ARRAY_NEXT,   // after ',' in an array
+  STREAM_OBJECT_FIRST, // after '{': a key or '}'
+  STREAM_OBJECT_NEXT,  // after ',' in an object
+  STREAM_COLON,        // after a key
+  STREAM_AFTER_VALUE,  // after a value in a container: ',' or the closing bracket
+  STREAM_DONE,         // after the top-level value
+} StreamState;
+
+typedef struct streamFrame {
+  bool is_object;
+  KeyScope keys;
+} StreamFrame;
+
+typedef struct jsonStream {
+  JsonEventHandler handler;
+  StreamState state;
+  int max_depth; // 0 for DEFAULT_MAX_DEPTH
+  size_t max_token_length; // longest token accepted, in bytes (quotes included); 0 for no limit
+
+  char* buffer; // unconsumed input: the start of a token cut by the end of a chunk
+  size_t buffer_length;
+  size_t buffer_capacity;
+  size_t scanned; // bytes of that token already known not to end it, so they aren't scanned again
+  bool escaped;   // the byte before buffer[scanned] is a backslash escaping the next one
+  int line;       // position of buffer[0]
+  int column;
+
+  StreamFrame* frames;
+  int depth;
+  int frame_capacity;
+
+  KeyStack keys; // of the objects still open
+
+  bool ended;  // a '\0' byte ended the text, the rest of the input is ignored
+  bool failed;
+  ParseError error;
+} JsonStream;
+
+void init_json_stream(JsonStream* stream, const JsonEventHandler* handler);
+bool json_stream_feed(JsonStream* stream, const char* chunk, const size_t length, ParseError* error);
+bool json_stream_finish(JsonStream* stream, ParseError* error);
+void free_json_stream(JsonStream* stream);
+
+#endif
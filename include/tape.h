@@ -0,0 +1,94 @@
+#ifndef TAPE_H
+#define TAPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "error.h"
+#include "events.h"
+#include "json.h"
+#include "parser.h"
+
+// A parsed JSON text laid out flat: one array of 64-bit entries in document
+// order instead of a tree of pointers, so walking it reads memory front to
+// back. Each entry has a tag in its top byte and a 56-bit payload:
+//   TAPE_NULL, TAPE_TRUE, TAPE_FALSE    no payload
+//   TAPE_STRING, TAPE_KEY               offset of the text in `strings`
+//   TAPE_INT64 ... TAPE_BIG             offset of the lexeme in `strings`; the
+//                                       next entry holds the decoded value's bits
+//   TAPE_START_OBJECT, TAPE_START_ARRAY index of the entry after the matching
+//                                       end (bits 0-31) and child count (32-55,
+//                                       saturated at TAPE_MAX_COUNT)
+//   TAPE_END_OBJECT, TAPE_END_ARRAY     index of the matching start
+// Every member of an object is a TAPE_KEY entry followed by its value. Text in
+// `strings` is decoded, prefixed with its 32-bit length and NUL-terminated.
+//
+// A tape can be reused for many texts: its buffers are only grown.
+#define TAPE_TAG_SHIFT 56
+#define TAPE_PAYLOAD_MASK ((UINT64_C(1) << TAPE_TAG_SHIFT) - 1)
+#define TAPE_MAX_COUNT 0xFFFFFF
+
+typedef enum tapeTag {
+  TAPE_NULL = 'n',
+  TAPE_TRUE = 't',
+  TAPE_FALSE = 'f',
+  TAPE_STRING = '"',
+  TAPE_KEY = ':',
+  TAPE_INT64 = 'l',
+  TAPE_UINT64 = 'u',
+  TAPE_DOUBLE = 'd',
+  TAPE_BIG = 'b',
+  TAPE_START_OBJECT = '{',
+  TAPE_END_OBJECT = '}',
+  TAPE_START_ARRAY = '[',
+  TAPE_END_ARRAY = ']',
+} TapeTag;
+
+typedef struct jsonTape {
+  uint64_t* entries;
+  int count;
+  int capacity;
+  char* strings;
+  size_t string_length;
+  size_t string_capacity;
+  int max_depth; // 0 for DEFAULT_MAX_DEPTH
+
+  // Work buffers kept between parses
+  struct tapeFrame* frames;
+  int frame_capacity;
+  ParserScratch scratch;
+} JsonTape;
+
+// A value on a tape: the index of its first entry
+typedef struct jsonTapeValue {
+  const JsonTape* tape;
+  int index;
+} JsonTapeValue;
+
+// Walks the children of an array or the members of an object
+typedef struct jsonTapeIterator {
+  const JsonTape* tape;
+  int index; // next child
+  int end;   // the container's end entry
+} JsonTapeIterator;
+
+void init_json_tape(JsonTape* tape);
+bool parse_json_tape(JsonTape* tape, const char* input, ParseError* error);
+bool json_tape_from_value(JsonTape* tape, const JsonValue* root);
+void free_json_tape(JsonTape* tape);
+
+JsonTapeValue json_tape_root(const JsonTape* tape);
+JsonType json_tape_type(const JsonTapeValue value);
+bool json_tape_bool(const JsonTapeValue value);
+JsonNumber json_tape_number(const JsonTapeValue value);
+const char* json_tape_text(const JsonTapeValue value, int* length);
+int json_tape_count(const JsonTapeValue value);
+JsonTapeIterator json_tape_iterate(const JsonTapeValue container);
+bool json_tape_next(JsonTapeIterator* iterator, JsonTapeValue* value);
+bool json_tape_next_member(JsonTapeIterator* iterator, const char** key, int* key_length, JsonTapeValue* value);
+bool json_tape_find(const JsonTapeValue object, const char* key, const int length, JsonTapeValue* value);
+bool json_tape_replay(const JsonTapeValue value, const JsonEventHandler* handler, ParseError* error);
+JsonValue* json_tape_to_value(const JsonTapeValue value, Arena* arena, ParseError* error);
+
+#endif
@@ -21,6 +21,7 @@ typedef enum tokenType {
   TOKEN_INVALID_HEX,
   TOKEN_INVALID_CONTROL_CHARACTERS,
   TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER,
+  TOKEN_INVALID_UTF8,
 } TokenType;
 
 const char* token_type_to_string(TokenType type);
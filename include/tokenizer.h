@@ -3,31 +3,82 @@
 
 #include <stdbool.h>
 #include "token_type.h"
+#include "number.h"
 
+// Which text an invalid token shows (see token_display_text()); NOTE_NONE for valid tokens
+typedef enum tokenNote {
+  NOTE_NONE,
+  NOTE_UNEXPECTED_CHARACTER, // the character itself
+  NOTE_UNTERMINATED_STRING,
+  NOTE_ESCAPE,               // "\\" and the character after it
+  NOTE_UNICODE_ESCAPE,
+  NOTE_CONTROL_CHARACTER,    // "INVALID_CONTROL:0x.." of the character at the token's offset
+  NOTE_UTF8,
+  NOTE_MINUS,
+  NOTE_MINUS_DIGIT,
+  NOTE_LEADING_ZERO,
+  NOTE_HEX,
+  NOTE_FRACTION,
+  NOTE_EXPONENT,
+} TokenNote;
+
+// Tokens own no memory: strings and numbers are slices of the input.
 typedef struct token {
   TokenType type;
-  char* value;
-  int line;
+  int line;   // 0 for tokens taken from a TokenList until locate_token() works it out
   int column;
+  int offset; // strings and numbers: start of the lexeme in the input (string content excludes the quotes); other tokens: the position line/column describe
+  int length;
+  bool has_escapes;
+  unsigned char note; // TokenNote
 } Token;
 
+// Entry of a TokenList: the same token in 12 bytes, without line and column
+typedef struct packedToken {
+  int offset;
+  int length;
+  unsigned char type;
+  unsigned char note;
+  bool has_escapes;
+} PackedToken;
+
+// Every token of an input, from tokenize(). Positions are only derived from
+// the offsets when a diagnostic needs them. `input` must outlive the list.
+typedef struct tokenList {
+  const char* input;
+  PackedToken* tokens;
+  int count;
+  int capacity;
+} TokenList;
+
 typedef struct tokenizerState {
   const char* input;
   int current_index;
   int line;
   int column;
+  bool zero_copy; // the parser borrows strings and numbers from the input instead of copying them
+  JsonNumber number; // value of the last number token, decoded while it was lexed
 } TokenizerState;
 
 #include "error.h"
 
-Token* tokenize(const char* input, int* token_count);
+#define TOKEN_TEXT_SIZE 32
+
+bool tokenize(const char* input, TokenList* list);
+bool retokenize(const char* input, TokenList* list);
+Token get_token(const TokenList* list, const int index);
+void free_token_list(TokenList* list);
 Token next_token(TokenizerState* state);
 char peek(TokenizerState*);
 char advance(TokenizerState*);
-Token make_token(TokenType type, const char* value, const int line, const int column);
+Token make_token(TokenType type, const TokenNote note, const int offset, const int line, const int column);
+Token make_slice_token(TokenType type, const int start, const int length, const bool has_escapes, const int line, const int column);
 TokenizerState init_tokenizer(const char* input);
-void free_tokens(Token* tokens, const int count);
-void print_token(Token token, const int index, const bool color_enabled);
+void locate_offset(const char* input, const int offset, int* line, int* column);
+Token locate_token(const char* input, Token token);
+const char* token_display_text(const char* input, const Token* token, char* buffer, int* length);
+void print_token(const char* input, Token token, const int index, const bool color_enabled);
+void print_tokens(const TokenList* list, const bool color_enabled);
 bool match_keyword(TokenizerState* state, const char* keyword);
 
 #endif 
\ No newline at end of file
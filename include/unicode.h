@@ -0,0 +1,16 @@
+#ifndef UNICODE_H
+#define UNICODE_H
+
+#include <stdint.h>
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+#define UTF8_MAX_SEQUENCE 4
+
+// Length of the well-formed UTF-8 sequence at `input` (RFC 3629), 0 if invalid
+int utf8_sequence_length(const char* input);
+int encode_utf8(char* output, const uint32_t code_point);
+// Decodes the escapes of a validated string body, returns the decoded length.
+// The output is never longer than the input, so `output` may be `input`.
+int unescape_string(char* output, const char* input, const int length);
+
+#endif
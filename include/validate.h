@@ -0,0 +1,24 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <stdbool.h>
+#include "error.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+// Checks a JSON text without building a tree: parse_json_events() runs over
+// the input with a handler that does nothing, so only the container stack and
+// the keys of the objects still open (for duplicate detection) are kept, and
+// errors and their positions are the same as parse_json_text() reports. A
+// validator can be reused for many texts; its buffers are kept between calls.
+typedef struct jsonValidator {
+  int max_depth; // 0 for DEFAULT_MAX_DEPTH
+  ParserScratch scratch;
+} JsonValidator;
+
+void init_json_validator(JsonValidator* validator);
+bool validate_json_text(JsonValidator* validator, const char* input, ParseError* error);
+bool validate_json_value(JsonValidator* validator, TokenizerState* tokenizer, ParseError* error);
+void free_json_validator(JsonValidator* validator);
+
+#endif
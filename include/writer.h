@@ -0,0 +1,47 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "json.h"
+
+#define WRITER_BUFFER_SIZE (64 * 1024)
+#define WRITER_INDENT 2
+
+typedef enum writerStyle {
+  WRITER_COMPACT,
+  WRITER_PRETTY,
+} WriterStyle;
+
+// Receives each full buffer of output; returning false stops the writer
+typedef bool (*JsonSink)(void* context, const char* data, const size_t length);
+
+// Serializes JsonValue trees back to JSON text. Output is collected in a
+// buffer that either grows to hold everything (no sink, no fd) or is handed
+// to a sink / written to a file descriptor each time WRITER_BUFFER_SIZE
+// bytes have accumulated.
+typedef struct jsonWriter {
+  char* buffer;
+  size_t length;
+  size_t capacity;
+  JsonSink sink;
+  void* sink_context;
+  int fd; // -1 when not writing to a file descriptor
+  WriterStyle style;
+  bool failed; // out of memory, or the sink/fd refused the output
+} JsonWriter;
+
+void init_json_writer(JsonWriter* writer, const WriterStyle style);
+void init_json_writer_sink(JsonWriter* writer, const WriterStyle style, JsonSink sink, void* context);
+void init_json_writer_fd(JsonWriter* writer, const WriterStyle style, const int fd);
+bool write_json_value(JsonWriter* writer, const JsonValue* value);
+bool json_writer_raw(JsonWriter* writer, const char* data, const size_t length);
+bool json_writer_string(JsonWriter* writer, const char* text, const size_t length);
+bool json_writer_int64(JsonWriter* writer, const int64_t value);
+bool json_writer_uint64(JsonWriter* writer, const uint64_t value);
+bool json_writer_double(JsonWriter* writer, const double value);
+bool json_writer_flush(JsonWriter* writer);
+void free_json_writer(JsonWriter* writer);
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "stats.h"
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static ArenaBlock* new_block(size_t capacity) {
+  STATS_ALLOC(sizeof(ArenaBlock) + capacity);
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + capacity);
+  if (!block) {
+    fprintf(stderr, "Error: Can't allocate memory for arena block!\n");
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+void init_arena(Arena* arena) {
+  arena->first = NULL;
+  arena->current = NULL;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+  size = align_up(size);
+
+  ArenaBlock* block = arena->current;
+  if (block && block->capacity - block->used >= size) {
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+  }
+
+  // Reuse the blocks retained by a previous reset before asking malloc for more
+  while (block && block->next) {
+    block = block->next;
+    block->used = 0;
+    if (block->capacity >= size) {
+      arena->current = block;
+      block->used = size;
+      return block->data;
+    }
+  }
+
+  size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+  ArenaBlock* fresh = new_block(capacity);
+  if (!fresh) {
+    return NULL;
+  }
+
+  if (block) {
+    block->next = fresh;
+  } else {
+    arena->first = fresh;
+  }
+
+  arena->current = fresh;
+  fresh->used = size;
+  return fresh->data;
+}
+
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+  if (!ptr) {
+    return arena_alloc(arena, new_size);
+  }
+
+  ArenaBlock* block = arena->current;
+  size_t old_aligned = align_up(old_size);
+  size_t new_aligned = align_up(new_size);
+
+  // Grow in place when ptr is the most recent allocation of the current block
+  if (block && (char*)ptr + old_aligned == block->data + block->used &&
+    block->used - old_aligned + new_aligned <= block->capacity) {
+    block->used = block->used - old_aligned + new_aligned;
+    return ptr;
+  }
+
+  void* fresh = arena_alloc(arena, new_size);
+  if (fresh) {
+    memcpy(fresh, ptr, old_size < new_size ? old_size : new_size);
+  }
+  return fresh;
+}
+
+char* arena_strndup(Arena* arena, const char* s, size_t n) {
+  char* copy = arena_alloc(arena, n + 1);
+  if (copy) {
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+  }
+  return copy;
+}
+
+char* arena_strdup(Arena* arena, const char* s) {
+  return arena_strndup(arena, s, strlen(s));
+}
+
+void arena_reset(Arena* arena) {
+  arena->current = arena->first;
+  if (arena->first) {
+    arena->first->used = 0;
+  }
+}
+
+void free_arena(Arena* arena) {
+  ArenaBlock* block = arena->first;
+  while (block) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+
+  arena->first = NULL;
+  arena->current = NULL;
+}
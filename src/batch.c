@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "batch.h"
+#include "read_file.h"
+#include "document.h"
+#include "simd_scan.h"
+
+// ANSI color codes
+#define RESET   "\033[0m"
+#define RED     "\e[0;31m"
+
+#define PATH_SIZE 512
+#define INIT_QUEUE_CAPACITY 1024
+
+typedef struct batchItem {
+  char* path;
+  size_t bytes;
+  bool done;
+  bool ok;
+  ParseError error;
+} BatchItem;
+
+// Items are appended by the scan and handed out in order. `reported` trails
+// behind: the items before it have been printed and released.
+typedef struct batchQueue {
+  pthread_mutex_t lock;
+  pthread_cond_t has_work;
+  BatchItem** items;
+  long count;
+  long capacity;
+  long next;     // first item not yet taken by a worker
+  long reported; // first item not yet printed
+  bool scan_done;
+
+  const BatchOptions* options;
+  long failed;
+  size_t bytes;
+} BatchQueue;
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Threads used when none are asked for, at most MAX_THREADS
+int online_cpus() {
+#ifdef _SC_NPROCESSORS_ONLN
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus > 0) {
+    return cpus > MAX_THREADS ? MAX_THREADS : (int)cpus;
+  }
+#endif
+  return 1;
+}
+
+static bool enqueue(BatchQueue* queue, const char* path) {
+  BatchItem* item = malloc(sizeof(BatchItem));
+  char* copy = strdup(path);
+  if (!item || !copy) {
+    fprintf(stderr, "Error: Can't allocate memory for batch item!\n");
+    free(item);
+    free(copy);
+    return false;
+  }
+
+  item->path = copy;
+  item->bytes = 0;
+  item->done = false;
+  item->ok = false;
+  clear_error(&item->error);
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->count == queue->capacity) {
+    long capacity = queue->capacity > 0 ? queue->capacity * 2 : INIT_QUEUE_CAPACITY;
+    BatchItem** items = realloc(queue->items, sizeof(BatchItem*) * capacity);
+    if (!items) {
+      pthread_mutex_unlock(&queue->lock);
+      fprintf(stderr, "Error: Can't reallocate memory while growing batch queue!\n");
+      free(copy);
+      free(item);
+      return false;
+    }
+    queue->items = items;
+    queue->capacity = capacity;
+  }
+
+  queue->items[queue->count] = item;
+  queue->count += 1;
+  pthread_cond_signal(&queue->has_work);
+  pthread_mutex_unlock(&queue->lock);
+  return true;
+}
+
+// Depth-first, in readdir order, skipping hidden entries like main() does
+static bool scan_folder(BatchQueue* queue, const char* folder_path) {
+  DIR* dir = opendir(folder_path);
+  if (!dir) {
+    fprintf(stderr, "Error: folder '%s' not found!\n", folder_path);
+    return false;
+  }
+
+  bool ok = true;
+  struct dirent* entry;
+  while (ok && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    char full_path[PATH_SIZE];
+    snprintf(full_path, sizeof(full_path), "%s%s%s",
+      folder_path,
+      folder_path[strlen(folder_path) - 1] == '/' ? "" : "/",
+      entry->d_name);
+
+    if (is_directory(full_path)) {
+      ok = scan_folder(queue, full_path);
+    } else if (has_json_extension(entry->d_name) && is_regular_file(full_path)) {
+      ok = enqueue(queue, full_path);
+    }
+  }
+
+  closedir(dir);
+  return ok;
+}
+
+static void report_item(BatchQueue* queue, BatchItem* item) {
+  queue->bytes += item->bytes;
+  if (!item->ok) {
+    queue->failed += 1;
+    if (queue->options->color_enabled) {
+      printf("%sFAIL%s %s: %s (line %d, column %d)\n", RED, RESET,
+        item->path, item->error.message, item->error.line, item->error.column);
+    } else {
+      printf("FAIL %s: %s (line %d, column %d)\n",
+        item->path, item->error.message, item->error.line, item->error.column);
+    }
+  }
+}
+
+// Called with the lock held: prints the finished prefix of the queue
+static void report_finished(BatchQueue* queue) {
+  while (queue->reported < queue->next && queue->items[queue->reported]->done) {
+    BatchItem* item = queue->items[queue->reported];
+    report_item(queue, item);
+    free(item->path);
+    free(item);
+    queue->items[queue->reported] = NULL;
+    queue->reported += 1;
+  }
+}
+
+static void* batch_worker(void* argument) {
+  BatchQueue* queue = argument;
+
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = true; // the tree is dropped before the buffer is reused
+  document.max_depth = queue->options->max_depth;
+  document.keys = queue->options->keys;
+
+  char* buffer = NULL;
+  size_t capacity = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  while (true) {
+    while (queue->next == queue->count && !queue->scan_done) {
+      pthread_cond_wait(&queue->has_work, &queue->lock);
+    }
+
+    if (queue->next == queue->count) {
+      break;
+    }
+
+    BatchItem* item = queue->items[queue->next];
+    queue->next += 1;
+    pthread_mutex_unlock(&queue->lock);
+
+    size_t length = 0;
+    if (read_file_into(item->path, &buffer, &capacity, &length)) {
+      item->bytes = length;
+      item->ok = parse_json_document(&document, buffer, &item->error) != NULL;
+      reset_json_document(&document);
+    } else {
+      set_error(&item->error, "Can't read file", 0, 0);
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    item->done = true;
+    report_finished(queue);
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  free(buffer);
+  free_json_document(&document);
+  return NULL;
+}
+
+bool run_batch(const char* folder_path, const BatchOptions* options, BatchSummary* summary) {
+  int threads = options->threads > 0 ? options->threads : online_cpus();
+  if (threads > MAX_THREADS) {
+    threads = MAX_THREADS;
+  }
+
+  BatchQueue queue = {
+    .items = NULL,
+    .count = 0,
+    .capacity = 0,
+    .next = 0,
+    .reported = 0,
+    .scan_done = false,
+    .options = options,
+    .failed = 0,
+    .bytes = 0,
+  };
+  pthread_mutex_init(&queue.lock, NULL);
+  pthread_cond_init(&queue.has_work, NULL);
+
+  // Pick the string scanner before the workers race to do it lazily
+  get_scan_level();
+
+  double start = now_seconds();
+
+  pthread_t workers[MAX_THREADS];
+  int started = 0;
+  while (started < threads && pthread_create(&workers[started], NULL, batch_worker, &queue) == 0) {
+    started += 1;
+  }
+
+  bool scanned = started > 0 && scan_folder(&queue, folder_path);
+  if (started == 0) {
+    fprintf(stderr, "Error: Can't start batch worker threads!\n");
+  }
+
+  pthread_mutex_lock(&queue.lock);
+  queue.scan_done = true;
+  pthread_cond_broadcast(&queue.has_work);
+  pthread_mutex_unlock(&queue.lock);
+
+  for (int i = 0; i < started; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+
+  summary->files = queue.count;
+  summary->failed = queue.failed;
+  summary->bytes = queue.bytes;
+  summary->seconds = now_seconds() - start;
+  summary->threads = started;
+
+  free(queue.items);
+  pthread_cond_destroy(&queue.has_work);
+  pthread_mutex_destroy(&queue.lock);
+  return scanned;
+}
+
+void print_batch_summary(const BatchSummary* summary) {
+  double megabytes = summary->bytes / (1024.0 * 1024.0);
+  double seconds = summary->seconds > 0 ? summary->seconds : 1e-9;
+
+  printf("\nFiles: %ld (%ld failed), %.1f MB in %.3f s with %d thread%s\n",
+    summary->files, summary->failed, megabytes, summary->seconds,
+    summary->threads, summary->threads == 1 ? "" : "s");
+  printf("Throughput: %.0f files/s, %.1f MB/s\n", summary->files / seconds, megabytes / seconds);
+}
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <string.h>
+#include "document.h"
+
+void init_json_document(JsonDocument* document) {
+  init_arena(&document->arena);
+  document->root = NULL;
+  document->zero_copy = false;
+  document->max_depth = 0;
+  init_parser_scratch(&document->scratch);
+  document->keys = NULL;
+}
+
+JsonValue* parse_json_document(JsonDocument* document, const char* input, ParseError* error) {
+  reset_json_document(document);
+
+  TokenizerState tokenizer = init_tokenizer(input);
+  tokenizer.zero_copy = document->zero_copy;
+
+  ParserState parser_state = init_pull_parser(&tokenizer);
+  parser_state.max_depth = document->max_depth;
+  parser_state.arena = &document->arena;
+  parser_state.scratch = &document->scratch;
+  parser_state.keys = document->keys;
+
+  document->root = parse_json_text(&parser_state, error);
+  free_parser_state(&parser_state);
+
+  return document->root;
+}
+
+void reset_json_document(JsonDocument* document) {
+  arena_reset(&document->arena);
+  document->root = NULL;
+}
+
+void free_json_document(JsonDocument* document) {
+  free_arena(&document->arena);
+  free_parser_scratch(&document->scratch);
+  document->root = NULL;
+}
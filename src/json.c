@@ -2,6 +2,8 @@
 #include <string.h>
 #include <stdio.h>
 #include "json.h"
+#include "key_table.h"
+#include "stats.h"
 
 // ANSI color codes
 #define RESET   "\033[0m"
@@ -10,20 +12,149 @@
 #define CYAN    "\033[36m"
 #define RED     "\e[0;31m"
 
-void free_json_value(JsonValue* value) {
-  if (!value) {
-    return;
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+// FNV-1a
+unsigned int hash_key(const char* key, const int length) {
+  unsigned int hash = FNV_OFFSET_BASIS;
+  for (int i = 0; i < length; ++i) {
+    hash ^= (unsigned char)key[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static bool pair_has_key(const JsonPair* pair, const char* key, const int length) {
+  return pair->key_length == length && memcmp(pair->key, key, length) == 0;
+}
+
+// Position of the pair with the given key, or -1. Small objects are scanned
+// linearly, larger ones go through their hash index.
+int json_object_find(const JsonObject* object, const char* key, const int length) {
+  return json_object_find_hashed(object, key, length, object->index ? hash_key(key, length) : 0);
+}
+
+// Same as json_object_find() with the hash_key() of the key already known
+int json_object_find_hashed(const JsonObject* object, const char* key, const int length, const unsigned int hash) {
+  if (!object->index) {
+    for (int i = 0; i < object->count; ++i) {
+      if (pair_has_key(object->pairs[i], key, length)) {
+        return i;
+      }
+    }
+    return -1;
   }
 
+  unsigned int mask = object->index_capacity - 1;
+  for (unsigned int slot = hash & mask; object->index[slot] != 0; slot = (slot + 1) & mask) {
+    int position = object->index[slot] - 1;
+    if (pair_has_key(object->pairs[position], key, length)) {
+      return position;
+    }
+  }
+  return -1;
+}
+
+// Pairs with an interned key are matched on the pointer alone
+static bool pair_is_interned(const JsonPair* pair, const InternedKey* key) {
+  return pair->interned_key ? pair->key == key->text : pair_has_key(pair, key->text, key->length);
+}
+
+// Same as json_object_find() for a key of the KeyTable the tree was parsed
+// with: no bytes are compared and no hash is computed
+int json_object_find_interned(const JsonObject* object, const InternedKey* key) {
+  if (!object->index) {
+    for (int i = 0; i < object->count; ++i) {
+      if (pair_is_interned(object->pairs[i], key)) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  unsigned int mask = object->index_capacity - 1;
+  for (unsigned int slot = key->hash & mask; object->index[slot] != 0; slot = (slot + 1) & mask) {
+    int position = object->index[slot] - 1;
+    if (pair_is_interned(object->pairs[position], key)) {
+      return position;
+    }
+  }
+  return -1;
+}
+
+JsonValue* json_object_get(const JsonObject* object, const char* key, const int length) {
+  int position = json_object_find(object, key, length);
+  return position >= 0 ? object->pairs[position]->value : NULL;
+}
+
+// The caller guarantees the index has a free slot (it is kept at most half full)
+void json_object_index_insert(JsonObject* object, const int position) {
+  const JsonPair* pair = object->pairs[position];
+  unsigned int mask = object->index_capacity - 1;
+  unsigned int hash = pair->interned_key ? interned_key(pair->key)->hash : hash_key(pair->key, pair->key_length);
+  unsigned int slot = hash & mask;
+  while (object->index[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  object->index[slot] = position + 1;
+}
+
+JsonNumber json_number(const JsonValue* value) {
+  JsonNumber number = { .kind = value->number_kind, .value = value->numeric };
+  return number;
+}
+
+// Exact conversions only: false when the number is not an integer in range
+bool json_number_as_int64(const JsonValue* value, int64_t* result) {
+  if (value->number_kind != NUMBER_INT64) {
+    return false;
+  }
+
+  *result = value->numeric.integer;
+  return true;
+}
+
+bool json_number_as_uint64(const JsonValue* value, uint64_t* result) {
+  if (value->number_kind == NUMBER_UINT64) {
+    *result = value->numeric.unsigned_integer;
+    return true;
+  }
+
+  if (value->number_kind == NUMBER_INT64 && value->numeric.integer >= 0) {
+    *result = (uint64_t)value->numeric.integer;
+    return true;
+  }
+
+  return false;
+}
+
+// Nearest double, whatever the kind
+double json_number_as_double(const JsonValue* value) {
+  switch (value->number_kind) {
+    case NUMBER_INT64: return (double)value->numeric.integer;
+    case NUMBER_UINT64: return (double)value->numeric.unsigned_integer;
+    default: return value->numeric.real;
+  }
+}
+
+#define FREE_STACK_SIZE 64
+
+static void free_json_node(JsonValue* value) {
   switch (value->type) {
     case JSON_STRING:
-      free(value->string);
+      if (!value->borrowed) {
+        free(value->string);
+      }
       break;
 
-    case JSON_ARRAY: {
-      for (int i = 0; i < value->array->count; ++i) {
-        free_json_value(value->array->elements[i]);
+    case JSON_NUMBER:
+      if (!value->borrowed) {
+        free(value->number);
       }
+      break;
+
+    case JSON_ARRAY: {
       free(value->array->elements);
       free(value->array);
       break;
@@ -33,130 +164,277 @@ void free_json_value(JsonValue* value) {
       if (value->object && value->object->pairs) {
         for (int i = 0; i < value->object->count; ++i) {
           if (value->object->pairs[i]) {
-            free(value->object->pairs[i]->key);
-            free_json_value(value->object->pairs[i]->value);
+            if (!value->object->pairs[i]->borrowed_key) {
+              free(value->object->pairs[i]->key);
+            }
             free(value->object->pairs[i]);
           }
         }
         free(value->object->pairs);
       }
+      free(value->object->index);
       free(value->object);
       break;
     }
+
+    default:
+      break;
   }
 
   free(value);
 }
 
+// Walks the tree with an explicit stack (on the C stack while it fits, on the
+// heap beyond that) so arbitrarily deep trees can be released.
+void free_json_value(JsonValue* value) {
+  if (!value) {
+    return;
+  }
+
+  JsonValue* local[FREE_STACK_SIZE];
+  JsonValue** pending = local;
+  int capacity = FREE_STACK_SIZE;
+  int count = 0;
+
+  pending[count] = value;
+  count += 1;
+
+  while (count > 0) {
+    count -= 1;
+    JsonValue* current = pending[count];
+
+    int children = 0;
+    if (current->type == JSON_ARRAY) {
+      children = current->array->count;
+    } else if (current->type == JSON_OBJECT && current->object && current->object->pairs) {
+      children = current->object->count;
+    }
+
+    if (count + children > capacity) {
+      int grown = capacity * 2;
+      while (count + children > grown) {
+        grown *= 2;
+      }
+
+      STATS_ALLOC(sizeof(JsonValue*) * grown);
+      JsonValue** heap = malloc(sizeof(JsonValue*) * grown);
+      if (!heap) {
+        fprintf(stderr, "Error: Can't allocate memory while freeing JsonValue!\n");
+        break;
+      }
+
+      memcpy(heap, pending, sizeof(JsonValue*) * count);
+      if (pending != local) {
+        free(pending);
+      }
+      pending = heap;
+      capacity = grown;
+    }
+
+    for (int i = 0; i < children; ++i) {
+      JsonValue* child = current->type == JSON_ARRAY
+        ? current->array->elements[i]
+        : (current->object->pairs[i] ? current->object->pairs[i]->value : NULL);
+      if (child) {
+        pending[count] = child;
+        count += 1;
+      }
+    }
+
+    free_json_node(current);
+  }
+
+  if (pending != local) {
+    free(pending);
+  }
+}
+
 void print_indent(int indent) {
   for (int i = 0; i < indent; ++i) {
     printf("  ");
   }
 }
 
-void print_json_value(const JsonValue* value, const int indent, const bool color_enabled) {
+// Writes decoded string text back in JSON notation, so quotes, backslashes and
+// control characters (including NUL) stay visible in the printed tree.
+void print_escaped(const char* text, const int length) {
+  int start = 0;
+  for (int i = 0; i < length; ++i) {
+    unsigned char c = (unsigned char)text[i];
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+
+    fwrite(&text[start], 1, i - start, stdout);
+    start = i + 1;
+    switch (c) {
+      case '"': fputs("\\\"", stdout); break;
+      case '\\': fputs("\\\\", stdout); break;
+      case '\b': fputs("\\b", stdout); break;
+      case '\f': fputs("\\f", stdout); break;
+      case '\n': fputs("\\n", stdout); break;
+      case '\r': fputs("\\r", stdout); break;
+      case '\t': fputs("\\t", stdout); break;
+      default: printf("\\u%04X", c); break;
+    }
+  }
+  fwrite(&text[start], 1, length - start, stdout);
+}
+
+// Prints a scalar, or the opening line of a container. Returns the number of
+// children left to print, 0 when the value is already complete.
+static int print_json_node(const JsonValue* value, const bool color_enabled) {
   if (!value) {
     printf("NULL VALUE\n");
-    return;
+    return 0;
   }
 
   if (color_enabled) {
     switch (value->type) {
       case JSON_STRING: {
-        printf("%sSTRING%s(%s\"%s\"%s)\n", YELLOW, RESET, GREEN, value->string, RESET);
-        break;
+        printf("%sSTRING%s(%s\"", YELLOW, RESET, GREEN);
+        print_escaped(value->string, value->length);
+        printf("\"%s)\n", RESET);
+        return 0;
       }
 
       case JSON_NUMBER: {
-        printf("%sNUMBER%s(%s%s%s)\n", YELLOW, RESET, RED, value->number, RESET);
-        break;
+        printf("%sNUMBER%s(%s%.*s%s)\n", YELLOW, RESET, RED, value->length, value->number, RESET);
+        return 0;
       }
 
       case JSON_BOOL: {
         printf("%sBOOLEAN%s(%s%s%s)\n", RED, RESET, CYAN, value->boolean ? "true" : "false", RESET);
-        break;
+        return 0;
       }
 
       case JSON_NULL: {
         printf("%sNULL%s\n", CYAN, RESET);
-        break;
+        return 0;
       }
 
       case JSON_ARRAY: {
-        printf("%sARRAY%s [%s", CYAN, RESET, value->array->count > 0 ? "\n" : "");
-        for (int i = 0; i < value->array->count; ++i) {
-          print_indent(indent + 1);
-          print_json_value(value->array->elements[i], indent + 1, color_enabled);
-        }
-        if (value->object->count > 0) {
-          print_indent(indent);
-        }
-        printf("]\n");
-        break;
+        printf("%sARRAY%s [%s", CYAN, RESET, value->array->count > 0 ? "\n" : "]\n");
+        return value->array->count;
       }
-      
+
       case JSON_OBJECT: {
-        printf("%sOBJECT%s {%s", CYAN, RESET, value->object->count > 0 ? "\n" : "");
-        for (int i = 0; i < value->object->count; ++i) {
-          print_indent(indent + 1);
-          printf("\"%s\": ", value->object->pairs[i]->key);
-          print_json_value(value->object->pairs[i]->value, indent + 1, color_enabled);
-        }
-        if (value->object->count > 0) {
-          print_indent(indent);
-        }
-        printf("}\n");
-        break;
+        printf("%sOBJECT%s {%s", CYAN, RESET, value->object->count > 0 ? "\n" : "}\n");
+        return value->object->count;
       }
     }
   } else {
     switch (value->type) {
       case JSON_STRING: {
-        printf("STRING(\"%s\")\n", value->string);
-        break;
+        printf("STRING(\"");
+        print_escaped(value->string, value->length);
+        printf("\")\n");
+        return 0;
       }
 
       case JSON_NUMBER: {
-        printf("NUMBER(%s)\n", value->number);
-        break;
+        printf("NUMBER(%.*s)\n", value->length, value->number);
+        return 0;
       }
 
       case JSON_BOOL: {
         printf("BOOLEAN(%s)\n", value->boolean ? "true" : "false");
-        break;
+        return 0;
       }
 
       case JSON_NULL: {
         printf("NULL\n");
-        break;
+        return 0;
       }
 
       case JSON_ARRAY: {
-        printf("ARRAY [%s", value->array->count > 0 ? "\n" : "");
-        for (int i = 0; i < value->array->count; ++i) {
-          print_indent(indent + 1);
-          print_json_value(value->array->elements[i], indent + 1, color_enabled);
-        }
-        if (value->object->count > 0) {
-          print_indent(indent);
-        }
-        printf("]\n");
-        break;
+        printf("ARRAY [%s", value->array->count > 0 ? "\n" : "]\n");
+        return value->array->count;
       }
-      
+
       case JSON_OBJECT: {
-        printf("OBJECT {%s", value->object->count > 0 ? "\n" : "");
-        for (int i = 0; i < value->object->count; ++i) {
-          print_indent(indent + 1);
-          printf("\"%s\": ", value->object->pairs[i]->key);
-          print_json_value(value->object->pairs[i]->value, indent + 1, color_enabled);
-        }
-        if (value->object->count > 0) {
-          print_indent(indent);
-        }
-        printf("}\n");
+        printf("OBJECT {%s", value->object->count > 0 ? "\n" : "}\n");
+        return value->object->count;
+      }
+    }
+  }
+
+  return 0;
+}
+
+#define PRINT_STACK_SIZE 64
+
+// A container whose children are being printed
+typedef struct printFrame {
+  const JsonValue* container;
+  int next; // index of the next child to print
+} PrintFrame;
+
+// Like free_json_value(), walks the tree with an explicit stack (on the C
+// stack while it fits, on the heap beyond that), so the depth of the printed
+// tree is not limited by the C stack.
+void print_json_value(const JsonValue* value, const int indent, const bool color_enabled) {
+  PrintFrame local[PRINT_STACK_SIZE];
+  PrintFrame* frames = local;
+  int capacity = PRINT_STACK_SIZE;
+  int depth = 0;
+
+  if (print_json_node(value, color_enabled) > 0) {
+    frames[depth] = (PrintFrame){ .container = value, .next = 0 };
+    depth += 1;
+  }
+
+  while (depth > 0) {
+    PrintFrame* frame = &frames[depth - 1];
+    const JsonValue* container = frame->container;
+    int child_indent = indent + depth;
+
+    int count = container->type == JSON_ARRAY ? container->array->count : container->object->count;
+    if (frame->next == count) {
+      print_indent(child_indent - 1);
+      printf(container->type == JSON_ARRAY ? "]\n" : "}\n");
+      depth -= 1;
+      continue;
+    }
+
+    const JsonValue* child;
+    print_indent(child_indent);
+    if (container->type == JSON_ARRAY) {
+      child = container->array->elements[frame->next];
+    } else {
+      const JsonPair* pair = container->object->pairs[frame->next];
+      printf("\"");
+      print_escaped(pair->key, pair->key_length);
+      printf("\": ");
+      child = pair->value;
+    }
+    frame->next += 1;
+
+    if (print_json_node(child, color_enabled) == 0) {
+      continue;
+    }
+
+    if (depth == capacity) {
+      STATS_ALLOC(sizeof(PrintFrame) * capacity * 2);
+      PrintFrame* heap = malloc(sizeof(PrintFrame) * capacity * 2);
+      if (!heap) {
+        fprintf(stderr, "Error: Can't allocate memory while printing JsonValue!\n");
         break;
       }
+
+      memcpy(heap, frames, sizeof(PrintFrame) * depth);
+      if (frames != local) {
+        free(frames);
+      }
+      frames = heap;
+      capacity *= 2;
     }
+
+    frames[depth] = (PrintFrame){ .container = child, .next = 0 };
+    depth += 1;
+  }
+
+  if (frames != local) {
+    free(frames);
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "key_stack.h"
+#include "json.h"
+#include "stats.h"
+
+#define INIT_KEY_CAPACITY 16
+
+void init_key_stack(KeyStack* stack) {
+  stack->keys = NULL;
+  stack->key_count = 0;
+  stack->key_capacity = 0;
+  stack->pool = NULL;
+  stack->pool_length = 0;
+  stack->pool_capacity = 0;
+}
+
+// Doubles *capacity until it holds `needed` elements
+static bool ensure_capacity(void** data, int* capacity, const int needed, const size_t element_size) {
+  if (needed <= *capacity) {
+    return true;
+  }
+
+  int grown = *capacity > 0 ? *capacity : INIT_KEY_CAPACITY;
+  while (grown < needed) {
+    grown *= 2;
+  }
+
+  STATS_ALLOC(element_size * grown);
+  void* resized = realloc(*data, element_size * grown);
+  if (!resized) {
+    fprintf(stderr, "Error: Can't allocate memory for object keys!\n");
+    return false;
+  }
+
+  *data = resized;
+  *capacity = grown;
+  return true;
+}
+
+KeyScope open_key_scope(const KeyStack* stack) {
+  KeyScope scope = {
+    .first_key = stack->key_count,
+    .pool_start = stack->pool_length,
+    .index = NULL,
+    .index_capacity = 0,
+  };
+  return scope;
+}
+
+// Forgets the keys of the innermost object
+void close_key_scope(KeyStack* stack, KeyScope* scope) {
+  free(scope->index);
+  scope->index = NULL;
+  scope->index_capacity = 0;
+  stack->key_count = scope->first_key;
+  stack->pool_length = scope->pool_start;
+}
+
+static bool key_matches(const KeyStack* stack, const StackedKey* entry, const unsigned int hash, const char* key, const int length) {
+  // The pool is still NULL while only empty keys were added
+  return entry->hash == hash && entry->length == length &&
+    (length == 0 || memcmp(stack->pool + entry->offset, key, length) == 0);
+}
+
+bool key_scope_contains(const KeyStack* stack, const KeyScope* scope, const unsigned int hash, const char* key, const int length) {
+  if (!scope->index) {
+    for (int i = scope->first_key; i < stack->key_count; ++i) {
+      if (key_matches(stack, &stack->keys[i], hash, key, length)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  unsigned int mask = scope->index_capacity - 1;
+  for (unsigned int slot = hash & mask; scope->index[slot] != 0; slot = (slot + 1) & mask) {
+    if (key_matches(stack, &stack->keys[scope->first_key + scope->index[slot] - 1], hash, key, length)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void scope_index_insert(const KeyStack* stack, KeyScope* scope, const int position) {
+  unsigned int mask = scope->index_capacity - 1;
+  unsigned int slot = stack->keys[scope->first_key + position].hash & mask;
+  while (scope->index[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  scope->index[slot] = position + 1;
+}
+
+// Remembers a key of the innermost object. Same indexing policy as object_push() in parser.c.
+bool key_scope_add(KeyStack* stack, KeyScope* scope, const unsigned int hash, const char* key, const int length) {
+  if (!ensure_capacity((void**)&stack->keys, &stack->key_capacity, stack->key_count + 1, sizeof(StackedKey)) ||
+    !ensure_capacity((void**)&stack->pool, &stack->pool_capacity, stack->pool_length + length, sizeof(char))) {
+    return false;
+  }
+
+  if (length > 0) {
+    memcpy(stack->pool + stack->pool_length, key, length);
+  }
+  stack->keys[stack->key_count] = (StackedKey){ .hash = hash, .offset = stack->pool_length, .length = length };
+  stack->key_count += 1;
+  stack->pool_length += length;
+
+  int count = stack->key_count - scope->first_key;
+  if (count < KEY_INDEX_THRESHOLD) {
+    return true;
+  }
+
+  if (scope->index && count * 2 <= scope->index_capacity) {
+    scope_index_insert(stack, scope, count - 1);
+    return true;
+  }
+
+  int index_capacity = KEY_INDEX_THRESHOLD;
+  while (index_capacity < count * 4) {
+    index_capacity *= 2;
+  }
+
+  free(scope->index);
+  STATS_ALLOC(sizeof(int) * index_capacity);
+  scope->index = calloc(index_capacity, sizeof(int));
+  scope->index_capacity = 0;
+
+  if (!scope->index) {
+    // The index is only an accelerator: lookups fall back to a linear scan
+    fprintf(stderr, "Error: Can't allocate memory for object's key index!\n");
+    return true;
+  }
+
+  scope->index_capacity = index_capacity;
+  for (int i = 0; i < count; ++i) {
+    scope_index_insert(stack, scope, i);
+  }
+  return true;
+}
+
+void free_key_stack(KeyStack* stack) {
+  free(stack->keys);
+  free(stack->pool);
+  init_key_stack(stack);
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "key_table.h"
+#include "json.h"
+#include "stats.h"
+
+#define INIT_SLOT_CAPACITY 256
+
+struct keySlots {
+  KeySlots* next_retired;
+  unsigned int capacity; // power of two
+  _Atomic(const InternedKey*) entries[];
+};
+
+void init_key_table(KeyTable* table) {
+  atomic_init(&table->slots, NULL);
+  table->retired = NULL;
+  init_arena(&table->keys);
+  atomic_init(&table->count, 0);
+  pthread_mutex_init(&table->lock, NULL);
+}
+
+// The entry with the given key, or NULL with *free_slot set to where it would go
+static const InternedKey* probe(const KeySlots* slots, const char* key, const int length, const unsigned int hash,
+    unsigned int* free_slot) {
+  if (!slots) {
+    return NULL;
+  }
+
+  unsigned int mask = slots->capacity - 1;
+  for (unsigned int slot = hash & mask; ; slot = (slot + 1) & mask) {
+    const InternedKey* entry = atomic_load_explicit(&slots->entries[slot], memory_order_acquire);
+    if (!entry) {
+      *free_slot = slot;
+      return NULL;
+    }
+
+    if (entry->hash == hash && entry->length == length && memcmp(entry->text, key, length) == 0) {
+      return entry;
+    }
+  }
+}
+
+// Called with the lock held. The new table is filled before it is published;
+// the old one is kept, since a reader may still be probing it.
+static KeySlots* grow_slots(KeyTable* table, KeySlots* old) {
+  unsigned int capacity = old ? old->capacity * 2 : INIT_SLOT_CAPACITY;
+  size_t size = sizeof(KeySlots) + sizeof(_Atomic(const InternedKey*)) * capacity;
+  STATS_ALLOC(size);
+  KeySlots* slots = calloc(1, size);
+  if (!slots) {
+    fprintf(stderr, "Error: Can't allocate memory for the key table!\n");
+    return NULL;
+  }
+  slots->capacity = capacity;
+
+  if (old) {
+    for (unsigned int i = 0; i < old->capacity; ++i) {
+      const InternedKey* entry = atomic_load_explicit(&old->entries[i], memory_order_relaxed);
+      if (entry) {
+        unsigned int slot = entry->hash & (capacity - 1);
+        while (atomic_load_explicit(&slots->entries[slot], memory_order_relaxed)) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+        atomic_store_explicit(&slots->entries[slot], entry, memory_order_relaxed);
+      }
+    }
+
+    old->next_retired = table->retired;
+    table->retired = old;
+  }
+
+  atomic_store_explicit(&table->slots, slots, memory_order_release);
+  return slots;
+}
+
+// Called with the lock held, once the key is known to be missing
+static const InternedKey* add_key(KeyTable* table, const char* key, const int length, const unsigned int hash) {
+  KeySlots* slots = atomic_load_explicit(&table->slots, memory_order_relaxed);
+  int count = atomic_load_explicit(&table->count, memory_order_relaxed);
+  if (!slots || (unsigned int)(count + 1) * 2 > slots->capacity) {
+    slots = grow_slots(table, slots);
+    if (!slots) {
+      return NULL;
+    }
+  }
+
+  InternedKey* entry = arena_alloc(&table->keys, sizeof(InternedKey) + length + 1);
+  if (!entry) {
+    fprintf(stderr, "Error: Can't allocate memory for an interned key!\n");
+    return NULL;
+  }
+
+  entry->hash = hash;
+  entry->id = count;
+  entry->length = length;
+  memcpy(entry->text, key, length);
+  entry->text[length] = '\0';
+
+  unsigned int slot = 0;
+  probe(slots, key, length, hash, &slot);
+  atomic_store_explicit(&slots->entries[slot], entry, memory_order_release);
+  atomic_store_explicit(&table->count, count + 1, memory_order_relaxed);
+  return entry;
+}
+
+// The interned key with the given text, or NULL when it was never added
+const InternedKey* key_table_find(const KeyTable* table, const char* key, const int length) {
+  unsigned int slot;
+  return probe(atomic_load_explicit(&table->slots, memory_order_acquire), key, length, hash_key(key, length), &slot);
+}
+
+// The interned key with the given text, added if needed; NULL when out of memory
+const InternedKey* key_table_intern(KeyTable* table, const char* key, const int length) {
+  unsigned int hash = hash_key(key, length);
+  unsigned int slot;
+  const InternedKey* entry = probe(atomic_load_explicit(&table->slots, memory_order_acquire), key, length, hash, &slot);
+  if (entry) {
+    return entry;
+  }
+
+  pthread_mutex_lock(&table->lock);
+  // Another thread may have added it since
+  entry = probe(atomic_load_explicit(&table->slots, memory_order_relaxed), key, length, hash, &slot);
+  if (!entry) {
+    entry = add_key(table, key, length, hash);
+  }
+  pthread_mutex_unlock(&table->lock);
+  return entry;
+}
+
+// The entry of a canonical pointer (a JsonPair key with `interned_key` set)
+const InternedKey* interned_key(const char* text) {
+  return (const InternedKey*)(text - offsetof(InternedKey, text));
+}
+
+int key_table_count(const KeyTable* table) {
+  return atomic_load_explicit(&table->count, memory_order_relaxed);
+}
+
+// No other thread may be using the table, nor any tree parsed with it
+void free_key_table(KeyTable* table) {
+  free(atomic_load_explicit(&table->slots, memory_order_relaxed));
+  while (table->retired) {
+    KeySlots* next = table->retired->next_retired;
+    free(table->retired);
+    table->retired = next;
+  }
+
+  free_arena(&table->keys);
+  pthread_mutex_destroy(&table->lock);
+  atomic_store_explicit(&table->slots, NULL, memory_order_relaxed);
+  atomic_store_explicit(&table->count, 0, memory_order_relaxed);
+}
@@ -1,14 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <limits.h>
+#include <errno.h>
 #include "helper.h"
 #include "read_file.h"
 #include "parser.h"
 #include "json.h"
+#include "document.h"
+#include "stream.h"
+#include "writer.h"
+#include "batch.h"
+#include "ndjson.h"
+#include "validate.h"
+#include "stats.h"
+#include "path.h"
+#include "ondemand.h"
+#include "tape.h"
+#include "key_table.h"
 
 // ANSI color codes
 #define RESET     "\033[0m"
@@ -16,25 +30,862 @@
 #define BG_WHITE  "\e[47m"
 #define BLACK     "\e[1;30m"
 #define WHITE     "\033[97m"
+#define GREEN     "\033[32m"
+#define YELLOW    "\033[33m"
+#define CYAN      "\033[36m"
+#define RED       "\e[0;31m"
 
 #define PATH_SIZE 512
 
+// Exit codes of --validate
+#define EXIT_VALID 0
+#define EXIT_INVALID 1
+#define EXIT_UNREADABLE 2
+#define STREAM_CHUNK_SIZE (64 * 1024)
+
+typedef struct cliOptions {
+  bool color_enabled;
+  bool pull_enabled;
+  bool arena_enabled;
+  bool zero_copy_enabled;
+  bool stream_enabled;
+  int chunk_size; // --stream: bytes fed at a time, 0 for STREAM_CHUNK_SIZE
+  int max_token_length; // --stream: 0 for no limit
+  bool events_enabled;
+  bool tape_enabled;
+  KeyTable* keys; // --intern-keys: &key_table, shared by every file parsed
+  KeyTable key_table;
+  bool emit_enabled;
+  WriterStyle emit_style;
+  bool batch_enabled;
+  bool ndjson_enabled;
+  int threads;
+  bool validate_enabled;
+  bool stats_enabled;
+  bool ondemand_enabled;
+  bool validate_skipped;
+  int max_depth;
+  const char** queries; // --query paths, in the order given
+  JsonPath* query_paths;
+  int query_count;
+  JsonPathSet query_set;
+} CliOptions;
+
+// Writes the tree back as JSON text, straight to stdout's file descriptor
+static void emit_json(const JsonValue* root, const WriterStyle style) {
+  fflush(stdout);
+
+  JsonWriter writer;
+  init_json_writer_fd(&writer, style, STDOUT_FILENO);
+  if (!write_json_value(&writer, root) || !json_writer_raw(&writer, "\n", 1) || !json_writer_flush(&writer)) {
+    fprintf(stderr, "Error: Can't write JSON output!\n");
+  }
+  free_json_writer(&writer);
+}
+
+static void print_query_result(const char* query, const JsonValue* value, const CliOptions* options) {
+  if (options->color_enabled) {
+    printf("%s%s%s: ", GREEN, query, RESET);
+  } else {
+    printf("%s: ", query);
+  }
+
+  if (value) {
+    print_json_value(value, 0, options->color_enabled);
+  } else if (options->color_enabled) {
+    printf("%sNOT FOUND%s\n", RED, RESET);
+  } else {
+    printf("NOT FOUND\n");
+  }
+}
+
+// The value of each --query path, all found in one walk over the tree
+static void print_query_results(JsonValue* root, const CliOptions* options) {
+  JsonValue** results = malloc(sizeof(JsonValue*) * options->query_count);
+  if (!results || !json_path_set_eval(&options->query_set, root, results)) {
+    fprintf(stderr, "Error: Can't allocate memory for query results!\n");
+    free(results);
+    return;
+  }
+
+  for (int i = 0; i < options->query_count; ++i) {
+    print_query_result(options->queries[i], results[i], options);
+  }
+
+  free(results);
+}
+
+static void print_title(const char* title, const CliOptions* options) {
+  if (options->color_enabled) {
+    printf("\n%s%s=> %s:%s\n\n", BG_BLUE, WHITE, title, RESET);
+  } else {
+    printf("\n=> %s:\n\n", title);
+  }
+}
+
+// The AST dump, the serialized JSON with --emit or the --query results
+static void print_tree(JsonValue* root, const CliOptions* options) {
+  const char* title = options->query_count > 0 ? "Query results"
+    : options->emit_enabled ? "Serialized JSON" : "Parsed JSON AST";
+  print_title(title, options);
+
+  if (options->query_count > 0) {
+    print_query_results(root, options);
+  } else if (options->emit_enabled) {
+    emit_json(root, options->emit_style);
+  } else {
+    print_json_value(root, 0, options->color_enabled);
+  }
+}
+
+static void report_result(JsonValue* root, ParseError* error, const CliOptions* options) {
+  if (root) {
+    uint64_t started = STATS_CLOCK();
+    print_tree(root, options);
+    STATS_PHASE_END(STATS_PRINT, started);
+
+    started = STATS_CLOCK();
+    free_json_value(root);
+    STATS_PHASE_END(STATS_FREE, started);
+  } else {
+    printf("\nParsing failed!\n");
+    print_error(error, options->color_enabled);
+  }
+}
+
+static void parse_tokenized(const char* json_text, const char* full_path, const CliOptions* options, TokenList* tokens) {
+  const bool color_enabled = options->color_enabled;
+  uint64_t started = STATS_CLOCK();
+  bool tokenized = retokenize(json_text, tokens);
+  STATS_PHASE_END(STATS_TOKENIZE, started);
+
+  if (!tokenized) {
+    printf("Tokenization Failed for path: %s\n", full_path);
+    return;
+  }
+
+  started = STATS_CLOCK();
+  printf("Total Tokens: %d\n", tokens->count);
+  print_tokens(tokens, color_enabled);
+  STATS_PHASE_END(STATS_PRINT, started);
+  
+  ParserState parser_state = { .tokens = tokens, .current_index = 0, .max_depth = options->max_depth, .keys = options->keys };
+  ParseError error;
+  started = STATS_CLOCK();
+  JsonValue* root = parse_json_text(&parser_state, &error);
+  STATS_PHASE_END(STATS_PARSE, started);
+  report_result(root, &error, options);
+}
+
+// Parses without materializing the token array: the parser pulls tokens one at a time.
+static void parse_pulled(const char* json_text, const CliOptions* options) {
+  TokenizerState tokenizer = init_tokenizer(json_text);
+  tokenizer.zero_copy = options->zero_copy_enabled;
+
+  ParserState parser_state = init_pull_parser(&tokenizer);
+  parser_state.max_depth = options->max_depth;
+  parser_state.keys = options->keys;
+  ParseError error;
+  uint64_t started = STATS_CLOCK();
+  JsonValue* root = parse_json_text(&parser_state, &error);
+  STATS_PHASE_END(STATS_PARSE, started);
+  report_result(root, &error, options);
+
+  free_parser_state(&parser_state);
+}
+
+// Same as parse_pulled(), but the tree is allocated from the document's arena.
+static void parse_into_document(JsonDocument* document, const char* json_text, const CliOptions* options) {
+  ParseError error;
+  uint64_t started = STATS_CLOCK();
+  JsonValue* root = parse_json_document(document, json_text, &error);
+  STATS_PHASE_END(STATS_PARSE, started);
+
+  started = STATS_CLOCK();
+  if (root) {
+    print_tree(root, options);
+  } else {
+    printf("\nParsing failed!\n");
+    print_error(&error, options->color_enabled);
+  }
+  STATS_PHASE_END(STATS_PRINT, started);
+
+  started = STATS_CLOCK();
+  reset_json_document(document);
+  STATS_PHASE_END(STATS_FREE, started);
+}
+
+// Answers the --query paths from a cursor over the input: only the keys on the
+// way are read and only the values found are built.
+static void query_on_demand(const char* json_text, const CliOptions* options) {
+  OnDemandDocument document;
+  init_ondemand_document(&document);
+  document.validate = options->validate_skipped;
+  document.zero_copy = options->zero_copy_enabled;
+  document.max_depth = options->max_depth;
+
+  ParseError error;
+  JsonCursor root;
+  uint64_t started = STATS_CLOCK();
+  bool ok = ondemand_root(&document, json_text, &root, &error);
+  STATS_PHASE_END(STATS_PARSE, started);
+
+  if (ok) {
+    print_title("Query results", options);
+  }
+
+  for (int i = 0; ok && i < options->query_count; ++i) {
+    JsonCursor cursor;
+    JsonValue* value = NULL;
+    started = STATS_CLOCK();
+    CursorResult result = json_cursor_path(&root, &options->query_paths[i], &cursor, &error);
+    if (result == CURSOR_FOUND) {
+      value = json_cursor_value(&cursor, &error);
+      ok = value != NULL;
+    }
+    ok = ok && result != CURSOR_ERROR;
+    STATS_PHASE_END(STATS_PARSE, started);
+
+    if (ok) {
+      started = STATS_CLOCK();
+      print_query_result(options->queries[i], value, options);
+      STATS_PHASE_END(STATS_PRINT, started);
+    }
+  }
+
+  if (!ok) {
+    printf("\nParsing failed!\n");
+    print_error(&error, options->color_enabled);
+  }
+
+  started = STATS_CLOCK();
+  free_ondemand_document(&document);
+  STATS_PHASE_END(STATS_FREE, started);
+}
+
+// Prints the AST in the same layout as print_json_value(), but live from parse
+// events, so a container's children are printed before it is known to be complete.
+typedef struct streamPrinter {
+  bool color_enabled;
+  int depth;
+  bool empty;     // the innermost container has no children so far
+  bool after_key; // the next value follows a key already printed
+} StreamPrinter;
+
+static void print_child_prefix(StreamPrinter* printer) {
+  if (printer->after_key) {
+    printer->after_key = false;
+    return;
+  }
+
+  if (printer->depth == 0) {
+    return;
+  }
+
+  if (printer->empty) {
+    printf("\n");
+    printer->empty = false;
+  }
+  print_indent(printer->depth);
+}
+
+static bool print_null_event(void* context) {
+  StreamPrinter* printer = context;
+  print_child_prefix(printer);
+  if (printer->color_enabled) {
+    printf("%sNULL%s\n", CYAN, RESET);
+  } else {
+    printf("NULL\n");
+  }
+  return true;
+}
+
+static bool print_bool_event(void* context, const bool value) {
+  StreamPrinter* printer = context;
+  print_child_prefix(printer);
+  if (printer->color_enabled) {
+    printf("%sBOOLEAN%s(%s%s%s)\n", RED, RESET, CYAN, value ? "true" : "false", RESET);
+  } else {
+    printf("BOOLEAN(%s)\n", value ? "true" : "false");
+  }
+  return true;
+}
+
+static bool print_number_event(void* context, const char* text, const int length) {
+  StreamPrinter* printer = context;
+  print_child_prefix(printer);
+  if (printer->color_enabled) {
+    printf("%sNUMBER%s(%s%.*s%s)\n", YELLOW, RESET, RED, length, text, RESET);
+  } else {
+    printf("NUMBER(%.*s)\n", length, text);
+  }
+  return true;
+}
+
+static bool print_string_event(void* context, const char* text, const int length, const bool has_escapes) {
+  (void)has_escapes; // the text arrives decoded either way
+  StreamPrinter* printer = context;
+  print_child_prefix(printer);
+  if (printer->color_enabled) {
+    printf("%sSTRING%s(%s\"", YELLOW, RESET, GREEN);
+    print_escaped(text, length);
+    printf("\"%s)\n", RESET);
+  } else {
+    printf("STRING(\"");
+    print_escaped(text, length);
+    printf("\")\n");
+  }
+  return true;
+}
+
+static bool print_key_event(void* context, const char* text, const int length, const bool has_escapes) {
+  (void)has_escapes;
+  StreamPrinter* printer = context;
+  print_child_prefix(printer);
+  printf("\"");
+  print_escaped(text, length);
+  printf("\": ");
+  printer->after_key = true;
+  return true;
+}
+
+static bool print_start_event(StreamPrinter* printer, const char* name, const char* bracket) {
+  print_child_prefix(printer);
+  if (printer->color_enabled) {
+    printf("%s%s%s %s", CYAN, name, RESET, bracket);
+  } else {
+    printf("%s %s", name, bracket);
+  }
+  printer->depth += 1;
+  printer->empty = true;
+  return true;
+}
+
+static bool print_end_event(StreamPrinter* printer, const char* bracket) {
+  printer->depth -= 1;
+  if (!printer->empty) {
+    print_indent(printer->depth);
+  }
+  printf("%s\n", bracket);
+  printer->empty = false;
+  return true;
+}
+
+static bool print_start_object_event(void* context) {
+  return print_start_event(context, "OBJECT", "{");
+}
+
+static bool print_end_object_event(void* context) {
+  return print_end_event(context, "}");
+}
+
+static bool print_start_array_event(void* context) {
+  return print_start_event(context, "ARRAY", "[");
+}
+
+static bool print_end_array_event(void* context) {
+  return print_end_event(context, "]");
+}
+
+// Prints the AST title and returns the handler that prints the rest
+static JsonEventHandler init_printer_handler(StreamPrinter* printer, const CliOptions* options) {
+  *printer = (StreamPrinter){ .color_enabled = options->color_enabled, .depth = 0, .empty = false, .after_key = false };
+
+  if (options->color_enabled) {
+    printf("\n%s%s=> Parsed JSON AST:%s\n\n", BG_BLUE, WHITE, RESET);
+  } else {
+    printf("\n=> Parsed JSON AST:\n\n");
+  }
+
+  return (JsonEventHandler){
+    .context = printer,
+    .on_null = print_null_event,
+    .on_bool = print_bool_event,
+    .on_number = print_number_event,
+    .on_string = print_string_event,
+    .on_key = print_key_event,
+    .on_start_object = print_start_object_event,
+    .on_end_object = print_end_object_event,
+    .on_start_array = print_start_array_event,
+    .on_end_array = print_end_array_event,
+  };
+}
+
+// Prints the AST straight from the events of the pull parser: no tree is
+// built, and strings without escapes are printed from the input itself.
+static void parse_with_events(const char* json_text, const CliOptions* options) {
+  TokenizerState tokenizer = init_tokenizer(json_text);
+  ParserState parser_state = init_pull_parser(&tokenizer);
+  parser_state.max_depth = options->max_depth;
+
+  StreamPrinter printer;
+  JsonEventHandler handler = init_printer_handler(&printer, options);
+
+  ParseError error;
+  uint64_t started = STATS_CLOCK();
+  if (!parse_json_text_events(&parser_state, &handler, &error)) {
+    printf("\nParsing failed!\n");
+    print_error(&error, options->color_enabled);
+  }
+  STATS_PHASE_END(STATS_PARSE, started);
+
+  free_parser_state(&parser_state);
+}
+
+// Parses onto a flat tape, then rebuilds the tree from it for printing, so
+// the output is the same as the other modes when the tape round-trips.
+static void parse_onto_tape(const char* json_text, const CliOptions* options) {
+  JsonTape tape;
+  init_json_tape(&tape);
+  tape.max_depth = options->max_depth;
+
+  ParseError error;
+  uint64_t started = STATS_CLOCK();
+  JsonValue* root = NULL;
+  if (parse_json_tape(&tape, json_text, &error)) {
+    root = json_tape_to_value(json_tape_root(&tape), NULL, &error);
+  }
+  STATS_PHASE_END(STATS_PARSE, started);
+  report_result(root, &error, options);
+
+  free_json_tape(&tape);
+}
+
+// Feeds the file to the push parser in fixed-size chunks, so memory stays
+// constant whatever the size of the input.
+static void parse_streamed(const char* full_path, const CliOptions* options) {
+  FILE* stream_file = strcmp(full_path, "-") == 0 ? stdin : fopen(full_path, "rb");
+  if (!stream_file) {
+    fprintf(stderr, "Error: File '%s' not found!\n", full_path);
+    return;
+  }
+
+  size_t chunk_size = options->chunk_size > 0 ? (size_t)options->chunk_size : STREAM_CHUNK_SIZE;
+  char* chunk = malloc(chunk_size);
+  if (!chunk) {
+    fprintf(stderr, "Error: Can't allocate memory for stream chunk!\n");
+    if (stream_file != stdin) {
+      fclose(stream_file);
+    }
+    return;
+  }
+
+  StreamPrinter printer;
+  JsonEventHandler handler = init_printer_handler(&printer, options);
+
+  JsonStream stream;
+  init_json_stream(&stream, &handler);
+  stream.max_depth = options->max_depth;
+  stream.max_token_length = (size_t)options->max_token_length;
+
+  ParseError error;
+  bool ok = true;
+  size_t read;
+  while (ok && (read = fread(chunk, sizeof(char), chunk_size, stream_file)) > 0) {
+    ok = json_stream_feed(&stream, chunk, read, &error);
+  }
+  ok = ok && json_stream_finish(&stream, &error);
+
+  if (!ok) {
+    printf("\nParsing failed!\n");
+    print_error(&error, options->color_enabled);
+  }
+
+  free_json_stream(&stream);
+  free(chunk);
+  if (stream_file != stdin) {
+    fclose(stream_file);
+  }
+}
+
+// The counters collected for the last file (or run), as JSON
+static void print_stats(const CliOptions* options) {
+  if (options->color_enabled) {
+    printf("\n%s%s=> Stats:%s\n\n", BG_BLUE, WHITE, RESET);
+  } else {
+    printf("\n=> Stats:\n\n");
+  }
+  print_json_stats(stdout, json_stats_get());
+}
+
+// Validates every record of a newline-delimited file on all cores. Exits with
+// 0 (all valid), 1 (invalid records) or 2 (unreadable input), like --validate.
+static int run_ndjson_file(const char* path, const CliOptions* options) {
+  if (is_directory(path)) {
+    fprintf(stderr, "Error: --ndjson needs a file, '%s' is a folder!\n", path);
+    return 2;
+  }
+
+  NdjsonOptions ndjson_options = {
+    .threads = options->threads,
+    .max_depth = options->max_depth,
+    .chunk_size = 0,
+    .color_enabled = options->color_enabled,
+    .keys = options->keys,
+  };
+  NdjsonSummary summary;
+  if (!run_ndjson(path, &ndjson_options, &summary)) {
+    return 2;
+  }
+
+  print_ndjson_summary(&summary);
+  return summary.failed == 0 ? 0 : 1;
+}
+
+// The document and the token list are reused from one file to the next
+static void test_file(const char* full_path, const CliOptions* options, JsonDocument* document, TokenList* tokens) {
+  if (options->color_enabled) {
+    printf("%s%s===> Testing file: %s%s\n\n", BG_BLUE, WHITE, full_path, RESET);
+  } else {
+    printf("===> Testing file: %s\n\n", full_path);
+  }
+
+  json_stats_reset();
+
+  // Reading, parsing and printing are interleaved when streaming
+  if (options->stream_enabled) {
+    uint64_t started = STATS_CLOCK();
+    parse_streamed(full_path, options);
+    STATS_PHASE_END(STATS_PARSE, started);
+    if (options->stats_enabled) {
+      print_stats(options);
+    }
+    printf("\n-----\n\n");
+    return;
+  }
+
+  MappedFile file;
+  uint64_t started = STATS_CLOCK();
+  bool mapped = map_file(full_path, &file);
+  STATS_PHASE_END(STATS_READ, started);
+  if (!mapped) {
+    return;
+  }
+
+  if (options->ondemand_enabled && options->query_count > 0) {
+    query_on_demand(file.data, options);
+  } else if (options->events_enabled) {
+    parse_with_events(file.data, options);
+  } else if (options->tape_enabled) {
+    parse_onto_tape(file.data, options);
+  } else if (options->arena_enabled || options->ondemand_enabled) {
+    parse_into_document(document, file.data, options);
+  } else if (options->pull_enabled) {
+    parse_pulled(file.data, options);
+  } else {
+    parse_tokenized(file.data, full_path, options, tokens);
+  }
+
+  unmap_file(&file);
+  if (options->stats_enabled) {
+    print_stats(options);
+  }
+  printf("\n-----\n\n");
+}
+
+// Checks one file without building a tree; only failures are printed
+static int validate_file(const char* full_path, const CliOptions* options, JsonValidator* validator) {
+  MappedFile file;
+  uint64_t started = STATS_CLOCK();
+  bool mapped = map_file(full_path, &file);
+  STATS_PHASE_END(STATS_READ, started);
+  if (!mapped) {
+    return EXIT_UNREADABLE;
+  }
+
+  ParseError error;
+  started = STATS_CLOCK();
+  bool valid = validate_json_text(validator, file.data, &error);
+  STATS_PHASE_END(STATS_PARSE, started);
+  unmap_file(&file);
+
+  if (!valid) {
+    if (options->color_enabled) {
+      printf("%sFAIL%s %s: %s (line %d, column %d)\n", RED, RESET, full_path, error.message, error.line, error.column);
+    } else {
+      printf("FAIL %s: %s (line %d, column %d)\n", full_path, error.message, error.line, error.column);
+    }
+  }
+
+  return valid ? EXIT_VALID : EXIT_INVALID;
+}
+
+// --validate over a file, stdin or the .json files of a folder. The exit code
+// is the worst result: unreadable input over invalid JSON over valid JSON.
+static int run_validation(const char* path, const CliOptions* options) {
+  JsonValidator validator;
+  init_json_validator(&validator);
+  validator.max_depth = options->max_depth;
+
+  if (strcmp(path, "-") == 0 || !is_directory(path)) {
+    int status = validate_file(path, options, &validator);
+    free_json_validator(&validator);
+    if (options->stats_enabled) {
+      print_json_stats(stdout, json_stats_get());
+    }
+    return status;
+  }
+
+  DIR* dir = opendir(path);
+  if (!dir) {
+    fprintf(stderr, "Error: folder '%s' not found!\n", path);
+    free_json_validator(&validator);
+    return EXIT_UNREADABLE;
+  }
+
+  int status = EXIT_VALID;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    char full_path[PATH_SIZE];
+    snprintf(full_path, sizeof(full_path), "%s%s%s",
+          path,
+          path[strlen(path) - 1] == '/' ? "" : "/",
+          entry->d_name);
+
+    if (is_regular_file(full_path) && has_json_extension(entry->d_name)) {
+      int result = validate_file(full_path, options, &validator);
+      if (result > status) {
+        status = result;
+      }
+    }
+  }
+
+  closedir(dir);
+  free_json_validator(&validator);
+  if (options->stats_enabled) {
+    print_json_stats(stdout, json_stats_get());
+  }
+  return status;
+}
+
+// A whole decimal number from 1 to INT_MAX, nothing else
+static bool parse_positive_int(const char* text, int* value) {
+  char* end;
+  errno = 0;
+  long parsed = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || errno == ERANGE || parsed < 1 || parsed > INT_MAX) {
+    return false;
+  }
+
+  *value = (int)parsed;
+  return true;
+}
+
+// Usage error for an option that `mode` would otherwise silently ignore
+static bool check_combination(const bool mode, const char* mode_name, const bool option, const char* option_name) {
+  if (mode && option) {
+    fprintf(stderr, "Error: %s can't be used with %s!\n", option_name, mode_name);
+    return false;
+  }
+  return true;
+}
+
+static void free_cli_options(CliOptions* options) {
+  for (int i = 0; i < options->query_count; ++i) {
+    free_json_path(&options->query_paths[i]);
+  }
+  free_json_path_set(&options->query_set);
+  free(options->query_paths);
+  free(options->queries);
+  if (options->keys) {
+    free_key_table(options->keys);
+  }
+}
+
 int main(int argc, char** argv) {
   if (argc < 2) {
-    printf("Usage: %s <path-to-json-file>\n", argv[0]);
+    printf("Usage: %s <path-to-json-folder | file | -> [--color] [--pull] [--arena] [--zero-copy] [--stream] [--chunk-size N] [--max-token N] [--events] [--tape] [--intern-keys] [--max-depth N] [--emit compact|pretty] [--batch] [--ndjson] [--threads N] [--validate] [--stats] [--query PATH]... [--on-demand] [--validate-skipped]\n", argv[0]);
+    return 1;
+  }
+
+  CliOptions options = { 0 };
+  init_json_path_set(&options.query_set);
+  options.queries = malloc(sizeof(char*) * argc);
+  options.query_paths = malloc(sizeof(JsonPath) * argc);
+  if (!options.queries || !options.query_paths) {
+    fprintf(stderr, "Error: Can't allocate memory for queries!\n");
+    free_cli_options(&options);
     return 1;
   }
 
-  bool color_enabled = false;
+  for (int i = 2; i < argc; ++i) {
+    if (strcmp(argv[i], "--color") == 0) {
+      options.color_enabled = true;
+    } else if (strcmp(argv[i], "--pull") == 0) {
+      options.pull_enabled = true;
+    } else if (strcmp(argv[i], "--arena") == 0) {
+      options.arena_enabled = true;
+    } else if (strcmp(argv[i], "--zero-copy") == 0) {
+      options.zero_copy_enabled = true;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      options.stream_enabled = true;
+    } else if (strcmp(argv[i], "--chunk-size") == 0) {
+      const char* size = i + 1 < argc ? argv[++i] : "";
+      if (!parse_positive_int(size, &options.chunk_size)) {
+        fprintf(stderr, "Error: Invalid --chunk-size '%s' (expected a positive integer)\n", size);
+        free_cli_options(&options);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--max-token") == 0) {
+      const char* length = i + 1 < argc ? argv[++i] : "";
+      if (!parse_positive_int(length, &options.max_token_length)) {
+        fprintf(stderr, "Error: Invalid --max-token '%s' (expected a positive integer)\n", length);
+        free_cli_options(&options);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--events") == 0) {
+      options.events_enabled = true;
+    } else if (strcmp(argv[i], "--tape") == 0) {
+      options.tape_enabled = true;
+    } else if (strcmp(argv[i], "--intern-keys") == 0 && !options.keys) {
+      init_key_table(&options.key_table);
+      options.keys = &options.key_table;
+    } else if (strcmp(argv[i], "--max-depth") == 0) {
+      const char* depth = i + 1 < argc ? argv[++i] : "";
+      if (!parse_positive_int(depth, &options.max_depth)) {
+        fprintf(stderr, "Error: Invalid --max-depth '%s' (expected a positive integer)\n", depth);
+        free_cli_options(&options);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--emit") == 0) {
+      const char* style = i + 1 < argc ? argv[++i] : "";
+      if (strcmp(style, "compact") != 0 && strcmp(style, "pretty") != 0) {
+        fprintf(stderr, "Error: Invalid --emit '%s' (expected compact or pretty)\n", style);
+        free_cli_options(&options);
+        return 1;
+      }
+      options.emit_enabled = true;
+      options.emit_style = strcmp(style, "pretty") == 0 ? WRITER_PRETTY : WRITER_COMPACT;
+    } else if (strcmp(argv[i], "--batch") == 0) {
+      options.batch_enabled = true;
+    } else if (strcmp(argv[i], "--ndjson") == 0) {
+      options.ndjson_enabled = true;
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      const char* threads = i + 1 < argc ? argv[++i] : "";
+      if (!parse_positive_int(threads, &options.threads)) {
+        fprintf(stderr, "Error: Invalid --threads '%s' (expected a positive integer)\n", threads);
+        free_cli_options(&options);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--validate") == 0) {
+      options.validate_enabled = true;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      options.stats_enabled = true;
+    } else if (strcmp(argv[i], "--on-demand") == 0) {
+      options.ondemand_enabled = true;
+    } else if (strcmp(argv[i], "--validate-skipped") == 0) {
+      options.validate_skipped = true;
+    } else if (strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+      ParseError error;
+      const char* query = argv[++i];
+      if (!compile_json_path(&options.query_paths[options.query_count], query, &error)) {
+        fprintf(stderr, "Error: Invalid query '%s': %s (column %d)\n", query, error.message, error.column);
+        free_cli_options(&options);
+        return 1;
+      }
 
-  if (argc >= 3 && strcmp(argv[2], "--color") == 0) {
-    color_enabled = true;
+      options.queries[options.query_count] = query;
+      options.query_count += 1;
+      if (json_path_set_add(&options.query_set, &options.query_paths[options.query_count - 1]) < 0) {
+        free_cli_options(&options);
+        return 1;
+      }
+    }
+  }
+
+  bool compatible = check_combination(options.events_enabled, "--events", options.emit_enabled, "--emit")
+    && check_combination(options.events_enabled, "--events", options.arena_enabled, "--arena")
+    && check_combination(options.events_enabled, "--events", options.keys != NULL, "--intern-keys")
+    && check_combination(options.tape_enabled, "--tape", options.arena_enabled, "--arena")
+    && check_combination(options.tape_enabled, "--tape", options.keys != NULL, "--intern-keys")
+    && check_combination(options.stream_enabled, "--stream", options.keys != NULL, "--intern-keys")
+    && check_combination(options.validate_enabled && !options.batch_enabled && !options.ndjson_enabled, "--validate", options.keys != NULL, "--intern-keys")
+    && check_combination(options.ondemand_enabled && options.query_count > 0, "--on-demand --query", options.keys != NULL, "--intern-keys")
+    && check_combination(options.stream_enabled, "--stream", options.query_count > 0, "--query")
+    && check_combination(options.events_enabled && !options.ondemand_enabled, "--events", options.query_count > 0, "--query")
+    && check_combination(options.validate_enabled, "--validate", options.query_count > 0, "--query")
+    && check_combination(options.batch_enabled, "--batch", options.query_count > 0, "--query")
+    && check_combination(options.ndjson_enabled, "--ndjson", options.query_count > 0, "--query")
+    && check_combination(options.query_count > 0, "--query", options.emit_enabled, "--emit");
+  if (!compatible) {
+    free_cli_options(&options);
+    return 1;
+  }
+
+  if ((options.chunk_size > 0 || options.max_token_length > 0) && !options.stream_enabled) {
+    fprintf(stderr, "Error: %s needs --stream!\n", options.chunk_size > 0 ? "--chunk-size" : "--max-token");
+    free_cli_options(&options);
+    return 1;
+  }
+
+  // Queries are then answered by comparing key pointers
+  if (options.keys && !intern_json_path_set(&options.query_set, options.keys)) {
+    free_cli_options(&options);
+    return 1;
+  }
+
+  if (options.stats_enabled && !json_stats_enable(true)) {
+    fprintf(stderr, "Error: --stats needs a build with JSON_STATS defined!\n");
+    options.stats_enabled = false;
   }
 
   const char* folder_path = argv[1];
+  // NDJSON records are only ever validated, so --validate changes nothing there
+  if (options.ndjson_enabled) {
+    int status = run_ndjson_file(folder_path, &options);
+    free_cli_options(&options);
+    return status;
+  }
+
+  if (options.validate_enabled && !options.batch_enabled) {
+    int status = run_validation(folder_path, &options);
+    free_cli_options(&options);
+    return status;
+  }
+
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = options.zero_copy_enabled;
+  document.max_depth = options.max_depth;
+  document.keys = options.keys;
+  TokenList tokens = { .input = NULL, .tokens = NULL, .count = 0, .capacity = 0 };
+
+  // A single file, a pipe or "-" for stdin
+  if (strcmp(folder_path, "-") == 0 || (!is_directory(folder_path) && access(folder_path, R_OK) == 0)) {
+    test_file(folder_path, &options, &document, &tokens);
+    free_json_document(&document);
+    free_token_list(&tokens);
+    free_cli_options(&options);
+    return 0;
+  }
+
+  if (options.batch_enabled && is_directory(folder_path)) {
+    free_json_document(&document);
+    free_token_list(&tokens);
+
+    BatchOptions batch_options = {
+      .threads = options.threads,
+      .max_depth = options.max_depth,
+      .color_enabled = options.color_enabled,
+      .keys = options.keys,
+    };
+    BatchSummary summary;
+    bool scanned = run_batch(folder_path, &batch_options, &summary);
+    print_batch_summary(&summary);
+    free_cli_options(&options);
+    return scanned && summary.failed == 0 ? 0 : 1;
+  }
+
   DIR* dir = opendir(folder_path);
   if (!dir) {
     printf("Error: folder '%s' not found!\n", folder_path);
+    free_json_document(&document);
+    free_token_list(&tokens);
+    free_cli_options(&options);
     return 1;
   }
 
@@ -55,69 +906,13 @@ int main(int argc, char** argv) {
 
 
     if (is_regular_file(full_path) && has_json_extension(entry->d_name)) {
-      if (color_enabled) {
-        printf("%s%s===> Testing file: %s%s\n\n", BG_BLUE, WHITE, full_path, RESET);
-      } else {
-        printf("===> Testing file: %s\n\n", full_path);
-      }
-
-      char* json_text = read_file(full_path);
-      if (!json_text) {
-        continue;
-      }
-
-      int token_count = 0;
-      Token* tokens = tokenize(json_text, &token_count);
-      
-      if (tokens) {
-        printf("Total Tokens: %d\n", token_count);
-        
-        for (int i = 0; i < token_count; ++i) {
-          print_token(tokens[i], i + 1, color_enabled);
-        }
-        
-        ParserState parser_state = { .tokens = tokens, .current_index = 0 };
-        ParseError error;
-        JsonValue* root = parse_json_value(&parser_state, &error);
-
-        if (root && root->type != JSON_OBJECT && root->type != JSON_ARRAY) {
-          set_error(&error, "Top-level JSON must be an object or array", 1, 1);
-          free_json_value(root);
-          root = NULL;
-        }
-
-        if (root) {
-          Token remaining = parser_peek(&parser_state);
-          if (remaining.type != TOKEN_EOF) {
-            set_error(&error, "End of file expected", remaining.line, remaining.column);
-            free_json_value(root);
-            root = NULL;
-          }
-        }
-
-        if (root) {
-          if (color_enabled) {
-            printf("\n%s%s=> Parsed JSON AST:%s\n\n", BG_BLUE, WHITE, RESET);
-          } else {
-            printf("\n=> Parsed JSON AST:\n\n");
-          }
-          
-          print_json_value(root, 0, color_enabled);
-          free_json_value(root);
-        } else {
-          printf("\nParsing failed!\n");
-          print_error(&error, color_enabled);
-        }
-
-        free_tokens(tokens, token_count);
-      } else {
-        printf("Tokenization Failed for path: %s\n", full_path);
-      }
-
-      free(json_text);
-      printf("\n-----\n\n");
+      test_file(full_path, &options, &document, &tokens);
     }
   }
 
+  free_json_document(&document);
+  free_token_list(&tokens);
+  closedir(dir);
+  free_cli_options(&options);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include "ndjson.h"
+#include "batch.h"
+#include "read_file.h"
+#include "document.h"
+#include "simd_scan.h"
+
+// ANSI color codes
+#define RESET   "\033[0m"
+#define RED     "\e[0;31m"
+
+#define CHUNKS_PER_THREAD 8
+#define MIN_CHUNK_SIZE (64 * 1024)
+#define MAX_CHUNK_SIZE (4 * 1024 * 1024)
+#define INIT_FAILURE_CAPACITY 8
+
+typedef struct ndjsonFailure {
+  long record;   // in the chunk, from 0
+  long line;     // in the chunk, from 0
+  size_t offset; // of the record in the input
+  ParseError error;
+} NdjsonFailure;
+
+// A run of whole lines. Records and lines are counted from the start of the
+// chunk; they are only turned into positions in the input once every chunk
+// before it has been counted too.
+typedef struct ndjsonChunk {
+  size_t start;
+  size_t end;
+  long records;
+  long lines;
+  NdjsonFailure* failures;
+  long failure_count;
+  long failure_capacity;
+  bool done;
+} NdjsonChunk;
+
+// Chunks are handed out in order. `reported` trails behind: the chunks before
+// it have been printed, and their records and lines are in the bases.
+typedef struct ndjsonQueue {
+  pthread_mutex_t lock;
+  const char* input;
+  NdjsonChunk* chunks;
+  long count;
+  long next;     // first chunk not yet taken by a worker
+  long reported; // first chunk not yet printed
+  long record_base;
+  long line_base;
+
+  const NdjsonOptions* options;
+  long failed;
+} NdjsonQueue;
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Enough chunks for every thread to get several, so a slow one evens out
+static size_t pick_chunk_size(const size_t length, const int threads, const size_t requested) {
+  if (requested > 0) {
+    return requested;
+  }
+
+  size_t size = length / ((size_t)threads * CHUNKS_PER_THREAD);
+  if (size < MIN_CHUNK_SIZE) {
+    return MIN_CHUNK_SIZE;
+  }
+  return size > MAX_CHUNK_SIZE ? MAX_CHUNK_SIZE : size;
+}
+
+// Cuts the input after the first newline at or past every `chunk_size` bytes
+static bool split_chunks(NdjsonQueue* queue, const char* input, const size_t length, const size_t chunk_size) {
+  long capacity = (long)(length / chunk_size) + 1;
+  queue->chunks = calloc(capacity, sizeof(NdjsonChunk));
+  if (!queue->chunks) {
+    fprintf(stderr, "Error: Can't allocate memory for NDJSON chunks!\n");
+    return false;
+  }
+
+  size_t position = 0;
+  while (position < length) {
+    size_t end = length;
+    if (length - position > chunk_size) {
+      const char* newline = memchr(input + position + chunk_size - 1, '\n', length - position - chunk_size + 1);
+      end = newline ? (size_t)(newline - input) + 1 : length;
+    }
+
+    queue->chunks[queue->count].start = position;
+    queue->chunks[queue->count].end = end;
+    queue->count += 1;
+    position = end;
+  }
+  return true;
+}
+
+static bool is_blank(const char* text, const size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    if (text[i] != ' ' && text[i] != '\t' && text[i] != '\r') {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void add_failure(NdjsonChunk* chunk, const size_t offset, const ParseError* error) {
+  if (chunk->failure_count == chunk->failure_capacity) {
+    long capacity = chunk->failure_capacity > 0 ? chunk->failure_capacity * 2 : INIT_FAILURE_CAPACITY;
+    NdjsonFailure* failures = realloc(chunk->failures, sizeof(NdjsonFailure) * capacity);
+    if (!failures) {
+      fprintf(stderr, "Error: Can't reallocate memory while growing NDJSON failures!\n");
+      return;
+    }
+    chunk->failures = failures;
+    chunk->failure_capacity = capacity;
+  }
+
+  NdjsonFailure failure = { .record = chunk->records, .line = chunk->lines - 1, .offset = offset, .error = *error };
+  chunk->failures[chunk->failure_count] = failure;
+  chunk->failure_count += 1;
+}
+
+// The tokenizer stops at a '\0', so each record is copied into the worker's
+// buffer first; the tree borrows from that copy and is dropped before the next.
+static bool parse_record(JsonDocument* document, const char* text, const size_t length,
+    char** buffer, size_t* capacity, ParseError* error) {
+  if (length >= INT_MAX) {
+    set_error(error, "Record too large", 1, 1);
+    return false;
+  }
+
+  if (length + 1 > *capacity) {
+    char* grown = realloc(*buffer, length + 1);
+    if (!grown) {
+      fprintf(stderr, "Error: Can't reallocate memory for NDJSON record!\n");
+      set_error(error, "Out of memory", 1, 1);
+      return false;
+    }
+    *buffer = grown;
+    *capacity = length + 1;
+  }
+
+  memcpy(*buffer, text, length);
+  (*buffer)[length] = '\0';
+
+  bool parsed = parse_json_document(document, *buffer, error) != NULL;
+  reset_json_document(document);
+  return parsed;
+}
+
+static void parse_chunk(const char* input, NdjsonChunk* chunk, JsonDocument* document, char** buffer, size_t* capacity) {
+  size_t position = chunk->start;
+  while (position < chunk->end) {
+    const char* line = input + position;
+    const char* newline = memchr(line, '\n', chunk->end - position);
+    size_t length = newline ? (size_t)(newline - line) : chunk->end - position;
+    size_t next = position + length + (newline != NULL);
+    chunk->lines += 1;
+
+    if (length > 0 && line[length - 1] == '\r') {
+      length -= 1;
+    }
+
+    if (!is_blank(line, length)) {
+      ParseError error;
+      if (!parse_record(document, line, length, buffer, capacity, &error)) {
+        add_failure(chunk, position, &error);
+      }
+      chunk->records += 1;
+    }
+
+    position = next;
+  }
+}
+
+static void report_failure(const NdjsonQueue* queue, const NdjsonFailure* failure) {
+  long record = queue->record_base + failure->record + 1;
+  long line = queue->line_base + failure->line + 1;
+  if (queue->options->color_enabled) {
+    printf("%sFAIL%s record %ld (line %ld, byte %zu): %s (column %d)\n", RED, RESET,
+      record, line, failure->offset, failure->error.message, failure->error.column);
+  } else {
+    printf("FAIL record %ld (line %ld, byte %zu): %s (column %d)\n",
+      record, line, failure->offset, failure->error.message, failure->error.column);
+  }
+}
+
+// Called with the lock held: prints the finished prefix of the chunks
+static void report_finished(NdjsonQueue* queue) {
+  while (queue->reported < queue->next && queue->chunks[queue->reported].done) {
+    NdjsonChunk* chunk = &queue->chunks[queue->reported];
+    for (long i = 0; i < chunk->failure_count; ++i) {
+      report_failure(queue, &chunk->failures[i]);
+    }
+
+    queue->failed += chunk->failure_count;
+    queue->record_base += chunk->records;
+    queue->line_base += chunk->lines;
+    free(chunk->failures);
+    chunk->failures = NULL;
+    queue->reported += 1;
+  }
+}
+
+static void* ndjson_worker(void* argument) {
+  NdjsonQueue* queue = argument;
+
+  JsonDocument document;
+  init_json_document(&document);
+  document.zero_copy = true; // the tree is dropped before the buffer is reused
+  document.max_depth = queue->options->max_depth;
+  document.keys = queue->options->keys;
+
+  char* buffer = NULL;
+  size_t capacity = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  while (queue->next < queue->count) {
+    NdjsonChunk* chunk = &queue->chunks[queue->next];
+    queue->next += 1;
+    pthread_mutex_unlock(&queue->lock);
+
+    parse_chunk(queue->input, chunk, &document, &buffer, &capacity);
+
+    pthread_mutex_lock(&queue->lock);
+    chunk->done = true;
+    report_finished(queue);
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  free(buffer);
+  free_json_document(&document);
+  return NULL;
+}
+
+bool parse_ndjson(const char* input, const size_t length, const NdjsonOptions* options, NdjsonSummary* summary) {
+  int threads = options->threads > 0 ? options->threads : online_cpus();
+  if (threads > MAX_THREADS) {
+    threads = MAX_THREADS;
+  }
+
+  NdjsonQueue queue = {
+    .input = input,
+    .chunks = NULL,
+    .count = 0,
+    .next = 0,
+    .reported = 0,
+    .record_base = 0,
+    .line_base = 0,
+    .options = options,
+    .failed = 0,
+  };
+
+  double start = now_seconds();
+  if (!split_chunks(&queue, input, length, pick_chunk_size(length, threads, options->chunk_size))) {
+    *summary = (NdjsonSummary){ .bytes = length };
+    return false;
+  }
+
+  if (threads > queue.count) {
+    threads = queue.count > 0 ? (int)queue.count : 1;
+  }
+
+  pthread_mutex_init(&queue.lock, NULL);
+
+  // Pick the string scanner before the workers race to do it lazily
+  get_scan_level();
+
+  pthread_t workers[MAX_THREADS];
+  int started = 0;
+  while (started < threads && pthread_create(&workers[started], NULL, ndjson_worker, &queue) == 0) {
+    started += 1;
+  }
+
+  if (started == 0) {
+    fprintf(stderr, "Error: Can't start NDJSON worker threads!\n");
+  }
+
+  for (int i = 0; i < started; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+
+  summary->records = queue.record_base;
+  summary->failed = queue.failed;
+  summary->bytes = length;
+  summary->seconds = now_seconds() - start;
+  summary->threads = started;
+  summary->chunks = queue.count;
+
+  bool parsed = started > 0 || queue.count == 0;
+  for (long i = queue.reported; i < queue.count; ++i) {
+    free(queue.chunks[i].failures);
+  }
+  free(queue.chunks);
+  pthread_mutex_destroy(&queue.lock);
+  return parsed;
+}
+
+bool run_ndjson(const char* path, const NdjsonOptions* options, NdjsonSummary* summary) {
+  MappedFile file;
+  if (!map_file(path, &file)) {
+    *summary = (NdjsonSummary){ 0 };
+    return false;
+  }
+
+  bool parsed = parse_ndjson(file.data, file.length, options, summary);
+  unmap_file(&file);
+  return parsed;
+}
+
+void print_ndjson_summary(const NdjsonSummary* summary) {
+  double megabytes = summary->bytes / (1024.0 * 1024.0);
+  double seconds = summary->seconds > 0 ? summary->seconds : 1e-9;
+
+  printf("\nRecords: %ld (%ld failed), %.1f MB in %.3f s with %d thread%s, %ld chunk%s\n",
+    summary->records, summary->failed, megabytes, summary->seconds,
+    summary->threads, summary->threads == 1 ? "" : "s",
+    summary->chunks, summary->chunks == 1 ? "" : "s");
+  printf("Throughput: %.0f records/s, %.1f MB/s\n", summary->records / seconds, megabytes / seconds);
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "number.h"
+#include "stats.h"
+
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+#define MAX_EXACT_POWER 22
+#define NUMBER_BUFFER_SIZE 64
+
+// Powers of ten that are exactly representable as doubles
+static const double exact_powers[MAX_EXACT_POWER + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+void init_number_scan(NumberScan* scan) {
+  scan->mantissa = 0;
+  scan->digits = 0;
+  scan->exponent = 0;
+  scan->negative = false;
+  scan->real = false;
+}
+
+// strtod() on a NUL-terminated copy of the lexeme: correctly rounded, but slow
+static double parse_double(const char* text, const int length) {
+  char local[NUMBER_BUFFER_SIZE];
+  char* copy = local;
+  if (length >= NUMBER_BUFFER_SIZE) {
+    STATS_ALLOC(length + 1);
+    copy = malloc(length + 1);
+  }
+
+  if (!copy) {
+    fprintf(stderr, "Error: Can't allocate memory for number!\n");
+    return NAN;
+  }
+
+  memcpy(copy, text, length);
+  copy[length] = '\0';
+  double real = strtod(copy, NULL);
+
+  if (copy != local) {
+    free(copy);
+  }
+  return real;
+}
+
+static JsonNumber make_real(const NumberKind kind, const double real) {
+  JsonNumber number = { .kind = kind, .value.real = real };
+  return number;
+}
+
+static JsonNumber finish_integer(const NumberScan* scan, const char* text, const int length) {
+  JsonNumber number;
+
+  if (scan->digits <= MAX_MANTISSA_DIGITS) {
+    if (!scan->negative && scan->mantissa <= INT64_MAX) {
+      number.kind = NUMBER_INT64;
+      number.value.integer = (int64_t)scan->mantissa;
+      return number;
+    }
+
+    if (!scan->negative) {
+      number.kind = NUMBER_UINT64;
+      number.value.unsigned_integer = scan->mantissa;
+      return number;
+    }
+
+    if (scan->mantissa <= (uint64_t)INT64_MAX + 1) {
+      number.kind = NUMBER_INT64;
+      number.value.integer = (int64_t)(0 - scan->mantissa);
+      return number;
+    }
+
+    return make_real(NUMBER_BIG, -(double)scan->mantissa);
+  }
+
+  // 20 digits may still fit in a uint64_t (up to 18446744073709551615)
+  if (!scan->negative && scan->digits == MAX_MANTISSA_DIGITS + 1) {
+    uint64_t head = 0;
+    for (int i = 0; i < MAX_MANTISSA_DIGITS; ++i) {
+      head = head * 10 + (text[i] - '0');
+    }
+
+    uint64_t last = text[MAX_MANTISSA_DIGITS] - '0';
+    if (head < UINT64_MAX / 10 || (head == UINT64_MAX / 10 && last <= UINT64_MAX % 10)) {
+      number.kind = NUMBER_UINT64;
+      number.value.unsigned_integer = head * 10 + last;
+      return number;
+    }
+  }
+
+  return make_real(NUMBER_BIG, parse_double(text, length));
+}
+
+// Exact when the mantissa and the power of ten are both exact doubles (one
+// correctly rounded operation, Clinger's fast path); strtod() otherwise.
+static JsonNumber finish_real(const NumberScan* scan, const char* text, const int length) {
+  if (scan->digits <= MAX_MANTISSA_DIGITS && scan->mantissa == 0) {
+    return make_real(NUMBER_DOUBLE, scan->negative ? -0.0 : 0.0);
+  }
+
+  if (scan->digits <= MAX_MANTISSA_DIGITS && scan->mantissa <= MAX_EXACT_MANTISSA &&
+    scan->exponent >= -MAX_EXACT_POWER && scan->exponent <= MAX_EXACT_POWER) {
+    double real = (double)scan->mantissa;
+    if (scan->exponent < 0) {
+      real /= exact_powers[-scan->exponent];
+    } else {
+      real *= exact_powers[scan->exponent];
+    }
+    return make_real(NUMBER_DOUBLE, scan->negative ? -real : real);
+  }
+
+  double real = parse_double(text, length);
+  return make_real(isinf(real) ? NUMBER_BIG : NUMBER_DOUBLE, real);
+}
+
+JsonNumber finish_number(const NumberScan* scan, const char* text, const int length) {
+  if (scan->real) {
+    return finish_real(scan, text, length);
+  }
+  return finish_integer(scan, text, length);
+}
+
+static int scan_digits(const char* text, const int length, int i, uint64_t* mantissa) {
+  uint64_t value = *mantissa;
+  int begin = i;
+  while (i < length && IS_DIGIT(text[i])) {
+    value = value * 10 + (text[i] - '0');
+    i += 1;
+  }
+
+  *mantissa = value;
+  return i - begin;
+}
+
+// Decodes a lexeme already validated by the tokenizer
+JsonNumber decode_number(const char* text, const int length) {
+  NumberScan scan;
+  init_number_scan(&scan);
+
+  int i = 0;
+  if (i < length && text[i] == '-') {
+    scan.negative = true;
+    i += 1;
+  }
+
+  int count = scan_digits(text, length, i, &scan.mantissa);
+  scan.digits += count;
+  i += count;
+
+  if (i < length && text[i] == '.') {
+    count = scan_digits(text, length, i + 1, &scan.mantissa);
+    scan.real = true;
+    scan.digits += count;
+    scan.exponent -= count;
+    i += count + 1;
+  }
+
+  if (i < length && (text[i] == 'e' || text[i] == 'E')) {
+    scan.real = true;
+    i += 1;
+
+    bool negative_exponent = false;
+    if (i < length && (text[i] == '+' || text[i] == '-')) {
+      negative_exponent = text[i] == '-';
+      i += 1;
+    }
+
+    int exponent = 0;
+    while (i < length && IS_DIGIT(text[i])) {
+      if (exponent < MAX_EXPONENT) {
+        exponent = exponent * 10 + (text[i] - '0');
+      }
+      i += 1;
+    }
+    scan.exponent += negative_exponent ? -exponent : exponent;
+  }
+
+  return finish_number(&scan, text, length);
+}
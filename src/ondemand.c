@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "ondemand.h"
+#include "parser.h"
+#include "simd_scan.h"
+#include "unicode.h"
+#include "stats.h"
+
+// Bytes the unchecked skip has to look at inside a container
+static const bool skip_stops[256] = {
+  ['\0'] = true, ['"'] = true, ['{'] = true, ['}'] = true, ['['] = true, [']'] = true,
+};
+
+void init_ondemand_document(OnDemandDocument* document) {
+  document->input = NULL;
+  document->validate = false;
+  document->zero_copy = false;
+  document->max_depth = 0;
+  init_arena(&document->arena);
+  init_json_validator(&document->validator);
+  document->scratch = NULL;
+  document->scratch_capacity = 0;
+  init_parser_scratch(&document->parser_scratch);
+}
+
+void free_ondemand_document(OnDemandDocument* document) {
+  free_arena(&document->arena);
+  free_json_validator(&document->validator);
+  free(document->scratch);
+  free_parser_scratch(&document->parser_scratch);
+  init_ondemand_document(document);
+}
+
+// A tokenizer standing at `offset`. Its line and column start from 1 and 0,
+// so the positions it gives are relative to `offset` (see relocate_error()).
+static TokenizerState tokenizer_at(const OnDemandDocument* document, const int offset) {
+  TokenizerState tokenizer = init_tokenizer(document->input);
+  tokenizer.current_index = offset;
+  tokenizer.zero_copy = document->zero_copy;
+  return tokenizer;
+}
+
+// Moves an error reported through tokenizer_at(origin) to its place in the input
+static void relocate_error(const OnDemandDocument* document, const int origin, ParseError* error) {
+  int line;
+  int column;
+  locate_offset(document->input, origin, &line, &column);
+  if (error->line == 1) {
+    error->column += column;
+  }
+  error->line += line - 1;
+}
+
+// Tokens are located from their offset, wherever the tokenizer started.
+// Without a message, the token itself is reported as an unexpected value.
+static CursorResult token_error(const OnDemandDocument* document, ParseError* error, const char* message, Token token) {
+  token.line = 0;
+  token = locate_token(document->input, token);
+  if (message) {
+    set_error(error, message, token.line, token.column);
+  } else {
+    report_value_expected(error, &token);
+  }
+  return CURSOR_ERROR;
+}
+
+static CursorResult position_error(const OnDemandDocument* document, ParseError* error, const char* message, const int offset) {
+  return token_error(document, error, message, make_token(TOKEN_INVALID, NOTE_NONE, offset + 1, 0, 0));
+}
+
+static void skip_spaces(TokenizerState* tokenizer) {
+  while (isspace((unsigned char)peek(tokenizer))) {
+    advance(tokenizer);
+  }
+}
+
+// Just past the closing quote of the string whose content starts at `p`,
+// NULL when the input ends first
+static const char* skip_string(const char* p) {
+  while (true) {
+    p += scan_string_run(p);
+    switch (*p) {
+      case '"': return p + 1;
+      case '\0': return NULL;
+      case '\\': {
+        if (p[1] == '\0') {
+          return NULL;
+        }
+        p += 2;
+        break;
+      }
+      default: p += 1; break;
+    }
+  }
+}
+
+// Offset just past the value at `offset`, found by counting brackets and
+// jumping over strings; nothing else is checked. -1 when the input ends
+// first, `offset` itself when there is no value there.
+static int skip_unchecked(const char* input, const int offset) {
+  const char* p = &input[offset];
+  if (*p == '"') {
+    p = skip_string(p + 1);
+    return p ? (int)(p - input) : -1;
+  }
+
+  if (*p != '{' && *p != '[') {
+    while (*p != ',' && *p != '}' && *p != ']' && *p != '\0' && !isspace((unsigned char)*p)) {
+      p += 1;
+    }
+    return (int)(p - input);
+  }
+
+  int depth = 0;
+  while (true) {
+    while (!skip_stops[(unsigned char)*p]) {
+      p += 1;
+    }
+
+    switch (*p) {
+      case '\0': return -1;
+      case '"': {
+        p = skip_string(p + 1);
+        if (!p) {
+          return -1;
+        }
+        continue;
+      }
+      case '{':
+      case '[': depth += 1; break;
+      default: {
+        depth -= 1;
+        if (depth == 0) {
+          return (int)(p + 1 - input);
+        }
+        break;
+      }
+    }
+    p += 1;
+  }
+}
+
+// Moves the tokenizer past the value it stands on. `origin` is where the
+// tokenizer started, for the positions of the validator's errors.
+static bool skip_value(OnDemandDocument* document, TokenizerState* tokenizer, const int origin, ParseError* error) {
+  if (document->validate) {
+    document->validator.max_depth = document->max_depth;
+    if (!validate_json_value(&document->validator, tokenizer, error)) {
+      relocate_error(document, origin, error);
+      return false;
+    }
+    return true;
+  }
+
+  skip_spaces(tokenizer);
+  int start = tokenizer->current_index;
+  int end = skip_unchecked(document->input, start);
+  if (end < 0) {
+    position_error(document, error, "Unterminated value", start);
+    return false;
+  }
+
+  if (end == start) {
+    token_error(document, error, NULL, next_token(tokenizer));
+    return false;
+  }
+
+  tokenizer->current_index = end;
+  return true;
+}
+
+// Reads the ',' or the closing bracket after a member or element
+static bool read_separator(const OnDemandDocument* document, TokenizerState* tokenizer, const bool is_object, bool* more, ParseError* error) {
+  Token token = next_token(tokenizer);
+  if (token.type == TOKEN_COMMA) {
+    *more = true;
+    return true;
+  }
+
+  if (token.type == (is_object ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+    *more = false;
+    return true;
+  }
+
+  token_error(document, error, is_object ? "Expected ',' or '}' in object" : "Expected ',' or ']' in array", token);
+  return false;
+}
+
+// Same checks and messages as read_object_key() in parser.c
+static CursorResult key_error(const OnDemandDocument* document, ParseError* error, const Token* token, const bool first) {
+  if (token->type == TOKEN_EOF) {
+    return token_error(document, error, first ? "Expected comma or closing brace" : "Property expected", *token);
+  }
+  if (!first && token->type == TOKEN_RBRACE) {
+    return token_error(document, error, "Trailing comma", *token);
+  }
+  if (token->type == TOKEN_NUMBER) {
+    return token_error(document, error, "Expected string as object key", *token);
+  }
+  if (token->type == TOKEN_INVALID_UTF8) {
+    return token_error(document, error, NULL, *token);
+  }
+  return token_error(document, error, "Property keys must be doublequoted", *token);
+}
+
+// Compares a key token with `key`, decoding it first when it has escapes
+static bool key_matches(OnDemandDocument* document, const Token* token, const char* key, const int length, bool* matches) {
+  const char* raw = &document->input[token->offset];
+  if (!token->has_escapes || token->length < length) {
+    *matches = !token->has_escapes && token->length == length && memcmp(raw, key, length) == 0;
+    return true;
+  }
+
+  if (token->length > document->scratch_capacity) {
+    STATS_ALLOC(token->length);
+    char* scratch = realloc(document->scratch, token->length);
+    if (!scratch) {
+      fprintf(stderr, "Error: Can't allocate memory for unescaped key!\n");
+      return false;
+    }
+    document->scratch = scratch;
+    document->scratch_capacity = token->length;
+  }
+
+  int decoded = unescape_string(document->scratch, raw, token->length);
+  *matches = decoded == length && memcmp(document->scratch, key, length) == 0;
+  return true;
+}
+
+static JsonCursor cursor_at(OnDemandDocument* document, const int offset) {
+  JsonCursor cursor = { .document = document, .offset = offset, .resume = 0, .resume_index = 0 };
+  return cursor;
+}
+
+// Looks for `key` among the members from where the tokenizer stands: just
+// after the '{' when `first`, at a member otherwise. Gives up at the '}' or at
+// the member that starts at `stop`. `member` receives where the member found
+// starts (its key's opening quote).
+static CursorResult scan_members(OnDemandDocument* document, TokenizerState* tokenizer, const int origin, bool first,
+    const int stop, const char* key, const int length, JsonCursor* value, int* member, ParseError* error) {
+  while (true) {
+    Token token = next_token(tokenizer);
+    if (token.type != TOKEN_STRING) {
+      if (first && token.type == TOKEN_RBRACE) {
+        return CURSOR_MISSING;
+      }
+      return key_error(document, error, &token, first);
+    }
+
+    if (token.offset - 1 == stop) {
+      return CURSOR_MISSING;
+    }
+
+    Token colon = next_token(tokenizer);
+    if (colon.type != TOKEN_COLON) {
+      return token_error(document, error, "Expected ':' after object key", colon);
+    }
+
+    skip_spaces(tokenizer);
+    int start = tokenizer->current_index;
+    bool matches;
+    if (!key_matches(document, &token, key, length, &matches)) {
+      return token_error(document, error, "Out of memory", token);
+    }
+
+    if (matches) {
+      *value = cursor_at(document, start);
+      *member = token.offset - 1;
+      return CURSOR_FOUND;
+    }
+
+    bool more;
+    if (!skip_value(document, tokenizer, origin, error) || !read_separator(document, tokenizer, true, &more, error)) {
+      return CURSOR_ERROR;
+    }
+
+    if (!more) {
+      return CURSOR_MISSING;
+    }
+    first = false;
+  }
+}
+
+bool ondemand_root(OnDemandDocument* document, const char* input, JsonCursor* root, ParseError* error) {
+  clear_error(error);
+  arena_reset(&document->arena);
+  document->input = input;
+
+  TokenizerState tokenizer = tokenizer_at(document, 0);
+  skip_spaces(&tokenizer);
+  *root = cursor_at(document, tokenizer.current_index);
+
+  char c = peek(&tokenizer);
+  if (c == '{' || c == '[') {
+    return true;
+  }
+
+  if (c == '\0') {
+    token_error(document, error, "Empty input - expected a JSON value", next_token(&tokenizer));
+  } else {
+    set_error(error, "Top-level JSON must be an object or array", 1, 1);
+  }
+  return false;
+}
+
+// Guessed from the first character; the value is only checked once it is read
+JsonType json_cursor_type(const JsonCursor* cursor) {
+  switch (cursor->document->input[cursor->offset]) {
+    case '{': return JSON_OBJECT;
+    case '[': return JSON_ARRAY;
+    case '"': return JSON_STRING;
+    case 't':
+    case 'f': return JSON_BOOL;
+    case 'n': return JSON_NULL;
+    default: return JSON_NUMBER;
+  }
+}
+
+CursorResult json_cursor_field(JsonCursor* object, const char* key, const int length, JsonCursor* value, ParseError* error) {
+  clear_error(error);
+  OnDemandDocument* document = object->document;
+  if (document->input[object->offset] != '{') {
+    return position_error(document, error, "Expected '{' at start of object", object->offset);
+  }
+
+  // Fields are mostly asked for in document order, so the search starts at the
+  // member found last and only wraps around when the key isn't further on
+  CursorResult result = CURSOR_MISSING;
+  int member;
+  if (object->resume > 0) {
+    TokenizerState tokenizer = tokenizer_at(document, object->resume);
+    result = scan_members(document, &tokenizer, object->resume, false, -1, key, length, value, &member, error);
+  }
+
+  if (result == CURSOR_MISSING) {
+    TokenizerState tokenizer = tokenizer_at(document, object->offset + 1);
+    int stop = object->resume > 0 ? object->resume : -1;
+    result = scan_members(document, &tokenizer, object->offset + 1, true, stop, key, length, value, &member, error);
+  }
+
+  if (result == CURSOR_FOUND) {
+    object->resume = member;
+  }
+  return result;
+}
+
+CursorResult json_cursor_index(JsonCursor* array, const int index, JsonCursor* value, ParseError* error) {
+  clear_error(error);
+  OnDemandDocument* document = array->document;
+  if (document->input[array->offset] != '[') {
+    return position_error(document, error, "Expected '[' at start of array", array->offset);
+  }
+
+  if (index < 0) {
+    return CURSOR_MISSING;
+  }
+
+  // Going forward from the element found last, as for fields
+  int position = 0;
+  int origin = array->offset + 1;
+  if (array->resume > 0 && index >= array->resume_index) {
+    position = array->resume_index;
+    origin = array->resume;
+  }
+
+  TokenizerState tokenizer = tokenizer_at(document, origin);
+  skip_spaces(&tokenizer);
+  if (position == 0 && peek(&tokenizer) == ']') {
+    return CURSOR_MISSING;
+  }
+
+  while (true) {
+    int start = tokenizer.current_index;
+    if (position == index) {
+      *value = cursor_at(document, start);
+      array->resume = start;
+      array->resume_index = index;
+      return CURSOR_FOUND;
+    }
+
+    bool more;
+    if (!skip_value(document, &tokenizer, origin, error) || !read_separator(document, &tokenizer, false, &more, error)) {
+      return CURSOR_ERROR;
+    }
+
+    if (!more) {
+      return CURSOR_MISSING;
+    }
+
+    skip_spaces(&tokenizer);
+    if (peek(&tokenizer) == ']') {
+      return token_error(document, error, "Trailing comma", next_token(&tokenizer));
+    }
+    position += 1;
+  }
+}
+
+// Follows a compiled path; keys address objects and indexes arrays, as in json_path_get()
+CursorResult json_cursor_path(JsonCursor* root, const JsonPath* path, JsonCursor* value, ParseError* error) {
+  clear_error(error);
+  JsonCursor current = *root;
+  for (int i = 0; i < path->count; ++i) {
+    // The root is searched in place, so that its resume position is kept
+    JsonCursor* container = i == 0 ? root : &current;
+    const PathStep* step = &path->steps[i];
+    JsonCursor next;
+    CursorResult result = CURSOR_MISSING;
+
+    switch (json_cursor_type(container)) {
+      case JSON_OBJECT: {
+        result = json_cursor_field(container, step->key, step->length, &next, error);
+        break;
+      }
+
+      case JSON_ARRAY: {
+        if (step->index >= 0) {
+          result = json_cursor_index(container, step->index, &next, error);
+        }
+        break;
+      }
+
+      default: {
+        break;
+      }
+    }
+
+    if (result != CURSOR_FOUND) {
+      return result;
+    }
+    current = next;
+  }
+
+  *value = current;
+  return CURSOR_FOUND;
+}
+
+// Builds the value under the cursor in the document's arena: it lives until
+// the next ondemand_root() or free_ondemand_document(). The value is parsed,
+// and so fully checked, whatever `validate` says.
+JsonValue* json_cursor_value(const JsonCursor* cursor, ParseError* error) {
+  OnDemandDocument* document = cursor->document;
+  TokenizerState tokenizer = tokenizer_at(document, cursor->offset);
+  ParserState parser_state = init_pull_parser(&tokenizer);
+  parser_state.max_depth = document->max_depth;
+  parser_state.arena = &document->arena;
+  parser_state.scratch = &document->parser_scratch;
+
+  JsonValue* value = parse_json_value_iterative(&parser_state, error);
+  free_parser_state(&parser_state);
+  if (!value) {
+    relocate_error(document, cursor->offset, error);
+  }
+  return value;
+}
@@ -3,144 +3,162 @@
 #include <stdlib.h>
 #include <string.h>
 #include "parser.h"
+#include "helper.h"
 #include "json.h"
+#include "key_table.h"
+#include "unicode.h"
+#include "stats.h"
 
 #define BUFFER_SIZE 128
+#define INIT_CONTAINER_CAPACITY 4
 
-JsonValue* parse_json_value(ParserState* state, ParseError* error) {
-  Token token = parser_peek(state);
-
-  if (token.type == TOKEN_EOF) {
-    set_error(error, "Empty input - expected a JSON value", token.line, token.column);
-    return NULL;
+// Allocation helpers: nodes come from the state's arena when one is attached,
+// otherwise from the heap (and are then released with free_json_value()).
+static void* parser_alloc(ParserState* state, size_t size) {
+  if (state->arena) {
+    return arena_alloc(state->arena, size);
   }
+  STATS_ALLOC(size);
+  return malloc(size);
+}
 
-  switch (token.type) {
-    case TOKEN_NULL: {
-      return parse_null(state, error);
-    }
-
-    case TOKEN_TRUE:  
-    case TOKEN_FALSE: {
-      return parse_bool(state, &token, error);
-    }
-    
-    case TOKEN_NUMBER: {
-      return parse_number(state, &token, error);
-    }
+static void* parser_grow(ParserState* state, void* ptr, size_t old_size, size_t new_size) {
+  if (state->arena) {
+    return arena_realloc(state->arena, ptr, old_size, new_size);
+  }
+  STATS_ALLOC(new_size);
+  return realloc(ptr, new_size);
+}
 
-    case TOKEN_STRING: {
-      return parse_string(state, &token, error);
-    }
+static void parser_free(ParserState* state, void* ptr) {
+  if (!state->arena) {
+    free(ptr);
+  }
+}
 
-    case TOKEN_RBRACE:
-    case TOKEN_LBRACE: {
-      return parse_object(state, error);
-    }
+static const char* parser_input(const ParserState* state) {
+  return state->tokenizer ? state->tokenizer->input : state->tokens->input;
+}
 
-    case TOKEN_RBRACKET:
-    case TOKEN_LBRACKET: {
-      return parse_array(state, error);
-    }
+static void parser_free_text(ParserState* state, char* text, const bool borrowed) {
+  if (!borrowed) {
+    parser_free(state, text);
+  }
+}
 
-    default: {
-      switch (token.type) {
-        case TOKEN_INVALID_LEADING_ZEROES: {
-          set_error(error, "Numbers cannot have leading zeroes", token.line, token.column);
-          break;
-        }
+// Tokens from a TokenList carry no position: it is only worked out here, when
+// an error needs it
+static Token located(const ParserState* state, const Token* token) {
+  return state->tokens ? locate_token(state->tokens->input, *token) : *token;
+}
 
-        case TOKEN_INVALID_HEX: {
-          set_error(error, "Numbers cannot be hex", token.line, token.column);
-          break;
-        }
+static void token_error(const ParserState* state, ParseError* error, const char* message, const Token* token) {
+  Token at = located(state, token);
+  set_error(error, message, at.line, at.column);
+}
 
-        case TOKEN_INVALID_ESCAPE: {
-          set_error(error, "Invalid escape sequence", token.line, token.column);
-          break;
-        }
+// Reports `message` at the token the parser stands on. Event handlers use it
+// too: their callbacks run while their token is still the lookahead.
+void peek_error(ParserState* state, ParseError* error, const char* message) {
+  if (!state->tokens && !state->tokenizer) {
+    // Events that don't come from an input (see build_json_tree()) have no position
+    set_error(error, message, 0, 0);
+    return;
+  }
 
-        case TOKEN_INVALID_CONTROL_CHARACTERS: {
-          set_error(error, "Control characters must be escaped", token.line, token.column);
-          break;
-        }
+  Token next = parser_peek(state);
+  token_error(state, error, message, &next);
+}
 
-        case TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER: {
-          set_error(error, "Unexpected end of number.", token.line, token.column);
-          break;
-        }
+static void report_token(const ParserState* state, ParseError* error, const Token* token) {
+  Token at = located(state, token);
+  report_value_expected(error, &at);
+}
 
-        default: {
-          set_error(error, "Value expected", token.line, token.column);
-          break;
-        }
-      }
+// Containers grow geometrically so appending n elements costs O(n) overall
+static int grown_capacity(const int capacity) {
+  return capacity > 0 ? capacity * 2 : INIT_CONTAINER_CAPACITY;
+}
 
-      return NULL;
+static bool array_push(ParserState* state, JsonArray* array, JsonValue* element) {
+  if (array->count == array->capacity) {
+    int capacity = grown_capacity(array->capacity);
+    JsonValue** elements = parser_grow(state, array->elements,
+      sizeof(JsonValue*) * array->capacity, sizeof(JsonValue*) * capacity);
+    if (!elements) {
+      fprintf(stderr, "Error: Can't reallocate memory while increasing array's capacity!\n");
+      return false;
     }
+
+    array->elements = elements;
+    array->capacity = capacity;
   }
 
-  return NULL;
+  array->elements[array->count] = element;
+  array->count += 1;
+  return true;
 }
 
-JsonValue* parse_null(ParserState* state, ParseError* error) {
-  parser_advance(state);
-  JsonValue* null_value = malloc(sizeof(JsonValue));
-  if (null_value == NULL) {
-    fprintf(stderr, "Error: Can't allocate memory for JsonValue when parsing 'null'!\n");
-    return NULL;
+static bool object_push(ParserState* state, JsonObject* object, JsonPair* pair) {
+  if (object->count == object->capacity) {
+    int capacity = grown_capacity(object->capacity);
+    JsonPair** pairs = parser_grow(state, object->pairs,
+      sizeof(JsonPair*) * object->capacity, sizeof(JsonPair*) * capacity);
+    if (!pairs) {
+      fprintf(stderr, "Error: Can't reallocate memory while increasing object's capacity!\n");
+      return false;
+    }
+
+    object->pairs = pairs;
+    object->capacity = capacity;
   }
 
-  null_value->type = JSON_NULL;
-  return null_value;
-}
+  object->pairs[object->count] = pair;
+  object->count += 1;
 
-JsonValue* parse_bool(ParserState* state, Token* token, ParseError* error) {
-  parser_advance(state);
-  JsonValue* bool_value = malloc(sizeof(JsonValue));
-  if (bool_value == NULL) {
-    fprintf(stderr, "Error: Can't allocate memory for JsonValue when parsing '%s'!\n", token->type == TOKEN_TRUE ? "true" : "false");
-    return NULL;
+  if (object->count < KEY_INDEX_THRESHOLD) {
+    return true;
   }
 
-  bool_value->type = JSON_BOOL;
-  bool_value->boolean = token->type == TOKEN_TRUE;
-  return bool_value;
-}
+  if (object->index && object->count * 2 <= object->index_capacity) {
+    json_object_index_insert(object, object->count - 1);
+    return true;
+  }
 
-JsonValue* parse_number(ParserState* state, Token* token, ParseError* error) {
-  parser_advance(state);
-  JsonValue* number_value = malloc(sizeof(JsonValue));
-  if (number_value == NULL) {
-    fprintf(stderr, "Error: Can't allocate memory for JsonValue when parsing '%s'!\n", token->value);
-    return NULL;
+  // (Re)build the index with room for twice as many pairs before the next rebuild
+  int index_capacity = KEY_INDEX_THRESHOLD;
+  while (index_capacity < object->count * 4) {
+    index_capacity *= 2;
   }
 
-  number_value->type = JSON_NUMBER;
-  number_value->number = strdup(token->value);
-  return number_value;
-}
+  int* index = parser_alloc(state, sizeof(int) * index_capacity);
+  parser_free(state, object->index);
+  object->index = index;
+  object->index_capacity = 0;
 
-JsonValue* parse_string(ParserState* state, Token* token, ParseError* error) {
-  parser_advance(state);
-  JsonValue* string_value = malloc(sizeof(JsonValue));
-  if (string_value == NULL) {
-    fprintf(stderr, "Error: Can't allocate memory for JsonValue when parsing '%s'!\n", token->value);
-    return NULL;
+  if (!index) {
+    // The index is only an accelerator: lookups fall back to a linear scan
+    fprintf(stderr, "Error: Can't allocate memory for object's key index!\n");
+    return true;
   }
 
-  string_value->type = JSON_STRING;
-  string_value->string = strdup(token->value);
-  return string_value;
+  memset(index, 0, sizeof(int) * index_capacity);
+  object->index_capacity = index_capacity;
+
+  for (int i = 0; i < object->count; ++i) {
+    json_object_index_insert(object, i);
+  }
+  return true;
 }
 
-JsonValue* parse_object(ParserState* state, ParseError* error) {
-  if (!parser_match(state, TOKEN_LBRACE)) {
-    set_error(error, "Expected '{' at start of object", parser_peek(state).line, parser_peek(state).column);
-    return NULL;
+static void parser_discard(ParserState* state, JsonValue* value) {
+  if (!state->arena) {
+    free_json_value(value);
   }
+}
 
-  JsonValue* object = malloc(sizeof(JsonValue));
+static JsonValue* new_object_value(ParserState* state) {
+  JsonValue* object = parser_alloc(state, sizeof(JsonValue));
   if (!object) {
     fprintf(stderr, "Error: Can't allocate memory for JsonValue when parsing object!\n");
     return NULL;
@@ -148,113 +166,111 @@ JsonValue* parse_object(ParserState* state, ParseError* error) {
 
   object->type = JSON_OBJECT;
 
-  JsonObject* obj = malloc(sizeof(JsonObject));
+  JsonObject* obj = parser_alloc(state, sizeof(JsonObject));
   if (!obj) {
     fprintf(stderr, "Error: Can't allocate memory for JsonObject when parsing object!\n");
-    free(object);
+    parser_free(state, object);
     return NULL;
   }
 
   obj->pairs = NULL;
   obj->count = 0;
+  obj->capacity = 0;
+  obj->index = NULL;
+  obj->index_capacity = 0;
 
   object->object = obj;
+  return object;
+}
 
-  if (parser_peek(state).type == TOKEN_EOF) {
-    Token eof = parser_peek(state);
-    set_error(error, "Expected comma or closing brace", eof.line, eof.column);
-    free_json_value(object);
+static JsonValue* new_array_value(ParserState* state) {
+  JsonValue* array = parser_alloc(state, sizeof(JsonValue));
+  if (array == NULL) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonValue!\n");
     return NULL;
   }
 
-  if (parser_peek(state).type == TOKEN_RBRACE) {
-    parser_advance(state);
-    return object;
-  }
+  array->type = JSON_ARRAY;
 
-  while (true) {
-    Token key_token = parser_peek(state);
-    if (key_token.type == TOKEN_NUMBER) {
-      set_error(error, "Expected string as object key", key_token.line, key_token.column);
-      free_json_value(object);
-      return NULL;
-    }
+  JsonArray* arr = parser_alloc(state, sizeof(JsonArray));
+  if (!arr) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonArray when parsing object!\n");
+    parser_free(state, array);
+    return NULL;
+  }
 
-    if (key_token.type != TOKEN_STRING) {
-      set_error(error, "Property keys must be doublequoted", key_token.line, key_token.column);
-      free_json_value(object);
-      return NULL;
-    }
+  arr->elements = NULL;
+  arr->count = 0;
+  arr->capacity = 0;
 
-    char* key = strdup(key_token.value);
-    parser_advance(state);
+  array->array = arr;
+  return array;
+}
 
-    if (key_exists(obj, key)) {
-      char message[BUFFER_SIZE];
-      snprintf(message, sizeof(message), "Duplicate key \"%s\" found", key);
-      set_error(error, message, key_token.line, key_token.column);
-      free(key);
-      free_json_value(object);
-      return NULL;
+// Error for a token that cannot start a value: tokenizer errors get their own message
+void report_value_expected(ParseError* error, const Token* token) {
+  switch (token->type) {
+    case TOKEN_INVALID_LEADING_ZEROES: {
+      set_error(error, "Numbers cannot have leading zeroes", token->line, token->column);
+      break;
     }
 
-    if (!parser_match(state, TOKEN_COLON)) {
-      set_error(error, "Expected ':' after object key", parser_peek(state).line, parser_peek(state).column);
-      free(key);
-      free_json_value(object);
-      return NULL;
+    case TOKEN_INVALID_HEX: {
+      set_error(error, "Numbers cannot be hex", token->line, token->column);
+      break;
     }
 
-    JsonValue* value = parse_json_value(state, error);
-    if (!value) {
-      free(key);
-      free_json_value(object);
-      return NULL;
+    case TOKEN_INVALID_ESCAPE: {
+      set_error(error, "Invalid escape sequence", token->line, token->column);
+      break;
     }
 
-    JsonPair* pair = malloc(sizeof(JsonPair));
-    if (pair == NULL) {
-      fprintf(stderr, "Error: Can't allocate memory for JsonPair!\n");
-      return NULL;
+    case TOKEN_INVALID_CONTROL_CHARACTERS: {
+      set_error(error, "Control characters must be escaped", token->line, token->column);
+      break;
     }
 
-    pair->key = key;
-    pair->value = value;
+    case TOKEN_INVALID_UTF8: {
+      set_error(error, "Invalid UTF-8 sequence", token->line, token->column);
+      break;
+    }
 
-    // Expand object.pairs
-    object->object->pairs = realloc(object->object->pairs, sizeof(JsonPair*) * (object->object->count + 1));
-    object->object->pairs[object->object->count] = pair;
-    object->object->count += 1;
+    case TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER: {
+      set_error(error, "Unexpected end of number.", token->line, token->column);
+      break;
+    }
 
-    Token next = parser_peek(state);
-    if (next.type == TOKEN_COMMA) {
-      parser_advance(state);
+    default: {
+      set_error(error, "Value expected", token->line, token->column);
+      break;
+    }
+  }
+}
 
-      Token after_comma = parser_peek(state);
-      if (after_comma.type == TOKEN_RBRACE) {
-        set_error(error, "Trailing comma", after_comma.line, after_comma.column);
-        free_json_value(object);
-        return NULL;
-      }
+JsonValue* parse_json_text(ParserState* state, ParseError* error) {
+  JsonValue* root = parse_json_value_iterative(state, error);
 
-      if (after_comma.type != TOKEN_STRING && after_comma.type == TOKEN_EOF) {
-        set_error(error, "Property expected", after_comma.line, after_comma.column);
-        free_json_value(object);
-        return NULL;
-      }
+  if (root && root->type != JSON_OBJECT && root->type != JSON_ARRAY) {
+    set_error(error, "Top-level JSON must be an object or array", 1, 1);
+    parser_discard(state, root);
+    return NULL;
+  }
 
-      continue;
-    } else if (next.type == TOKEN_RBRACE) {
-      parser_advance(state);
-      break;
-    } else {
-      set_error(error, "Expected ',' or '}' in object", next.line, next.column);
-      free_json_value(object);
+  if (root) {
+    Token remaining = parser_peek(state);
+    if (remaining.type != TOKEN_EOF) {
+      token_error(state, error, "End of file expected", &remaining);
+      parser_discard(state, root);
       return NULL;
     }
   }
 
-  return object;
+  return root;
+}
+
+// Reads one value of any type; the parser is left on the token after it
+JsonValue* parse_json_value(ParserState* state, ParseError* error) {
+  return parse_json_value_iterative(state, error);
 }
 
 bool parser_match(ParserState* state, const TokenType expected) {
@@ -265,89 +281,804 @@ bool parser_match(ParserState* state, const TokenType expected) {
   return false;
 }
 
-JsonValue* parse_array(ParserState* state, ParseError* error) {
-  if (!parser_match(state, TOKEN_LBRACKET)) {
-    set_error(error, "Expected '[' at start of array", parser_peek(state).line, parser_peek(state).column);
-    return NULL;
+ParserState init_pull_parser(TokenizerState* tokenizer) {
+  ParserState state = {
+    .tokens = NULL,
+    .current_index = 0,
+    .tokenizer = tokenizer,
+    .lookahead = next_token(tokenizer),
+    .arena = NULL,
+    .max_depth = 0,
+    .scratch = NULL,
+    .keys = NULL,
+  };
+  return state;
+}
+
+void free_parser_state(ParserState* state) {
+  if (!state || !state->tokenizer) {
+    return;
   }
 
-  JsonValue* array = malloc(sizeof(JsonValue));
-  if (array == NULL) {
-    fprintf(stderr, "Error: Can't allocate memory for JsonValue!\n");
-    return NULL;
+  state->lookahead.type = TOKEN_EOF;
+}
+
+void init_parser_scratch(ParserScratch* scratch) {
+  *scratch = (ParserScratch){ .frames = NULL, .frame_capacity = 0, .events = NULL, .event_capacity = 0, .text = NULL, .text_capacity = 0 };
+  init_key_stack(&scratch->keys);
+}
+
+void free_parser_scratch(ParserScratch* scratch) {
+  free(scratch->frames);
+  free(scratch->events);
+  free(scratch->text);
+  free_key_stack(&scratch->keys);
+  init_parser_scratch(scratch);
+}
+
+Token parser_peek(ParserState* state) {
+  if (state->tokenizer) {
+    return state->lookahead;
   }
+  return get_token(state->tokens, state->current_index);
+}
 
-  array->type = JSON_ARRAY;
+void parser_advance(ParserState* state) {
+  if (state->tokenizer) {
+    if (state->lookahead.type != TOKEN_EOF) {
+      state->lookahead = next_token(state->tokenizer);
+      state->current_index += 1;
+    }
+    return;
+  }
 
-  JsonArray* arr = malloc(sizeof(JsonArray));
-  if (!arr) {
-    fprintf(stderr, "Error: Can't allocate memory for JsonArray when parsing object!\n");
-    free(array);
-    return NULL;
+  if (state->tokens->tokens[state->current_index].type != TOKEN_EOF) {
+    state->current_index += 1;
   }
+}
 
-  arr->elements = NULL;
-  arr->count = 0;
+// Event-driven parsing: the grammar runs over the tokens (from a TokenList or
+// pulled from the tokenizer) and each value is reported to a JsonEventHandler
+// as it is read. Open containers live on an explicit stack (on the C stack
+// while it fits, on the heap beyond that), so nesting depth is bounded by
+// state->max_depth rather than by stack size. Callbacks are made while their
+// token is still the parser's lookahead, so a handler can report an error at
+// it with the parser's own helpers. Duplicate keys are caught here, so every
+// consumer reports them the same way.
 
-  array->array = arr;
+#define EVENT_STACK_SIZE 64
+#define EVENT_TEXT_SIZE 256
 
-  if (parser_peek(state).type == TOKEN_RBRACKET) {
-    parser_advance(state);
-    return array;
+typedef struct eventFrame {
+  bool is_object;
+  int count;     // values completed in the container so far
+  KeyScope keys; // objects: keys read so far
+} EventFrame;
+
+typedef struct eventParser {
+  ParserState* state;
+  const JsonEventHandler* handler;
+  ParseError* error;
+  EventFrame* frames;
+  int depth;
+  int capacity;
+  char* text; // decoded text of the string being reported, when it has escapes
+  int text_capacity;
+  KeyStack* keys;
+} EventParser;
+
+// A callback returned false: it may have set its own error
+static bool handler_stopped(EventParser* parser) {
+  if (parser->error && parser->error->message[0] == '\0') {
+    peek_error(parser->state, parser->error, "Parsing stopped by the event handler");
+  }
+  return false;
+}
+
+static bool push_event_frame(EventParser* parser, EventFrame* local, const bool is_object) {
+  if (parser->depth == parser->capacity) {
+    int capacity = parser->capacity * 2;
+    STATS_ALLOC(sizeof(EventFrame) * capacity);
+    EventFrame* frames = malloc(sizeof(EventFrame) * capacity);
+    if (!frames) {
+      fprintf(stderr, "Error: Can't allocate memory while increasing parser stack's capacity!\n");
+      return false;
+    }
+
+    memcpy(frames, parser->frames, sizeof(EventFrame) * parser->depth);
+    if (parser->frames != local) {
+      free(parser->frames);
+    }
+    parser->frames = frames;
+    parser->capacity = capacity;
+  }
+
+  parser->frames[parser->depth] = (EventFrame){ .is_object = is_object, .count = 0 };
+  if (is_object) {
+    parser->frames[parser->depth].keys = open_key_scope(parser->keys);
+  }
+  parser->depth += 1;
+  return true;
+}
+
+// Text of a string token: a slice of the input unless it has escapes, then
+// its decoded text in the parser's buffer
+static inline bool token_text(EventParser* parser, char* local, const Token* token, const char** text, int* length) {
+  *text = &parser_input(parser->state)[token->offset];
+  *length = token->length;
+  if (token->has_escapes) {
+    if (token->length > parser->text_capacity) {
+      int capacity = parser->text_capacity * 2 > token->length ? parser->text_capacity * 2 : token->length;
+      STATS_ALLOC(capacity);
+      char* grown = malloc(capacity);
+      if (!grown) {
+        fprintf(stderr, "Error: Can't allocate memory for unescaped string!\n");
+        peek_error(parser->state, parser->error, "Out of memory");
+        return false;
+      }
+
+      if (parser->text != local) {
+        free(parser->text);
+      }
+      parser->text = grown;
+      parser->text_capacity = capacity;
+    }
+
+    *length = unescape_string(parser->text, *text, token->length);
+    *text = parser->text;
+  }
+  return true;
+}
+
+// Reports a string token. Nothing is decoded when the callback is not set.
+static inline bool emit_text(EventParser* parser, char* local, const Token* token,
+    bool (*callback)(void* context, const char* text, const int length, const bool has_escapes)) {
+  if (!callback) {
+    return true;
+  }
+
+  const char* text;
+  int length;
+  if (!token_text(parser, local, token, &text, &length)) {
+    return false;
+  }
+
+  return callback(parser->handler->context, text, length, token->has_escapes) || handler_stopped(parser);
+}
+
+// Reads `"key" :`, rejecting a key the object already has
+static inline bool read_object_key(EventParser* parser, char* local) {
+  ParserState* state = parser->state;
+  Token key_token = parser_peek(state);
+  if (key_token.type == TOKEN_NUMBER) {
+    token_error(state, parser->error, "Expected string as object key", &key_token);
+    return false;
+  }
+
+  if (key_token.type == TOKEN_INVALID_UTF8) {
+    report_token(state, parser->error, &key_token);
+    return false;
+  }
+
+  if (key_token.type != TOKEN_STRING) {
+    token_error(state, parser->error, "Property keys must be doublequoted", &key_token);
+    return false;
+  }
+
+  const char* key;
+  int length;
+  if (!token_text(parser, local, &key_token, &key, &length)) {
+    return false;
+  }
+
+  EventFrame* frame = &parser->frames[parser->depth - 1];
+  unsigned int hash = hash_key(key, length);
+  if (key_scope_contains(parser->keys, &frame->keys, hash, key, length)) {
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Duplicate key \"%.*s\" found", length, key);
+    token_error(state, parser->error, message, &key_token);
+    return false;
+  }
+
+  if (!key_scope_add(parser->keys, &frame->keys, hash, key, length)) {
+    token_error(state, parser->error, "Out of memory", &key_token);
+    return false;
+  }
+
+  const JsonEventHandler* handler = parser->handler;
+  if (handler->on_key && !handler->on_key(handler->context, key, length, key_token.has_escapes)) {
+    return handler_stopped(parser);
+  }
+  parser_advance(state);
+
+  if (!parser_match(state, TOKEN_COLON)) {
+    peek_error(state, parser->error, "Expected ':' after object key");
+    return false;
+  }
+
+  return true;
+}
+
+// Consumes the closing bracket of the innermost container, once it is reported
+static inline bool close_container(EventParser* parser) {
+  parser->depth -= 1;
+
+  const JsonEventHandler* handler = parser->handler;
+  bool (*end)(void* context) = handler->on_end_array;
+  if (parser->frames[parser->depth].is_object) {
+    STATS_MAX(largest_object, parser->frames[parser->depth].count);
+    close_key_scope(parser->keys, &parser->frames[parser->depth].keys);
+    end = handler->on_end_object;
+  } else {
+    STATS_MAX(largest_array, parser->frames[parser->depth].count);
   }
 
+  if (end && !end(handler->context)) {
+    return handler_stopped(parser);
+  }
+
+  parser_advance(parser->state);
+  return true;
+}
+
+static bool parse_events(EventParser* parser, EventFrame* local_frames, char* local_text) {
+  ParserState* state = parser->state;
+  ParseError* error = parser->error;
+  const JsonEventHandler* handler = parser->handler;
+  void* context = handler->context;
+  int max_depth = state->max_depth > 0 ? state->max_depth : DEFAULT_MAX_DEPTH;
+
   while (true) {
-    JsonValue* element = parse_json_value(state, error);
-    if (!element) {
-      free_json_value(array);
-      return NULL;
+    // A value is expected here
+    Token token = parser_peek(state);
+
+    switch (token.type) {
+      case TOKEN_EOF: {
+        token_error(state, error, "Empty input - expected a JSON value", &token);
+        return false;
+      }
+
+      case TOKEN_NULL: {
+        if (handler->on_null && !handler->on_null(context)) {
+          return handler_stopped(parser);
+        }
+        parser_advance(state);
+        break;
+      }
+
+      case TOKEN_TRUE:
+      case TOKEN_FALSE: {
+        if (handler->on_bool && !handler->on_bool(context, token.type == TOKEN_TRUE)) {
+          return handler_stopped(parser);
+        }
+        parser_advance(state);
+        break;
+      }
+
+      case TOKEN_NUMBER: {
+        if (handler->on_number && !handler->on_number(context, &parser_input(state)[token.offset], token.length)) {
+          return handler_stopped(parser);
+        }
+        parser_advance(state);
+        break;
+      }
+
+      case TOKEN_STRING: {
+        if (!emit_text(parser, local_text, &token, handler->on_string)) {
+          return false;
+        }
+        parser_advance(state);
+        break;
+      }
+
+      case TOKEN_RBRACE:
+      case TOKEN_LBRACE:
+      case TOKEN_RBRACKET:
+      case TOKEN_LBRACKET: {
+        bool is_object = token.type == TOKEN_LBRACE || token.type == TOKEN_RBRACE;
+        if (!parser_match(state, is_object ? TOKEN_LBRACE : TOKEN_LBRACKET)) {
+          peek_error(state, error, is_object ? "Expected '{' at start of object" : "Expected '[' at start of array");
+          return false;
+        }
+
+        if (parser->depth >= max_depth) {
+          token_error(state, error, "Maximum nesting depth exceeded", &token);
+          return false;
+        }
+
+        if (!push_event_frame(parser, local_frames, is_object)) {
+          token_error(state, error, "Out of memory", &token);
+          return false;
+        }
+        STATS_MAX(max_depth, parser->depth);
+
+        bool (*start)(void* context) = is_object ? handler->on_start_object : handler->on_start_array;
+        if (start && !start(context)) {
+          return handler_stopped(parser);
+        }
+
+        Token next = parser_peek(state);
+        if (is_object && next.type == TOKEN_EOF) {
+          token_error(state, error, "Expected comma or closing brace", &next);
+          return false;
+        }
+
+        if (next.type == (is_object ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+          if (!close_container(parser)) {
+            return false;
+          }
+          break;
+        }
+
+        if (is_object && !read_object_key(parser, local_text)) {
+          return false;
+        }
+
+        continue;
+      }
+
+      default: {
+        report_token(state, error, &token);
+        return false;
+      }
     }
 
-    // Expand array
-    array->array->elements = realloc(array->array->elements, sizeof(JsonValue*) * (array->array->count + 1));
-    array->array->elements[array->array->count] = element;
-    array->array->count += 1;
+    // A value is complete: count it and close every container it completes
+    while (true) {
+      if (parser->depth == 0) {
+        return true;
+      }
 
-    Token next = parser_peek(state);
-    if (next.type == TOKEN_COMMA) {
-      parser_advance(state);
+      EventFrame* frame = &parser->frames[parser->depth - 1];
+      bool is_object = frame->is_object;
+      frame->count += 1;
 
-      Token after_comma = parser_peek(state);
-      if (after_comma.type == TOKEN_RBRACKET) {
-        set_error(error, "Trailing comma", after_comma.line, after_comma.column);
-        free_json_value(array);
-        return NULL;
+      Token next = parser_peek(state);
+      if (next.type == TOKEN_COMMA) {
+        parser_advance(state);
+
+        Token after_comma = parser_peek(state);
+        if (after_comma.type == (is_object ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+          token_error(state, error, "Trailing comma", &after_comma);
+          return false;
+        }
+
+        if (is_object && after_comma.type == TOKEN_EOF) {
+          token_error(state, error, "Property expected", &after_comma);
+          return false;
+        }
+
+        if (is_object && !read_object_key(parser, local_text)) {
+          return false;
+        }
+
+        break;
+      } else if (next.type == (is_object ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+        if (!close_container(parser)) {
+          return false;
+        }
+      } else {
+        token_error(state, error, is_object ? "Expected ',' or '}' in object" : "Expected ',' or ']' in array", &next);
+        return false;
       }
+    }
+  }
+}
 
-      continue;
-    } else if (next.type == TOKEN_RBRACKET) {
-      parser_advance(state);
-      break;
-    } else {
-      set_error(error, "Expected ',' or ']' in array", next.line, next.column);
-      free_json_value(array);
-      return NULL;
+// Reads one value (scalar or container) and reports it to the handler; the
+// parser is left on the token after it. Events already delivered are not
+// taken back when an error is found later on.
+bool parse_json_events(ParserState* state, const JsonEventHandler* handler, ParseError* error) {
+  clear_error(error);
+
+  EventFrame local_frames[EVENT_STACK_SIZE];
+  char local_text[EVENT_TEXT_SIZE];
+  KeyStack local_keys;
+  EventParser parser = {
+    .state = state,
+    .handler = handler,
+    .error = error,
+    .frames = local_frames,
+    .depth = 0,
+    .capacity = EVENT_STACK_SIZE,
+    .text = local_text,
+    .text_capacity = EVENT_TEXT_SIZE,
+    .keys = &local_keys,
+  };
+
+  // Buffers grown by earlier parses take over once they beat the local ones
+  ParserScratch* scratch = state->scratch;
+  if (scratch) {
+    parser.keys = &scratch->keys;
+  } else {
+    init_key_stack(&local_keys);
+  }
+  if (scratch && scratch->event_capacity > EVENT_STACK_SIZE) {
+    parser.frames = scratch->events;
+    parser.capacity = scratch->event_capacity;
+  }
+  if (scratch && scratch->text_capacity > EVENT_TEXT_SIZE) {
+    parser.text = scratch->text;
+    parser.text_capacity = scratch->text_capacity;
+  }
+
+  bool parsed = parse_events(&parser, local_frames, local_text);
+
+  // Release the key scopes of the objects still open after an error
+  while (parser.depth > 0) {
+    parser.depth -= 1;
+    if (parser.frames[parser.depth].is_object) {
+      close_key_scope(parser.keys, &parser.frames[parser.depth].keys);
     }
   }
+  if (!scratch) {
+    free_key_stack(&local_keys);
+  }
 
-  return array;
+  if (parser.frames != local_frames) {
+    if (scratch) {
+      scratch->events = parser.frames;
+      scratch->event_capacity = parser.capacity;
+    } else {
+      free(parser.frames);
+    }
+  }
+  if (parser.text != local_text) {
+    if (scratch) {
+      scratch->text = parser.text;
+      scratch->text_capacity = parser.text_capacity;
+    } else {
+      free(parser.text);
+    }
+  }
+  return parsed;
 }
 
-Token parser_peek(ParserState* state) {
-  return state->tokens[state->current_index];
+// Same rules as parse_json_text(): one object or array, then the end of the input
+bool parse_json_text_events(ParserState* state, const JsonEventHandler* handler, ParseError* error) {
+  Token first = parser_peek(state);
+  switch (first.type) {
+    case TOKEN_NULL:
+    case TOKEN_TRUE:
+    case TOKEN_FALSE:
+    case TOKEN_NUMBER:
+    case TOKEN_STRING: {
+      clear_error(error);
+      set_error(error, "Top-level JSON must be an object or array", 1, 1);
+      return false;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  if (!parse_json_events(state, handler, error)) {
+    return false;
+  }
+
+  Token remaining = parser_peek(state);
+  if (remaining.type != TOKEN_EOF) {
+    token_error(state, error, "End of file expected", &remaining);
+    return false;
+  }
+
+  return true;
 }
 
-void parser_advance(ParserState* state) {
-  if (state->tokens[state->current_index].type != TOKEN_EOF) {
-    state->current_index += 1;
+// The tree builder is one consumer of the events: containers being filled
+// are kept on its own stack, and every value is attached to its parent as
+// soon as it is complete.
+
+typedef struct parseFrame {
+  JsonValue* container;
+  char* key; // object frames: key waiting for its value
+  int key_length;
+  bool borrowed_key;
+  bool interned_key;
+} ParseFrame;
+
+typedef struct parseStack {
+  ParseFrame* frames;
+  int count;
+  int capacity;
+} ParseStack;
+
+typedef struct treeBuilder {
+  ParserState* state;
+  ParseError* error;
+  ParseStack stack;
+  JsonValue* root; // set once the outermost value is complete
+} TreeBuilder;
+
+static bool push_frame(ParseStack* stack, JsonValue* container) {
+  if (stack->count == stack->capacity) {
+    int capacity = grown_capacity(stack->capacity);
+    STATS_ALLOC(sizeof(ParseFrame) * capacity);
+    ParseFrame* frames = realloc(stack->frames, sizeof(ParseFrame) * capacity);
+    if (!frames) {
+      fprintf(stderr, "Error: Can't reallocate memory while increasing parser stack's capacity!\n");
+      return false;
+    }
+
+    stack->frames = frames;
+    stack->capacity = capacity;
   }
+
+  ParseFrame frame = { .container = container, .key = NULL, .key_length = 0, .borrowed_key = false, .interned_key = false };
+  stack->frames[stack->count] = frame;
+  stack->count += 1;
+  return true;
 }
 
-bool key_exists(JsonObject* object, const char* key) {
-  for (int i = 0; i < object->count; ++i) {
-    if (strcmp(object->pairs[i]->key, key) == 0) {
-      return true;
+// Releases every container still on the stack. Children are only attached to
+// their parent once complete, so each frame owns its own partial subtree.
+static void unwind_stack(ParserState* state, ParseStack* stack) {
+  for (int i = stack->count - 1; i >= 0; --i) {
+    if (stack->frames[i].key) {
+      parser_free_text(state, stack->frames[i].key, stack->frames[i].borrowed_key);
     }
+    parser_discard(state, stack->frames[i].container);
+  }
+  stack->count = 0;
+}
+
+// Hands the stack's buffer back to the state's scratch, or frees it
+static void release_stack(ParserState* state, ParseStack* stack) {
+  if (state->scratch) {
+    state->scratch->frames = stack->frames;
+    state->scratch->frame_capacity = stack->capacity;
+  } else {
+    free(stack->frames);
   }
+  stack->frames = NULL;
+}
+
+// Attaches a complete value to the container on top of the stack
+static bool attach_value(ParserState* state, ParseFrame* frame, JsonValue* value) {
+  if (frame->container->type == JSON_ARRAY) {
+    return array_push(state, frame->container->array, value);
+  }
+
+  JsonPair* pair = parser_alloc(state, sizeof(JsonPair));
+  if (pair == NULL) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonPair!\n");
+    return false;
+  }
+
+  pair->key = frame->key;
+  pair->key_length = frame->key_length;
+  pair->borrowed_key = frame->borrowed_key;
+  pair->interned_key = frame->interned_key;
+  pair->value = value;
+
+  if (!object_push(state, frame->container->object, pair)) {
+    parser_free(state, pair);
+    return false;
+  }
+
+  frame->key = NULL;
+  return true;
+}
+
+static bool build_failed(TreeBuilder* builder) {
+  peek_error(builder->state, builder->error, "Out of memory");
   return false;
-}
\ No newline at end of file
+}
+
+// Hands a complete value to the container being filled, or makes it the root
+static bool build_value(TreeBuilder* builder, JsonValue* value) {
+  if (!value) {
+    return build_failed(builder);
+  }
+
+  if (builder->stack.count == 0) {
+    builder->root = value;
+    return true;
+  }
+
+  if (!attach_value(builder->state, &builder->stack.frames[builder->stack.count - 1], value)) {
+    parser_discard(builder->state, value);
+    return build_failed(builder);
+  }
+  return true;
+}
+
+static JsonValue* new_scalar_value(TreeBuilder* builder, const JsonType type) {
+  JsonValue* value = parser_alloc(builder->state, sizeof(JsonValue));
+  if (!value) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonValue!\n");
+    return NULL;
+  }
+
+  value->type = type;
+  return value;
+}
+
+// Text without escapes is a slice of the input, which zero-copy trees borrow;
+// anything else is copied (decoded text may contain NUL bytes)
+static char* build_text(TreeBuilder* builder, const char* text, const int length, const bool has_escapes, bool* borrowed) {
+  ParserState* state = builder->state;
+  *borrowed = !has_escapes && state->tokenizer && state->tokenizer->zero_copy;
+  if (*borrowed) {
+    return (char*)text;
+  }
+
+  char* copy = parser_alloc(state, length + 1);
+  if (!copy) {
+    fprintf(stderr, "Error: Can't allocate memory for string!\n");
+    return NULL;
+  }
+
+  memcpy(copy, text, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+static bool build_null(void* context) {
+  return build_value(context, new_scalar_value(context, JSON_NULL));
+}
+
+static bool build_bool(void* context, const bool boolean) {
+  JsonValue* value = new_scalar_value(context, JSON_BOOL);
+  if (value) {
+    value->boolean = boolean;
+  }
+  return build_value(context, value);
+}
+
+static bool build_number(void* context, const char* text, const int length) {
+  TreeBuilder* builder = context;
+  ParserState* state = builder->state;
+  JsonValue* value = new_scalar_value(builder, JSON_NUMBER);
+  if (!value) {
+    return build_failed(builder);
+  }
+
+  value->number = build_text(builder, text, length, false, &value->borrowed);
+  value->length = length;
+  if (!value->number) {
+    parser_free(state, value);
+    return build_failed(builder);
+  }
+
+  // The pull tokenizer has just decoded the lookahead; stored tokens are decoded here
+  JsonNumber number = state->tokenizer ? state->tokenizer->number : decode_number(text, length);
+  value->number_kind = number.kind;
+  value->numeric = number.value;
+  return build_value(builder, value);
+}
+
+static bool build_string(void* context, const char* text, const int length, const bool has_escapes) {
+  TreeBuilder* builder = context;
+  JsonValue* value = new_scalar_value(builder, JSON_STRING);
+  if (!value) {
+    return build_failed(builder);
+  }
+
+  value->string = build_text(builder, text, length, has_escapes, &value->borrowed);
+  value->length = length;
+  if (!value->string) {
+    parser_free(builder->state, value);
+    return build_failed(builder);
+  }
+  return build_value(builder, value);
+}
+
+// Duplicate keys never get here: parse_json_events() rejects them
+static bool build_key(void* context, const char* text, const int length, const bool has_escapes) {
+  TreeBuilder* builder = context;
+  ParseFrame* frame = &builder->stack.frames[builder->stack.count - 1];
+
+  // Interned keys are shared: found by pointer, never copied or freed
+  const InternedKey* interned = NULL;
+  if (builder->state->keys) {
+    interned = key_table_intern(builder->state->keys, text, length);
+    if (!interned) {
+      return build_failed(builder);
+    }
+  }
+
+  if (interned) {
+    frame->key = (char*)interned->text;
+    frame->borrowed_key = true;
+  } else {
+    frame->key = build_text(builder, text, length, has_escapes, &frame->borrowed_key);
+  }
+  frame->interned_key = interned != NULL;
+  frame->key_length = length;
+  return frame->key ? true : build_failed(builder);
+}
+
+static bool build_container(TreeBuilder* builder, JsonValue* container) {
+  if (!container) {
+    return build_failed(builder);
+  }
+
+  if (!push_frame(&builder->stack, container)) {
+    parser_discard(builder->state, container);
+    return build_failed(builder);
+  }
+  return true;
+}
+
+static bool build_start_object(void* context) {
+  TreeBuilder* builder = context;
+  return build_container(builder, new_object_value(builder->state));
+}
+
+static bool build_start_array(void* context) {
+  TreeBuilder* builder = context;
+  return build_container(builder, new_array_value(builder->state));
+}
+
+static bool build_end_container(void* context) {
+  TreeBuilder* builder = context;
+  builder->stack.count -= 1;
+  return build_value(builder, builder->stack.frames[builder->stack.count].container);
+}
+
+static JsonValue* build_tree(ParserState* state, JsonEventSource produce, void* source, ParseError* error) {
+  ParserScratch* scratch = state->scratch;
+  TreeBuilder builder = {
+    .state = state,
+    .error = error,
+    .stack = {
+      .frames = scratch ? scratch->frames : NULL,
+      .count = 0,
+      .capacity = scratch ? scratch->frame_capacity : 0,
+    },
+    .root = NULL,
+  };
+
+  JsonEventHandler handler = {
+    .context = &builder,
+    .on_null = build_null,
+    .on_bool = build_bool,
+    .on_number = build_number,
+    .on_string = build_string,
+    .on_key = build_key,
+    .on_start_object = build_start_object,
+    .on_end_object = build_end_container,
+    .on_start_array = build_start_array,
+    .on_end_array = build_end_container,
+  };
+
+  if (!produce(source, &handler, error)) {
+    unwind_stack(state, &builder.stack);
+    release_stack(state, &builder.stack);
+    return NULL;
+  }
+
+  release_stack(state, &builder.stack);
+  return builder.root;
+}
+
+static bool produce_parsed(void* source, const JsonEventHandler* handler, ParseError* error) {
+  return parse_json_events(source, handler, error);
+}
+
+// The tree builder over the events of parse_json_events(): nesting depth is
+// bounded by state->max_depth rather than by stack size.
+JsonValue* parse_json_value_iterative(ParserState* state, ParseError* error) {
+  return build_tree(state, produce_parsed, state, error);
+}
+
+// Builds a tree from events that don't come from the parser (a replayed tape,
+// say): `produce` reports one value to the handler it is given. Nodes come
+// from `arena` when it is set, otherwise from the heap. Text is always copied.
+// Keys are taken as they come: the source must not repeat one in an object.
+JsonValue* build_json_tree(Arena* arena, JsonEventSource produce, void* source, ParseError* error) {
+  ParserState state = {
+    .tokens = NULL,
+    .current_index = 0,
+    .tokenizer = NULL,
+    .arena = arena,
+    .max_depth = 0,
+    .scratch = NULL,
+    .keys = NULL,
+  };
+
+  clear_error(error);
+  return build_tree(&state, produce, source, error);
+}
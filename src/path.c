@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "path.h"
+#include "key_table.h"
+#include "stats.h"
+
+#define INIT_PATH_SET_CAPACITY 16
+#define PATH_STACK_SIZE 64
+
+// Position addressed by a key in an array, or -1: digits only, no leading zero
+static int array_index(const char* key, const int length) {
+  if (length == 0 || (length > 1 && key[0] == '0')) {
+    return -1;
+  }
+
+  long long value = 0;
+  for (int i = 0; i < length; ++i) {
+    if (key[i] < '0' || key[i] > '9') {
+      return -1;
+    }
+    value = value * 10 + (key[i] - '0');
+    if (value > INT_MAX) {
+      return -1;
+    }
+  }
+  return (int)value;
+}
+
+// The child of `value` a step leads to, or NULL
+static JsonValue* step_into(JsonValue* value, const PathStep* step) {
+  if (value->type == JSON_OBJECT) {
+    int position = step->interned ? json_object_find_interned(value->object, step->interned)
+      : json_object_find_hashed(value->object, step->key, step->length, step->hash);
+    return position >= 0 ? value->object->pairs[position]->value : NULL;
+  }
+
+  if (value->type == JSON_ARRAY && step->index >= 0 && step->index < value->array->count) {
+    return value->array->elements[step->index];
+  }
+
+  return NULL;
+}
+
+// Room for at most `count` steps whose keys, decoded, fit in the path's text
+static bool alloc_path(JsonPath* path, const int count, const size_t text_length) {
+  if (count > 0) {
+    STATS_ALLOC(sizeof(PathStep) * count);
+    path->steps = malloc(sizeof(PathStep) * count);
+  }
+  STATS_ALLOC(text_length + 1);
+  path->keys = malloc(text_length + 1);
+
+  if ((count > 0 && !path->steps) || !path->keys) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonPath!\n");
+    return false;
+  }
+  return true;
+}
+
+static void add_step(JsonPath* path, char* key, const int length) {
+  key[length] = '\0';
+  path->steps[path->count] = (PathStep){
+    .key = key,
+    .length = length,
+    .hash = hash_key(key, length),
+    .index = array_index(key, length),
+    .interned = NULL,
+  };
+  path->count += 1;
+}
+
+// Column is the 0-based offset in the path text
+static bool path_error(JsonPath* path, ParseError* error, const char* message, const size_t offset) {
+  free_json_path(path);
+  set_error(error, message, 1, (int)offset + 1);
+  return false;
+}
+
+bool compile_json_pointer(JsonPath* path, const char* pointer, ParseError* error) {
+  *path = (JsonPath){ 0 };
+  clear_error(error);
+
+  size_t text_length = strlen(pointer);
+  if (text_length > 0 && pointer[0] != '/') {
+    return path_error(path, error, "JSON Pointer must start with '/'", 0);
+  }
+
+  int count = 0;
+  for (size_t i = 0; i < text_length; ++i) {
+    count += pointer[i] == '/';
+  }
+
+  if (!alloc_path(path, count, text_length)) {
+    return path_error(path, error, "Out of memory", 0);
+  }
+
+  char* out = path->keys;
+  size_t i = 0;
+  while (i < text_length) {
+    i += 1; // the '/'
+    char* key = out;
+    while (i < text_length && pointer[i] != '/') {
+      if (pointer[i] != '~') {
+        *out++ = pointer[i++];
+        continue;
+      }
+
+      if (pointer[i + 1] != '0' && pointer[i + 1] != '1') {
+        return path_error(path, error, "Invalid escape in JSON Pointer (expected ~0 or ~1)", i);
+      }
+      *out++ = pointer[i + 1] == '0' ? '~' : '/';
+      i += 2;
+    }
+
+    add_step(path, key, (int)(out - key));
+    out += 1;
+  }
+
+  return true;
+}
+
+bool compile_json_dotted_path(JsonPath* path, const char* text, ParseError* error) {
+  *path = (JsonPath){ 0 };
+  clear_error(error);
+
+  size_t text_length = strlen(text);
+  int count = 1;
+  for (size_t i = 0; i < text_length; ++i) {
+    count += text[i] == '.' || text[i] == '[';
+  }
+
+  if (!alloc_path(path, count, text_length)) {
+    return path_error(path, error, "Out of memory", 0);
+  }
+
+  if (text_length == 0) {
+    return true;
+  }
+
+  char* out = path->keys;
+  size_t i = 0;
+  while (true) {
+    char* key = out;
+    if (text[i] == '[') {
+      i += 1;
+      size_t start = i;
+      while (text[i] >= '0' && text[i] <= '9') {
+        *out++ = text[i++];
+      }
+
+      if (i == start) {
+        return path_error(path, error, "Expected array index after '['", i);
+      }
+      if (text[i] != ']') {
+        return path_error(path, error, "Expected ']' after array index", i);
+      }
+      if (array_index(key, (int)(out - key)) < 0) {
+        return path_error(path, error, "Invalid array index", start);
+      }
+      i += 1;
+    } else {
+      size_t start = i;
+      while (text[i] != '\0' && text[i] != '.' && text[i] != '[') {
+        *out++ = text[i++];
+      }
+
+      if (i == start) {
+        return path_error(path, error, "Empty key in path", i);
+      }
+    }
+
+    add_step(path, key, (int)(out - key));
+    out += 1;
+
+    if (text[i] == '\0') {
+      return true;
+    }
+    if (text[i] == '.') {
+      i += 1;
+    } else if (text[i] != '[') {
+      return path_error(path, error, "Expected '.' or '[' after ']'", i);
+    }
+  }
+}
+
+// A JSON Pointer when the text is empty or starts with '/', a dotted path otherwise
+bool compile_json_path(JsonPath* path, const char* text, ParseError* error) {
+  if (text[0] == '\0' || text[0] == '/') {
+    return compile_json_pointer(path, text, error);
+  }
+  return compile_json_dotted_path(path, text, error);
+}
+
+// Points every step at its key in `table`, so in trees parsed with the same
+// table keys are matched by pointer. Trees parsed without a table still match
+// by bytes, but a tree parsed with another table won't match at all.
+bool intern_json_path(JsonPath* path, KeyTable* table) {
+  for (int i = 0; i < path->count; ++i) {
+    path->steps[i].interned = key_table_intern(table, path->steps[i].key, path->steps[i].length);
+    if (!path->steps[i].interned) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The value the path leads to, or NULL when some step doesn't exist
+JsonValue* json_path_get(const JsonPath* path, JsonValue* root) {
+  JsonValue* value = root;
+  for (int i = 0; value && i < path->count; ++i) {
+    value = step_into(value, &path->steps[i]);
+  }
+  return value;
+}
+
+void free_json_path(JsonPath* path) {
+  free(path->steps);
+  free(path->keys);
+  *path = (JsonPath){ 0 };
+}
+
+void init_json_path_set(JsonPathSet* set) {
+  init_arena(&set->keys);
+  set->nodes = NULL;
+  set->node_count = 0;
+  set->node_capacity = 0;
+  set->next_target = NULL;
+  set->path_count = 0;
+  set->path_capacity = 0;
+}
+
+// Appends a childless node, copying the step's key into the set. Returns its
+// position or -1; `nodes` may move.
+static int add_node(JsonPathSet* set, const PathStep* step) {
+  if (set->node_count == set->node_capacity) {
+    int capacity = set->node_capacity > 0 ? set->node_capacity * 2 : INIT_PATH_SET_CAPACITY;
+    STATS_ALLOC(sizeof(PathNode) * capacity);
+    PathNode* nodes = realloc(set->nodes, sizeof(PathNode) * capacity);
+    if (!nodes) {
+      fprintf(stderr, "Error: Can't allocate memory for JsonPathSet!\n");
+      return -1;
+    }
+    set->nodes = nodes;
+    set->node_capacity = capacity;
+  }
+
+  PathNode node = { .step = { 0 }, .first_child = -1, .next_sibling = -1, .first_target = -1 };
+  if (step) {
+    node.step = *step;
+    node.step.key = arena_strndup(&set->keys, step->key, step->length);
+    if (!node.step.key) {
+      return -1;
+    }
+  }
+
+  set->nodes[set->node_count] = node;
+  set->node_count += 1;
+  return set->node_count - 1;
+}
+
+static int find_child(const JsonPathSet* set, const int parent, const PathStep* step) {
+  for (int child = set->nodes[parent].first_child; child >= 0; child = set->nodes[child].next_sibling) {
+    const PathStep* edge = &set->nodes[child].step;
+    if (edge->hash == step->hash && edge->length == step->length && memcmp(edge->key, step->key, step->length) == 0) {
+      return child;
+    }
+  }
+  return -1;
+}
+
+// Returns the id of the path in the set (its slot in the results of
+// json_path_set_eval()), or -1 when out of memory. The set keeps its own copy
+// of the keys, so the path can be freed afterwards.
+int json_path_set_add(JsonPathSet* set, const JsonPath* path) {
+  if (set->node_count == 0 && add_node(set, NULL) < 0) {
+    return -1;
+  }
+
+  if (set->path_count == set->path_capacity) {
+    int capacity = set->path_capacity > 0 ? set->path_capacity * 2 : INIT_PATH_SET_CAPACITY;
+    STATS_ALLOC(sizeof(int) * capacity);
+    int* next_target = realloc(set->next_target, sizeof(int) * capacity);
+    if (!next_target) {
+      fprintf(stderr, "Error: Can't allocate memory for JsonPathSet!\n");
+      return -1;
+    }
+    set->next_target = next_target;
+    set->path_capacity = capacity;
+  }
+
+  int node = 0;
+  for (int i = 0; i < path->count; ++i) {
+    int child = find_child(set, node, &path->steps[i]);
+    if (child < 0) {
+      child = add_node(set, &path->steps[i]);
+      if (child < 0) {
+        return -1;
+      }
+      set->nodes[child].next_sibling = set->nodes[node].first_child;
+      set->nodes[node].first_child = child;
+    }
+    node = child;
+  }
+
+  int id = set->path_count;
+  set->next_target[id] = set->nodes[node].first_target;
+  set->nodes[node].first_target = id;
+  set->path_count += 1;
+  return id;
+}
+
+typedef struct pathVisit {
+  int node;
+  JsonValue* value;
+} PathVisit;
+
+// Same as intern_json_path() for every edge of the trie
+bool intern_json_path_set(JsonPathSet* set, KeyTable* table) {
+  for (int i = 1; i < set->node_count; ++i) {
+    PathStep* step = &set->nodes[i].step;
+    step->interned = key_table_intern(table, step->key, step->length);
+    if (!step->interned) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Fills results[id] for every path of the set: the value it leads to, or NULL.
+// Each node of the trie is visited at most once, so the pending stack never
+// holds more than node_count entries (on the C stack while that fits).
+bool json_path_set_eval(const JsonPathSet* set, JsonValue* root, JsonValue** results) {
+  for (int i = 0; i < set->path_count; ++i) {
+    results[i] = NULL;
+  }
+
+  if (set->node_count == 0 || !root) {
+    return true;
+  }
+
+  PathVisit local[PATH_STACK_SIZE];
+  PathVisit* pending = local;
+  if (set->node_count > PATH_STACK_SIZE) {
+    STATS_ALLOC(sizeof(PathVisit) * set->node_count);
+    pending = malloc(sizeof(PathVisit) * set->node_count);
+    if (!pending) {
+      fprintf(stderr, "Error: Can't allocate memory while evaluating JsonPathSet!\n");
+      return false;
+    }
+  }
+
+  int count = 0;
+  pending[count] = (PathVisit){ .node = 0, .value = root };
+  count += 1;
+
+  while (count > 0) {
+    count -= 1;
+    PathVisit visit = pending[count];
+    const PathNode* node = &set->nodes[visit.node];
+
+    for (int target = node->first_target; target >= 0; target = set->next_target[target]) {
+      results[target] = visit.value;
+    }
+
+    if (visit.value->type != JSON_OBJECT && visit.value->type != JSON_ARRAY) {
+      continue;
+    }
+
+    for (int child = node->first_child; child >= 0; child = set->nodes[child].next_sibling) {
+      JsonValue* value = step_into(visit.value, &set->nodes[child].step);
+      if (value) {
+        pending[count] = (PathVisit){ .node = child, .value = value };
+        count += 1;
+      }
+    }
+  }
+
+  if (pending != local) {
+    free(pending);
+  }
+  return true;
+}
+
+void free_json_path_set(JsonPathSet* set) {
+  free_arena(&set->keys);
+  free(set->nodes);
+  free(set->next_target);
+  init_json_path_set(set);
+}
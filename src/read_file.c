@@ -1,35 +1,212 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #include "read_file.h"
+#include "stats.h"
+
+#define READ_CHUNK_SIZE (64 * 1024)
+
+// Reads a stream of unknown size into a heap buffer followed by INPUT_PADDING '\0' bytes
+static char* read_stream(FILE* stream, size_t* length) {
+  size_t capacity = READ_CHUNK_SIZE;
+  size_t used = 0;
+  STATS_ALLOC(capacity + INPUT_PADDING);
+  char* buffer = malloc(capacity + INPUT_PADDING);
+  if (!buffer) {
+    fprintf(stderr, "Error: Can't allocate memory for file's content!\n");
+    return NULL;
+  }
+
+  size_t read;
+  while ((read = fread(buffer + used, sizeof(char), capacity - used, stream)) > 0) {
+    used += read;
+    if (used == capacity) {
+      STATS_ALLOC(capacity * 2 + INPUT_PADDING);
+      char* grown = realloc(buffer, capacity * 2 + INPUT_PADDING);
+      if (!grown) {
+        fprintf(stderr, "Error: Can't allocate memory for file's content!\n");
+        free(buffer);
+        return NULL;
+      }
+      buffer = grown;
+      capacity *= 2;
+    }
+  }
+
+  if (ferror(stream)) {
+    fprintf(stderr, "Error: Can't read file's content!\n");
+    free(buffer);
+    return NULL;
+  }
+
+  memset(buffer + used, '\0', INPUT_PADDING);
+  *length = used;
+  return buffer;
+}
 
 char* read_file(const char* filename) {
-  FILE* fptr = fopen(filename, "r");
+  FILE* fptr = fopen(filename, "rb");
   if (fptr == NULL) {
     fprintf(stderr, "Error: File '%s' not found!\n", filename);
-    fclose(fptr);
     return NULL;
   }
 
-  fseek(fptr, 0, SEEK_END);
-  long long length = ftell(fptr);
-  rewind(fptr);
+  size_t length = 0;
+  char* buffer = read_stream(fptr, &length);
+  fclose(fptr);
 
-  char* buffer = (char*)malloc(length + 1);
-  if (!buffer) {
-    fprintf(stderr, "Error: Can't allocate memory for file's content!\n");
-    fclose(fptr);
-    return NULL;
+  return buffer;
+}
+
+// Reads a whole file into a caller-owned buffer that grows as needed and is
+// reused across calls, so reading many small files costs no allocation per
+// file once the buffer is large enough. The content is followed by
+// INPUT_PADDING '\0' bytes.
+bool read_file_into(const char* filename, char** buffer, size_t* capacity, size_t* length) {
+  FILE* fptr = fopen(filename, "rb");
+  if (fptr == NULL) {
+    fprintf(stderr, "Error: File '%s' not found!\n", filename);
+    return false;
+  }
+
+  // The data goes straight into `buffer`, so stdio needs no buffer of its own
+  setvbuf(fptr, NULL, _IONBF, 0);
+
+  // Room for the padding and one more byte so a short read shows the end was reached
+  struct stat file_stat;
+  size_t needed = fstat(fileno(fptr), &file_stat) == 0 && file_stat.st_size > 0
+    ? (size_t)file_stat.st_size + INPUT_PADDING + 1
+    : READ_CHUNK_SIZE;
+  size_t used = 0;
+
+  while (true) {
+    if (*capacity < needed) {
+      STATS_ALLOC(needed);
+      char* grown = realloc(*buffer, needed);
+      if (!grown) {
+        fprintf(stderr, "Error: Can't allocate memory for file's content!\n");
+        fclose(fptr);
+        return false;
+      }
+      *buffer = grown;
+      *capacity = needed;
+    }
+
+    used += fread(*buffer + used, sizeof(char), *capacity - INPUT_PADDING - used, fptr);
+    if (used < *capacity - INPUT_PADDING) {
+      break;
+    }
+
+    // The file is larger than it was when stat'ed (or its size is unknown)
+    needed = *capacity * 2;
   }
 
-  fread(buffer, sizeof(char), length, fptr);
-  buffer[length] = '\0';
+  bool failed = ferror(fptr);
   fclose(fptr);
+  if (failed) {
+    fprintf(stderr, "Error: Can't read file '%s'!\n", filename);
+    return false;
+  }
 
-  return buffer;
+  memset(*buffer + used, '\0', INPUT_PADDING);
+  *length = used;
+  return true;
+}
+
+#ifndef _WIN32
+// Maps a regular file read-only. The mapping is placed over an anonymous
+// reservation that is at least INPUT_PADDING bytes longer than the file, so
+// the bytes after the last one are always readable '\0's even when the file
+// ends at (or just before) a page boundary.
+static bool map_regular_file(int fd, size_t length, MappedFile* file) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t reserved = (length + INPUT_PADDING + page - 1) / page * page;
+
+  char* base = mmap(NULL, reserved, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  if (mmap(base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(base, reserved);
+    return false;
+  }
+
+  madvise(base, length, MADV_SEQUENTIAL);
+
+  file->data = base;
+  file->length = length;
+  file->mapped_length = reserved;
+  return true;
+}
+#endif
+
+bool map_file(const char* filename, MappedFile* file) {
+  file->data = NULL;
+  file->length = 0;
+  file->mapped_length = 0;
+
+  if (strcmp(filename, "-") == 0) {
+    file->data = read_stream(stdin, &file->length);
+    return file->data != NULL;
+  }
+
+#ifndef _WIN32
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: File '%s' not found!\n", filename);
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0 &&
+    map_regular_file(fd, (size_t)file_stat.st_size, file)) {
+    close(fd);
+    return true;
+  }
+
+  // Pipes, devices and empty files can't be mapped: fall back to buffered reads
+  FILE* stream = fdopen(fd, "rb");
+  if (!stream) {
+    fprintf(stderr, "Error: Can't read file '%s'!\n", filename);
+    close(fd);
+    return false;
+  }
+
+  file->data = read_stream(stream, &file->length);
+  fclose(stream);
+  return file->data != NULL;
+#else
+  file->data = read_file(filename);
+  if (file->data) {
+    file->length = strlen(file->data);
+  }
+  return file->data != NULL;
+#endif
+}
+
+void unmap_file(MappedFile* file) {
+#ifndef _WIN32
+  if (file->mapped_length > 0) {
+    munmap(file->data, file->mapped_length);
+  } else {
+    free(file->data);
+  }
+#else
+  free(file->data);
+#endif
+
+  file->data = NULL;
+  file->length = 0;
+  file->mapped_length = 0;
 }
 
 bool has_json_extension(const char* filename) {
@@ -43,4 +220,12 @@ bool is_regular_file(const char* path) {
     return 0;
   }
   return S_ISREG(path_stat.st_mode);
-}
\ No newline at end of file
+}
+
+bool is_directory(const char* path) {
+  struct stat path_stat;
+  if (stat(path, &path_stat) != 0) {
+    return 0;
+  }
+  return S_ISDIR(path_stat.st_mode);
+}
@@ -0,0 +1,154 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "simd_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAS_X86_DISPATCH 1
+#endif
+
+// Returns the length of the leading run of `input` that needs no attention from
+// the string tokenizer: no '"', no '\\', no control character (0x00-0x1F,
+// which includes the terminating NUL) and no byte of a multi-byte UTF-8
+// sequence, so plain ASCII runs are validated for free. The vector paths only
+// issue aligned loads, so they never read across a page boundary past the
+// terminator.
+
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+
+static bool is_special(const unsigned char c) {
+  return c == '"' || c == '\\' || c < 0x20 || c >= 0x80;
+}
+
+static size_t scan_scalar(const char* input) {
+  const unsigned char* p = (const unsigned char*)input;
+  size_t i = 0;
+  while (!is_special(p[i])) {
+    i += 1;
+  }
+  return i;
+}
+
+#if defined(HAS_X86_DISPATCH)
+
+__attribute__((target("sse2"))) NO_SANITIZE_ADDRESS
+static size_t scan_sse2(const char* input) {
+  const unsigned char* p = (const unsigned char*)input;
+  size_t i = 0;
+
+  // Scalar head up to the first 16-byte boundary
+  while (((uintptr_t)(p + i) & 15) != 0) {
+    if (is_special(p[i])) {
+      return i;
+    }
+    i += 1;
+  }
+
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control_max = _mm_set1_epi8(0x1F);
+
+  while (true) {
+    __m128i chunk = _mm_load_si128((const __m128i*)(p + i));
+    __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max);
+    __m128i special = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)), control);
+
+    // The sign bit of the chunk itself flags non-ASCII bytes
+    int mask = _mm_movemask_epi8(_mm_or_si128(special, chunk));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+    i += 16;
+  }
+}
+
+__attribute__((target("avx2"))) NO_SANITIZE_ADDRESS
+static size_t scan_avx2(const char* input) {
+  const unsigned char* p = (const unsigned char*)input;
+  size_t i = 0;
+
+  // Scalar head up to the first 32-byte boundary
+  while (((uintptr_t)(p + i) & 31) != 0) {
+    if (is_special(p[i])) {
+      return i;
+    }
+    i += 1;
+  }
+
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i control_max = _mm256_set1_epi8(0x1F);
+
+  while (true) {
+    __m256i chunk = _mm256_load_si256((const __m256i*)(p + i));
+    __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control_max), control_max);
+    __m256i special = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)), control);
+
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(special, chunk));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+    i += 32;
+  }
+}
+
+#endif
+
+static size_t (*scan_impl)(const char*) = NULL;
+static ScanLevel scan_level = SCAN_SCALAR;
+
+ScanLevel detect_scan_level() {
+#if defined(HAS_X86_DISPATCH)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SCAN_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SCAN_SSE2;
+  }
+#endif
+  return SCAN_SCALAR;
+}
+
+// Selects an implementation, capped at what the running CPU supports
+void set_scan_level(ScanLevel level) {
+  ScanLevel supported = detect_scan_level();
+  if (level > supported) {
+    level = supported;
+  }
+
+  switch (level) {
+#if defined(HAS_X86_DISPATCH)
+    case SCAN_AVX2: scan_impl = scan_avx2; break;
+    case SCAN_SSE2: scan_impl = scan_sse2; break;
+#endif
+    default: scan_impl = scan_scalar; level = SCAN_SCALAR; break;
+  }
+
+  scan_level = level;
+}
+
+ScanLevel get_scan_level() {
+  if (!scan_impl) {
+    set_scan_level(detect_scan_level());
+  }
+  return scan_level;
+}
+
+const char* scan_level_to_string(ScanLevel level) {
+  switch (level) {
+    case SCAN_SCALAR: return "scalar";
+    case SCAN_SSE2: return "sse2";
+    case SCAN_AVX2: return "avx2";
+    default: return "unknown";
+  }
+}
+
+size_t scan_string_run(const char* input) {
+  if (!scan_impl) {
+    set_scan_level(detect_scan_level());
+  }
+  return scan_impl(input);
+}
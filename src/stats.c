@@ -0,0 +1,71 @@
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+_Thread_local JsonStats json_stats;
+
+bool json_stats_available() {
+#ifdef JSON_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Returns false when the library was built without JSON_STATS
+bool json_stats_enable(const bool enabled) {
+  json_stats.enabled = enabled && json_stats_available();
+  return json_stats.enabled == enabled;
+}
+
+// Clears the counters, keeping the enabled flag
+void json_stats_reset() {
+  bool enabled = json_stats.enabled;
+  memset(&json_stats, 0, sizeof(json_stats));
+  json_stats.enabled = enabled;
+}
+
+const JsonStats* json_stats_get() {
+  return &json_stats;
+}
+
+uint64_t json_stats_clock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+const char* stats_phase_to_string(StatsPhase phase) {
+  switch (phase) {
+    case STATS_READ: return "read";
+    case STATS_TOKENIZE: return "tokenize";
+    case STATS_PARSE: return "parse";
+    case STATS_FREE: return "free";
+    case STATS_PRINT: return "print";
+    default: return "unknown";
+  }
+}
+
+void print_json_stats(FILE* out, const JsonStats* stats) {
+  fprintf(out, "{\n  \"phases_ns\": {");
+  for (int phase = 0; phase < STATS_PHASE_COUNT; ++phase) {
+    fprintf(out, "%s\"%s\": %llu", phase > 0 ? ", " : "",
+      stats_phase_to_string(phase), (unsigned long long)stats->phase_ns[phase]);
+  }
+
+  fprintf(out, "},\n  \"tokens\": {");
+  bool first = true;
+  for (int type = 0; type < STATS_TOKEN_TYPES; ++type) {
+    if (stats->tokens[type] == 0) {
+      continue;
+    }
+    fprintf(out, "%s\"%s\": %llu", first ? "" : ", ",
+      token_type_to_string(type), (unsigned long long)stats->tokens[type]);
+    first = false;
+  }
+
+  fprintf(out, "},\n  \"allocations\": %llu,\n  \"allocated_bytes\": %llu,\n",
+    (unsigned long long)stats->allocations, (unsigned long long)stats->allocated_bytes);
+  fprintf(out, "  \"max_depth\": %d,\n  \"longest_string\": %d,\n  \"largest_array\": %d,\n  \"largest_object\": %d\n}\n",
+    stats->max_depth, stats->longest_string, stats->largest_array, stats->largest_object);
+}
@@ -0,0 +1,562 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "stream.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "json.h"
+#include "unicode.h"
+#include "key_stack.h"
+#include "stats.h"
+
+#define INIT_STREAM_CAPACITY 16
+#define BUFFER_SIZE 128
+#define STREAM_SLICE_SIZE (1 << 28) // input buffered at a time, so offsets into the buffer fit the tokenizer's ints
+
+void init_json_stream(JsonStream* stream, const JsonEventHandler* handler) {
+  JsonStream fresh = {
+    .state = STREAM_VALUE,
+    .max_depth = 0,
+    .max_token_length = 0,
+    .buffer = NULL,
+    .buffer_length = 0,
+    .buffer_capacity = 0,
+    .scanned = 0,
+    .escaped = false,
+    .line = 1,
+    .column = 0,
+    .frames = NULL,
+    .depth = 0,
+    .frame_capacity = 0,
+    .ended = false,
+    .failed = false,
+  };
+
+  if (handler) {
+    fresh.handler = *handler;
+  }
+
+  *stream = fresh;
+  init_key_stack(&stream->keys);
+  clear_error(&stream->error);
+}
+
+void free_json_stream(JsonStream* stream) {
+  for (int i = 0; i < stream->depth; ++i) {
+    close_key_scope(&stream->keys, &stream->frames[i].keys);
+  }
+
+  free(stream->buffer);
+  free(stream->frames);
+  free_key_stack(&stream->keys);
+
+  stream->buffer = NULL;
+  stream->frames = NULL;
+  stream->buffer_length = stream->buffer_capacity = 0;
+  stream->scanned = 0;
+  stream->depth = stream->frame_capacity = 0;
+}
+
+// Doubles *capacity until it holds `needed` elements
+static bool ensure_capacity(void** data, int* capacity, const int needed, const size_t element_size) {
+  if (needed <= *capacity) {
+    return true;
+  }
+
+  int grown = *capacity > 0 ? *capacity : INIT_STREAM_CAPACITY;
+  while (grown < needed) {
+    grown *= 2;
+  }
+
+  STATS_ALLOC(element_size * grown);
+  void* resized = realloc(*data, element_size * grown);
+  if (!resized) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonStream!\n");
+    return false;
+  }
+
+  *data = resized;
+  *capacity = grown;
+  return true;
+}
+
+// Makes room for `extra` more bytes of input after the buffered ones
+static bool grow_buffer(JsonStream* stream, const size_t extra) {
+  size_t needed = stream->buffer_length + extra + 1;
+  if (needed <= stream->buffer_capacity) {
+    return true;
+  }
+
+  size_t grown = stream->buffer_capacity > 0 ? stream->buffer_capacity : INIT_STREAM_CAPACITY;
+  while (grown < needed) {
+    grown *= 2;
+  }
+
+  STATS_ALLOC(grown);
+  char* resized = realloc(stream->buffer, grown);
+  if (!resized) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonStream!\n");
+    return false;
+  }
+
+  stream->buffer = resized;
+  stream->buffer_capacity = grown;
+  return true;
+}
+
+static bool fail(JsonStream* stream, const char* message, const int line, const int column) {
+  set_error(&stream->error, message, line, column);
+  stream->failed = true;
+  return false;
+}
+
+static bool aborted(JsonStream* stream, const Token* token) {
+  return fail(stream, "Parsing aborted by handler", token->line, token->column);
+}
+
+// Text of a string/number token. Escapes are decoded in place: the token has
+// already been consumed, so its bytes of the buffer are never read again.
+static const char* token_text(JsonStream* stream, const Token* token, int* length) {
+  char* text = stream->buffer + token->offset;
+  *length = token->has_escapes ? unescape_string(text, text, token->length) : token->length;
+  return text;
+}
+
+static void value_complete(JsonStream* stream) {
+  stream->state = stream->depth == 0 ? STREAM_DONE : STREAM_AFTER_VALUE;
+}
+
+static bool open_container(JsonStream* stream, const Token* token, const bool is_object) {
+  int max_depth = stream->max_depth > 0 ? stream->max_depth : DEFAULT_MAX_DEPTH;
+  if (stream->depth >= max_depth) {
+    return fail(stream, "Maximum nesting depth exceeded", token->line, token->column);
+  }
+
+  if (!ensure_capacity((void**)&stream->frames, &stream->frame_capacity, stream->depth + 1, sizeof(StreamFrame))) {
+    return fail(stream, "Out of memory", token->line, token->column);
+  }
+
+  stream->frames[stream->depth] = (StreamFrame){
+    .is_object = is_object,
+    .keys = open_key_scope(&stream->keys),
+  };
+  stream->depth += 1;
+  STATS_MAX(max_depth, stream->depth);
+
+  const JsonEventHandler* handler = &stream->handler;
+  if (is_object) {
+    stream->state = STREAM_OBJECT_FIRST;
+    if (handler->on_start_object && !handler->on_start_object(handler->context)) {
+      return aborted(stream, token);
+    }
+  } else {
+    stream->state = STREAM_ARRAY_FIRST;
+    if (handler->on_start_array && !handler->on_start_array(handler->context)) {
+      return aborted(stream, token);
+    }
+  }
+
+  return true;
+}
+
+static bool close_container(JsonStream* stream, const Token* token) {
+  StreamFrame* frame = &stream->frames[stream->depth - 1];
+  bool is_object = frame->is_object;
+
+  close_key_scope(&stream->keys, &frame->keys);
+  stream->depth -= 1;
+  value_complete(stream);
+
+  const JsonEventHandler* handler = &stream->handler;
+  if (is_object) {
+    if (handler->on_end_object && !handler->on_end_object(handler->context)) {
+      return aborted(stream, token);
+    }
+  } else {
+    if (handler->on_end_array && !handler->on_end_array(handler->context)) {
+      return aborted(stream, token);
+    }
+  }
+
+  return true;
+}
+
+// Same checks and messages as read_object_key() in parser.c
+static bool accept_key(JsonStream* stream, const Token* token) {
+  if (token->type == TOKEN_NUMBER) {
+    return fail(stream, "Expected string as object key", token->line, token->column);
+  }
+
+  if (token->type == TOKEN_INVALID_UTF8) {
+    report_value_expected(&stream->error, token);
+    stream->failed = true;
+    return false;
+  }
+
+  if (token->type != TOKEN_STRING) {
+    return fail(stream, "Property keys must be doublequoted", token->line, token->column);
+  }
+
+  int length;
+  const char* key = token_text(stream, token, &length);
+  StreamFrame* frame = &stream->frames[stream->depth - 1];
+  unsigned int hash = hash_key(key, length);
+
+  if (key_scope_contains(&stream->keys, &frame->keys, hash, key, length)) {
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Duplicate key \"%.*s\" found", length, key);
+    return fail(stream, message, token->line, token->column);
+  }
+
+  if (!key_scope_add(&stream->keys, &frame->keys, hash, key, length)) {
+    return fail(stream, "Out of memory", token->line, token->column);
+  }
+
+  stream->state = STREAM_COLON;
+
+  const JsonEventHandler* handler = &stream->handler;
+  if (handler->on_key && !handler->on_key(handler->context, key, length, token->has_escapes)) {
+    return aborted(stream, token);
+  }
+
+  return true;
+}
+
+// Same checks and messages as parse_json_value_iterative() in parser.c
+static bool accept_value(JsonStream* stream, const Token* token) {
+  const JsonEventHandler* handler = &stream->handler;
+
+  switch (token->type) {
+    case TOKEN_EOF: {
+      return fail(stream, "Empty input - expected a JSON value", token->line, token->column);
+    }
+
+    case TOKEN_LBRACE:
+    case TOKEN_LBRACKET: {
+      return open_container(stream, token, token->type == TOKEN_LBRACE);
+    }
+
+    case TOKEN_RBRACE: {
+      return fail(stream, "Expected '{' at start of object", token->line, token->column);
+    }
+
+    case TOKEN_RBRACKET: {
+      return fail(stream, "Expected '[' at start of array", token->line, token->column);
+    }
+
+    case TOKEN_NULL:
+    case TOKEN_TRUE:
+    case TOKEN_FALSE:
+    case TOKEN_NUMBER:
+    case TOKEN_STRING: {
+      if (stream->depth == 0) {
+        return fail(stream, "Top-level JSON must be an object or array", 1, 1);
+      }
+
+      value_complete(stream);
+
+      bool keep_going = true;
+      int length;
+      const char* text = token_text(stream, token, &length);
+      if (token->type == TOKEN_NULL && handler->on_null) {
+        keep_going = handler->on_null(handler->context);
+      } else if ((token->type == TOKEN_TRUE || token->type == TOKEN_FALSE) && handler->on_bool) {
+        keep_going = handler->on_bool(handler->context, token->type == TOKEN_TRUE);
+      } else if (token->type == TOKEN_NUMBER && handler->on_number) {
+        keep_going = handler->on_number(handler->context, text, length);
+      } else if (token->type == TOKEN_STRING && handler->on_string) {
+        keep_going = handler->on_string(handler->context, text, length, token->has_escapes);
+      }
+
+      return keep_going || aborted(stream, token);
+    }
+
+    default: {
+      report_value_expected(&stream->error, token);
+      stream->failed = true;
+      return false;
+    }
+  }
+}
+
+static bool accept_token(JsonStream* stream, const Token* token) {
+  switch (stream->state) {
+    case STREAM_VALUE: {
+      return accept_value(stream, token);
+    }
+
+    case STREAM_ARRAY_FIRST: {
+      if (token->type == TOKEN_RBRACKET) {
+        return close_container(stream, token);
+      }
+      return accept_value(stream, token);
+    }
+
+    case STREAM_ARRAY_NEXT: {
+      if (token->type == TOKEN_RBRACKET) {
+        return fail(stream, "Trailing comma", token->line, token->column);
+      }
+      return accept_value(stream, token);
+    }
+
+    case STREAM_OBJECT_FIRST: {
+      if (token->type == TOKEN_EOF) {
+        return fail(stream, "Expected comma or closing brace", token->line, token->column);
+      }
+      if (token->type == TOKEN_RBRACE) {
+        return close_container(stream, token);
+      }
+      return accept_key(stream, token);
+    }
+
+    case STREAM_OBJECT_NEXT: {
+      if (token->type == TOKEN_RBRACE) {
+        return fail(stream, "Trailing comma", token->line, token->column);
+      }
+      if (token->type == TOKEN_EOF) {
+        return fail(stream, "Property expected", token->line, token->column);
+      }
+      return accept_key(stream, token);
+    }
+
+    case STREAM_COLON: {
+      if (token->type != TOKEN_COLON) {
+        return fail(stream, "Expected ':' after object key", token->line, token->column);
+      }
+      stream->state = STREAM_VALUE;
+      return true;
+    }
+
+    case STREAM_AFTER_VALUE: {
+      bool is_object = stream->frames[stream->depth - 1].is_object;
+      if (token->type == TOKEN_COMMA) {
+        stream->state = is_object ? STREAM_OBJECT_NEXT : STREAM_ARRAY_NEXT;
+        return true;
+      }
+      if (token->type == (is_object ? TOKEN_RBRACE : TOKEN_RBRACKET)) {
+        return close_container(stream, token);
+      }
+      return fail(stream, is_object ? "Expected ',' or '}' in object" : "Expected ',' or ']' in array",
+        token->line, token->column);
+    }
+
+    case STREAM_DONE: {
+      if (token->type != TOKEN_EOF) {
+        return fail(stream, "End of file expected", token->line, token->column);
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool is_keyword_prefix(const char* text, const int length) {
+  const char* keywords[] = { "true", "false", "null" };
+  for (int i = 0; i < 3; ++i) {
+    if (length < (int)strlen(keywords[i]) && strncmp(text, keywords[i], length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A token that runs into the end of the buffered input may only be the start
+// of a longer one: a number with more digits, an unterminated string, a
+// keyword cut in half. It is lexed again once more input has arrived.
+static bool may_continue(const JsonStream* stream, const Token* token, const int start, const int end) {
+  switch (token->type) {
+    case TOKEN_LBRACE:
+    case TOKEN_RBRACE:
+    case TOKEN_LBRACKET:
+    case TOKEN_RBRACKET:
+    case TOKEN_COLON:
+    case TOKEN_COMMA:
+    case TOKEN_PERIOD:
+      return false;
+
+    default:
+      break;
+  }
+
+  if ((size_t)end >= stream->buffer_length) {
+    return true;
+  }
+
+  // A multi-byte character cut by the end of the chunk looks invalid until the rest arrives
+  if (token->type == TOKEN_INVALID_UTF8 && stream->buffer_length - end < UTF8_MAX_SEQUENCE) {
+    return true;
+  }
+
+  return token->type == TOKEN_INVALID &&
+    is_keyword_prefix(stream->buffer + start, (int)(stream->buffer_length - start));
+}
+
+static bool is_number_byte(const char c) {
+  return isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-';
+}
+
+// Whether the token left at the start of the buffer by the last chunk can be
+// complete now: a string once its closing quote has arrived, a number once a
+// byte that can't belong to it has. Only the bytes added since are scanned,
+// so a token split over many chunks is lexed once, not again on every chunk.
+// Other tokens are a few bytes long and simply lexed again.
+static bool pending_token_ended(JsonStream* stream) {
+  const char* buffer = stream->buffer;
+  size_t position = stream->scanned;
+  if (position == 0) {
+    return true;
+  }
+
+  if (buffer[0] == '"') {
+    bool escaped = stream->escaped;
+    for (; position < stream->buffer_length; ++position) {
+      if (escaped) {
+        escaped = false;
+      } else if (buffer[position] == '\\') {
+        escaped = true;
+      } else if (buffer[position] == '"') {
+        return true;
+      }
+    }
+    stream->escaped = escaped;
+  } else if (is_number_byte(buffer[0])) {
+    for (; position < stream->buffer_length; ++position) {
+      if (!is_number_byte(buffer[position])) {
+        return true;
+      }
+    }
+  } else {
+    return true;
+  }
+
+  stream->scanned = position;
+  return false;
+}
+
+// Whether the tokenizer went past max_token_length bytes of one token, be it
+// complete or cut by the end of the buffer
+static bool is_too_long(const JsonStream* stream, const int length) {
+  return stream->max_token_length > 0 && (size_t)length > stream->max_token_length;
+}
+
+// Runs every complete token of the buffer through the grammar and keeps the
+// unconsumed tail. With `final` set the end of the buffer is the end of input.
+// A pending token over max_token_length is lexed again, so it fails instead
+// of growing the buffer until it ends.
+static bool consume(JsonStream* stream, const bool final) {
+  if (stream->buffer_length == 0) {
+    return true;
+  }
+  if (!final && !pending_token_ended(stream) && !is_too_long(stream, (int)stream->buffer_length)) {
+    return true;
+  }
+  stream->scanned = 0;
+
+  TokenizerState tokenizer = init_tokenizer(stream->buffer);
+  tokenizer.line = stream->line;
+  tokenizer.column = stream->column;
+
+  while (true) {
+    while (isspace(peek(&tokenizer))) {
+      advance(&tokenizer);
+    }
+
+    int start = tokenizer.current_index;
+    if ((size_t)start >= stream->buffer_length) {
+      break;
+    }
+
+    int line = tokenizer.line;
+    int column = tokenizer.column;
+    Token token = next_token(&tokenizer);
+
+    if (is_too_long(stream, tokenizer.current_index - start)) {
+      return fail(stream, "Token too long", line, column + 1);
+    }
+
+    if (!final && may_continue(stream, &token, start, tokenizer.current_index)) {
+      tokenizer.current_index = start;
+      tokenizer.line = line;
+      tokenizer.column = column;
+      stream->scanned = 1; // its first byte
+      stream->escaped = false;
+      break;
+    }
+
+    bool accepted = accept_token(stream, &token);
+    if (!accepted) {
+      return false;
+    }
+  }
+
+  size_t consumed = tokenizer.current_index;
+  if (consumed > 0) {
+    memmove(stream->buffer, stream->buffer + consumed, stream->buffer_length - consumed);
+    stream->buffer_length -= consumed;
+  }
+  stream->buffer[stream->buffer_length] = '\0';
+  stream->line = tokenizer.line;
+  stream->column = tokenizer.column;
+  return true;
+}
+
+static bool report(const JsonStream* stream, ParseError* error) {
+  if (stream->failed && error) {
+    *error = stream->error;
+  }
+  return !stream->failed;
+}
+
+bool json_stream_feed(JsonStream* stream, const char* chunk, const size_t length, ParseError* error) {
+  if (stream->failed || stream->ended) {
+    return report(stream, error);
+  }
+
+  // The tokenizer stops at '\0', so does the text
+  const char* terminator = memchr(chunk, '\0', length);
+  size_t used = terminator ? (size_t)(terminator - chunk) : length;
+  stream->ended = terminator != NULL;
+
+  // Large chunks are taken a slice at a time: the buffer then only outgrows
+  // the tokenizer's int offsets when a single token does
+  size_t fed = 0;
+  do {
+    size_t slice = used - fed < STREAM_SLICE_SIZE ? used - fed : STREAM_SLICE_SIZE;
+    if (stream->buffer_length + slice >= INT_MAX) {
+      fail(stream, "Token too long", stream->line, stream->column + 1);
+      break;
+    }
+
+    if (!grow_buffer(stream, slice)) {
+      fail(stream, "Out of memory", stream->line, stream->column);
+      break;
+    }
+
+    memcpy(stream->buffer + stream->buffer_length, chunk + fed, slice);
+    stream->buffer_length += slice;
+    stream->buffer[stream->buffer_length] = '\0';
+    fed += slice;
+  } while (consume(stream, false) && fed < used);
+
+  return report(stream, error);
+}
+
+bool json_stream_finish(JsonStream* stream, ParseError* error) {
+  if (stream->failed || !consume(stream, true)) {
+    return report(stream, error);
+  }
+
+  Token eof = {
+    .type = TOKEN_EOF,
+    .line = stream->line,
+    .column = stream->column,
+    .offset = 0,
+    .length = 0,
+    .has_escapes = false,
+  };
+  accept_token(stream, &eof);
+  return report(stream, error);
+}
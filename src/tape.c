@@ -0,0 +1,544 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "tape.h"
+#include "stats.h"
+
+#define INIT_TAPE_CAPACITY 64
+#define INIT_STRINGS_CAPACITY 256
+#define INIT_FRAME_CAPACITY 16
+#define COUNT_SHIFT 32
+#define INDEX_MASK 0xFFFFFFFFu
+
+typedef struct tapeFrame {
+  int start;              // index of the container's start entry
+  int count;              // children written so far
+  const JsonValue* value; // json_tape_from_value(): the container being copied
+} TapeFrame;
+
+typedef struct tapeBuilder {
+  JsonTape* tape;
+  ParserState* state;
+  ParseError* error;
+  int depth;
+} TapeBuilder;
+
+void init_json_tape(JsonTape* tape) {
+  tape->entries = NULL;
+  tape->count = 0;
+  tape->capacity = 0;
+  tape->strings = NULL;
+  tape->string_length = 0;
+  tape->string_capacity = 0;
+  tape->max_depth = 0;
+  tape->frames = NULL;
+  tape->frame_capacity = 0;
+  init_parser_scratch(&tape->scratch);
+}
+
+void free_json_tape(JsonTape* tape) {
+  free(tape->entries);
+  free(tape->strings);
+  free(tape->frames);
+  free_parser_scratch(&tape->scratch);
+  init_json_tape(tape);
+}
+
+static uint64_t make_entry(const TapeTag tag, const uint64_t payload) {
+  return ((uint64_t)tag << TAPE_TAG_SHIFT) | payload;
+}
+
+static TapeTag tag_at(const JsonTape* tape, const int index) {
+  return index < tape->count ? (TapeTag)(tape->entries[index] >> TAPE_TAG_SHIFT) : TAPE_NULL;
+}
+
+static uint64_t payload_at(const JsonTape* tape, const int index) {
+  return tape->entries[index] & TAPE_PAYLOAD_MASK;
+}
+
+static bool is_number_tag(const TapeTag tag) {
+  return tag == TAPE_INT64 || tag == TAPE_UINT64 || tag == TAPE_DOUBLE || tag == TAPE_BIG;
+}
+
+// Index of the entry after the value starting at `index`
+static int skip_value(const JsonTape* tape, const int index) {
+  TapeTag tag = tag_at(tape, index);
+  if (tag == TAPE_START_OBJECT || tag == TAPE_START_ARRAY) {
+    return (int)(payload_at(tape, index) & INDEX_MASK);
+  }
+  return is_number_tag(tag) ? index + 2 : index + 1;
+}
+
+static bool append_entry(JsonTape* tape, const uint64_t entry) {
+  if (tape->count == tape->capacity) {
+    if (tape->capacity > INT_MAX / 2) {
+      fprintf(stderr, "Error: Tape is too large!\n");
+      return false;
+    }
+
+    int capacity = tape->capacity > 0 ? tape->capacity * 2 : INIT_TAPE_CAPACITY;
+    STATS_ALLOC(sizeof(uint64_t) * capacity);
+    uint64_t* entries = realloc(tape->entries, sizeof(uint64_t) * capacity);
+    if (!entries) {
+      fprintf(stderr, "Error: Can't reallocate memory while increasing tape's capacity!\n");
+      return false;
+    }
+    tape->entries = entries;
+    tape->capacity = capacity;
+  }
+
+  tape->entries[tape->count] = entry;
+  tape->count += 1;
+  return true;
+}
+
+// Appends an entry whose payload is the offset of `text`, copied into the strings
+static bool append_text(JsonTape* tape, const TapeTag tag, const char* text, const int length) {
+  size_t needed = tape->string_length + sizeof(uint32_t) + length + 1;
+  if (needed > tape->string_capacity) {
+    size_t capacity = tape->string_capacity > 0 ? tape->string_capacity * 2 : INIT_STRINGS_CAPACITY;
+    if (capacity < needed) {
+      capacity = needed;
+    }
+
+    STATS_ALLOC(capacity);
+    char* strings = realloc(tape->strings, capacity);
+    if (!strings) {
+      fprintf(stderr, "Error: Can't reallocate memory while increasing tape's strings!\n");
+      return false;
+    }
+    tape->strings = strings;
+    tape->string_capacity = capacity;
+  }
+
+  size_t offset = tape->string_length;
+  uint32_t prefix = (uint32_t)length;
+  memcpy(tape->strings + offset, &prefix, sizeof(uint32_t));
+  memcpy(tape->strings + offset + sizeof(uint32_t), text, length);
+  tape->strings[offset + sizeof(uint32_t) + length] = '\0';
+  tape->string_length = needed;
+
+  return append_entry(tape, make_entry(tag, offset));
+}
+
+static bool append_number(JsonTape* tape, const char* text, const int length, const JsonNumber number) {
+  TapeTag tag = TAPE_DOUBLE;
+  switch (number.kind) {
+    case NUMBER_INT64: tag = TAPE_INT64; break;
+    case NUMBER_UINT64: tag = TAPE_UINT64; break;
+    case NUMBER_DOUBLE: tag = TAPE_DOUBLE; break;
+    case NUMBER_BIG: tag = TAPE_BIG; break;
+  }
+
+  return append_text(tape, tag, text, length) && append_entry(tape, number.value.unsigned_integer);
+}
+
+static bool push_tape_frame(JsonTape* tape, const int depth, const TapeFrame frame) {
+  if (depth == tape->frame_capacity) {
+    int capacity = tape->frame_capacity > 0 ? tape->frame_capacity * 2 : INIT_FRAME_CAPACITY;
+    STATS_ALLOC(sizeof(TapeFrame) * capacity);
+    TapeFrame* frames = realloc(tape->frames, sizeof(TapeFrame) * capacity);
+    if (!frames) {
+      fprintf(stderr, "Error: Can't reallocate memory while increasing tape's stack!\n");
+      return false;
+    }
+    tape->frames = frames;
+    tape->frame_capacity = capacity;
+  }
+
+  tape->frames[depth] = frame;
+  return true;
+}
+
+// Writes the end entry of the container starting at `start` and points the
+// start entry past it
+static bool close_container(JsonTape* tape, const int start, const int count) {
+  TapeTag end_tag = tag_at(tape, start) == TAPE_START_OBJECT ? TAPE_END_OBJECT : TAPE_END_ARRAY;
+  if (!append_entry(tape, make_entry(end_tag, start))) {
+    return false;
+  }
+
+  uint64_t children = count < TAPE_MAX_COUNT ? count : TAPE_MAX_COUNT;
+  tape->entries[start] = make_entry(tag_at(tape, start), (children << COUNT_SHIFT) | (uint64_t)tape->count);
+  return true;
+}
+
+// Building a tape from the parser's events
+
+static bool build_failed(TapeBuilder* builder) {
+  peek_error(builder->state, builder->error, "Out of memory");
+  return false;
+}
+
+// A value is complete: it is one more child of the container around it
+static bool count_child(TapeBuilder* builder, const bool appended) {
+  if (!appended) {
+    return build_failed(builder);
+  }
+
+  if (builder->depth > 0) {
+    builder->tape->frames[builder->depth - 1].count += 1;
+  }
+  return true;
+}
+
+static bool tape_null(void* context) {
+  TapeBuilder* builder = context;
+  return count_child(builder, append_entry(builder->tape, make_entry(TAPE_NULL, 0)));
+}
+
+static bool tape_bool(void* context, const bool value) {
+  TapeBuilder* builder = context;
+  return count_child(builder, append_entry(builder->tape, make_entry(value ? TAPE_TRUE : TAPE_FALSE, 0)));
+}
+
+static bool tape_number(void* context, const char* text, const int length) {
+  TapeBuilder* builder = context;
+  // The pull tokenizer has just decoded the lookahead
+  JsonNumber number = builder->state->tokenizer ? builder->state->tokenizer->number : decode_number(text, length);
+  return count_child(builder, append_number(builder->tape, text, length, number));
+}
+
+static bool tape_string(void* context, const char* text, const int length, const bool has_escapes) {
+  (void)has_escapes; // the text arrives decoded either way
+  TapeBuilder* builder = context;
+  return count_child(builder, append_text(builder->tape, TAPE_STRING, text, length));
+}
+
+static bool tape_key(void* context, const char* text, const int length, const bool has_escapes) {
+  (void)has_escapes;
+  TapeBuilder* builder = context;
+  return append_text(builder->tape, TAPE_KEY, text, length) ? true : build_failed(builder);
+}
+
+static bool tape_start(TapeBuilder* builder, const TapeTag tag) {
+  JsonTape* tape = builder->tape;
+  TapeFrame frame = { .start = tape->count, .count = 0, .value = NULL };
+
+  if (!push_tape_frame(tape, builder->depth, frame) || !append_entry(tape, make_entry(tag, 0))) {
+    return build_failed(builder);
+  }
+  builder->depth += 1;
+  return true;
+}
+
+static bool tape_end(void* context) {
+  TapeBuilder* builder = context;
+  JsonTape* tape = builder->tape;
+  builder->depth -= 1;
+
+  TapeFrame* frame = &tape->frames[builder->depth];
+  return count_child(builder, close_container(tape, frame->start, frame->count));
+}
+
+static bool tape_start_object(void* context) {
+  return tape_start(context, TAPE_START_OBJECT);
+}
+
+static bool tape_start_array(void* context) {
+  return tape_start(context, TAPE_START_ARRAY);
+}
+
+// Parses a JSON text onto the tape, replacing what it held. Same rules and
+// errors as parse_json_text(); on failure the tape is left empty.
+bool parse_json_tape(JsonTape* tape, const char* input, ParseError* error) {
+  tape->count = 0;
+  tape->string_length = 0;
+
+  TokenizerState tokenizer = init_tokenizer(input);
+  tokenizer.zero_copy = true; // text is copied into the tape anyway
+  ParserState state = init_pull_parser(&tokenizer);
+  state.max_depth = tape->max_depth;
+  state.scratch = &tape->scratch;
+
+  TapeBuilder builder = { .tape = tape, .state = &state, .error = error, .depth = 0 };
+  JsonEventHandler handler = {
+    .context = &builder,
+    .on_null = tape_null,
+    .on_bool = tape_bool,
+    .on_number = tape_number,
+    .on_string = tape_string,
+    .on_key = tape_key,
+    .on_start_object = tape_start_object,
+    .on_end_object = tape_end,
+    .on_start_array = tape_start_array,
+    .on_end_array = tape_end,
+  };
+
+  bool parsed = parse_json_text_events(&state, &handler, error);
+  free_parser_state(&state);
+
+  if (!parsed) {
+    tape->count = 0;
+    tape->string_length = 0;
+  }
+  return parsed;
+}
+
+// Converting between a tree and a tape
+
+// Writes a scalar, or the start entry of a container
+static bool append_value(JsonTape* tape, const JsonValue* value) {
+  switch (value->type) {
+    case JSON_NULL: return append_entry(tape, make_entry(TAPE_NULL, 0));
+    case JSON_BOOL: return append_entry(tape, make_entry(value->boolean ? TAPE_TRUE : TAPE_FALSE, 0));
+    case JSON_NUMBER: return append_number(tape, value->number, value->length, json_number(value));
+    case JSON_STRING: return append_text(tape, TAPE_STRING, value->string, value->length);
+    case JSON_ARRAY: return append_entry(tape, make_entry(TAPE_START_ARRAY, 0));
+    case JSON_OBJECT: return append_entry(tape, make_entry(TAPE_START_OBJECT, 0));
+  }
+  return false;
+}
+
+static int child_count(const JsonValue* container) {
+  return container->type == JSON_OBJECT ? container->object->count : container->array->count;
+}
+
+// Lays a tree out on the tape, replacing what it held. The tree is walked with
+// the tape's own stack, so any depth fits. On failure the tape is left empty.
+bool json_tape_from_value(JsonTape* tape, const JsonValue* root) {
+  tape->count = 0;
+  tape->string_length = 0;
+
+  int depth = 0;
+  const JsonValue* next = root;
+  while (next) {
+    const JsonValue* value = next;
+    next = NULL;
+
+    if (!append_value(tape, value)) {
+      tape->count = 0;
+      tape->string_length = 0;
+      return false;
+    }
+
+    if (value->type == JSON_OBJECT || value->type == JSON_ARRAY) {
+      TapeFrame frame = { .start = tape->count - 1, .count = 0, .value = value };
+      if (!push_tape_frame(tape, depth, frame)) {
+        tape->count = 0;
+        tape->string_length = 0;
+        return false;
+      }
+      depth += 1;
+    }
+
+    // Find the next value to write, closing every container already complete
+    while (depth > 0 && !next) {
+      TapeFrame* frame = &tape->frames[depth - 1];
+      bool written = true;
+      if (frame->count < child_count(frame->value)) {
+        if (frame->value->type == JSON_OBJECT) {
+          const JsonPair* pair = frame->value->object->pairs[frame->count];
+          written = append_text(tape, TAPE_KEY, pair->key, pair->key_length);
+          next = pair->value;
+        } else {
+          next = frame->value->array->elements[frame->count];
+        }
+        frame->count += 1;
+      } else {
+        written = close_container(tape, frame->start, frame->count);
+        depth -= 1;
+      }
+
+      if (!written) {
+        tape->count = 0;
+        tape->string_length = 0;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Reading a tape
+
+// The root value; only meaningful after a successful parse or conversion
+JsonTapeValue json_tape_root(const JsonTape* tape) {
+  JsonTapeValue root = { .tape = tape, .index = 0 };
+  return root;
+}
+
+JsonType json_tape_type(const JsonTapeValue value) {
+  switch (tag_at(value.tape, value.index)) {
+    case TAPE_TRUE:
+    case TAPE_FALSE: return JSON_BOOL;
+    case TAPE_INT64:
+    case TAPE_UINT64:
+    case TAPE_DOUBLE:
+    case TAPE_BIG: return JSON_NUMBER;
+    case TAPE_STRING: return JSON_STRING;
+    case TAPE_START_ARRAY: return JSON_ARRAY;
+    case TAPE_START_OBJECT: return JSON_OBJECT;
+    default: return JSON_NULL;
+  }
+}
+
+bool json_tape_bool(const JsonTapeValue value) {
+  return tag_at(value.tape, value.index) == TAPE_TRUE;
+}
+
+// The decoded value of a number; 0 for anything else
+JsonNumber json_tape_number(const JsonTapeValue value) {
+  JsonNumber number = { .kind = NUMBER_INT64, .value = { .integer = 0 } };
+  switch (tag_at(value.tape, value.index)) {
+    case TAPE_INT64: number.kind = NUMBER_INT64; break;
+    case TAPE_UINT64: number.kind = NUMBER_UINT64; break;
+    case TAPE_DOUBLE: number.kind = NUMBER_DOUBLE; break;
+    case TAPE_BIG: number.kind = NUMBER_BIG; break;
+    default: return number;
+  }
+
+  number.value.unsigned_integer = value.tape->entries[value.index + 1];
+  return number;
+}
+
+// Decoded, NUL-terminated text of a string or key, or the lexeme of a number;
+// NULL for anything else
+const char* json_tape_text(const JsonTapeValue value, int* length) {
+  TapeTag tag = tag_at(value.tape, value.index);
+  if (tag != TAPE_STRING && tag != TAPE_KEY && !is_number_tag(tag)) {
+    *length = 0;
+    return NULL;
+  }
+
+  const char* text = value.tape->strings + payload_at(value.tape, value.index);
+  uint32_t prefix;
+  memcpy(&prefix, text, sizeof(uint32_t));
+  *length = (int)prefix;
+  return text + sizeof(uint32_t);
+}
+
+// Children of an array or members of an object; 0 for anything else
+int json_tape_count(const JsonTapeValue value) {
+  TapeTag tag = tag_at(value.tape, value.index);
+  if (tag != TAPE_START_OBJECT && tag != TAPE_START_ARRAY) {
+    return 0;
+  }
+
+  int count = (int)(payload_at(value.tape, value.index) >> COUNT_SHIFT);
+  if (count < TAPE_MAX_COUNT) {
+    return count;
+  }
+
+  // Saturated: count them
+  count = 0;
+  JsonTapeIterator iterator = json_tape_iterate(value);
+  JsonTapeValue child;
+  while (json_tape_next(&iterator, &child)) {
+    count += 1;
+  }
+  return count;
+}
+
+// An iterator over the children of a container; empty for anything else
+JsonTapeIterator json_tape_iterate(const JsonTapeValue container) {
+  JsonTapeIterator iterator = { .tape = container.tape, .index = container.index + 1, .end = container.index + 1 };
+  TapeTag tag = tag_at(container.tape, container.index);
+  if (tag == TAPE_START_OBJECT || tag == TAPE_START_ARRAY) {
+    iterator.end = skip_value(container.tape, container.index) - 1;
+  }
+  return iterator;
+}
+
+// The next element of an array, or the next value of an object (its key skipped)
+bool json_tape_next(JsonTapeIterator* iterator, JsonTapeValue* value) {
+  if (iterator->index >= iterator->end) {
+    return false;
+  }
+
+  if (tag_at(iterator->tape, iterator->index) == TAPE_KEY) {
+    iterator->index += 1;
+  }
+
+  value->tape = iterator->tape;
+  value->index = iterator->index;
+  iterator->index = skip_value(iterator->tape, iterator->index);
+  return true;
+}
+
+// The next member of an object; false at its end (or for an array)
+bool json_tape_next_member(JsonTapeIterator* iterator, const char** key, int* key_length, JsonTapeValue* value) {
+  if (iterator->index >= iterator->end || tag_at(iterator->tape, iterator->index) != TAPE_KEY) {
+    return false;
+  }
+
+  JsonTapeValue key_entry = { .tape = iterator->tape, .index = iterator->index };
+  *key = json_tape_text(key_entry, key_length);
+
+  value->tape = iterator->tape;
+  value->index = iterator->index + 1;
+  iterator->index = skip_value(iterator->tape, value->index);
+  return true;
+}
+
+// Looks a key up in an object by walking its members (values are jumped over)
+bool json_tape_find(const JsonTapeValue object, const char* key, const int length, JsonTapeValue* value) {
+  JsonTapeIterator iterator = json_tape_iterate(object);
+  const char* member;
+  int member_length;
+  while (json_tape_next_member(&iterator, &member, &member_length, value)) {
+    if (member_length == length && memcmp(member, key, length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reports a value of the tape as events. Text comes from the tape's strings,
+// already decoded: `has_escapes` is always false, the tape doesn't keep it.
+bool json_tape_replay(const JsonTapeValue value, const JsonEventHandler* handler, ParseError* error) {
+  clear_error(error);
+  const JsonTape* tape = value.tape;
+  void* context = handler->context;
+
+  int end = skip_value(tape, value.index);
+  int index = value.index;
+  while (index < end) {
+    JsonTapeValue entry = { .tape = tape, .index = index };
+    TapeTag tag = tag_at(tape, index);
+    int length;
+    const char* text = json_tape_text(entry, &length);
+    bool accepted = true;
+
+    switch (tag) {
+      case TAPE_NULL: accepted = !handler->on_null || handler->on_null(context); break;
+      case TAPE_TRUE:
+      case TAPE_FALSE: accepted = !handler->on_bool || handler->on_bool(context, tag == TAPE_TRUE); break;
+      case TAPE_INT64:
+      case TAPE_UINT64:
+      case TAPE_DOUBLE:
+      case TAPE_BIG: accepted = !handler->on_number || handler->on_number(context, text, length); break;
+      case TAPE_STRING: accepted = !handler->on_string || handler->on_string(context, text, length, false); break;
+      case TAPE_KEY: accepted = !handler->on_key || handler->on_key(context, text, length, false); break;
+      case TAPE_START_OBJECT: accepted = !handler->on_start_object || handler->on_start_object(context); break;
+      case TAPE_END_OBJECT: accepted = !handler->on_end_object || handler->on_end_object(context); break;
+      case TAPE_START_ARRAY: accepted = !handler->on_start_array || handler->on_start_array(context); break;
+      case TAPE_END_ARRAY: accepted = !handler->on_end_array || handler->on_end_array(context); break;
+    }
+
+    if (!accepted) {
+      if (error->message[0] == '\0') {
+        set_error(error, "Replay stopped by the event handler", 0, 0);
+      }
+      return false;
+    }
+
+    index += is_number_tag(tag) ? 2 : 1;
+  }
+
+  return true;
+}
+
+static bool produce_replay(void* source, const JsonEventHandler* handler, ParseError* error) {
+  const JsonTapeValue* value = source;
+  return json_tape_replay(*value, handler, error);
+}
+
+// Builds a tree of a value of the tape, in `arena` when it is set (otherwise
+// on the heap, for free_json_value()). The tree doesn't refer to the tape.
+JsonValue* json_tape_to_value(const JsonTapeValue value, Arena* arena, ParseError* error) {
+  JsonTapeValue source = value;
+  return build_json_tree(arena, produce_replay, &source, error);
+}
@@ -21,6 +21,7 @@ const char* token_type_to_string(TokenType type) {
     case TOKEN_INVALID_HEX: return "INVALID_HEX";
     case TOKEN_INVALID_CONTROL_CHARACTERS: return "INVALID_CONTROL_CHARACTERS";
     case TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER: return "TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER";
+    case TOKEN_INVALID_UTF8: return "INVALID_UTF8";
     default: return "UNKNOWN";
   }
 }
\ No newline at end of file
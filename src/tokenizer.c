@@ -4,7 +4,9 @@
 #include <ctype.h>
 #include <string.h>
 #include "tokenizer.h"
-#include "helper.h"
+#include "simd_scan.h"
+#include "unicode.h"
+#include "stats.h"
 
 // ANSI color codes
 #define RESET   "\033[0m"
@@ -12,58 +14,112 @@
 #define YELLOW  "\033[33m"
 #define CYAN    "\033[36m"
 
-#define BUFFER_SIZE 128
-#define INVALID_ESCAPE_SIZE 3
-#define CHAR_SIZE 2
 #define INIT_TOKEN_CAPACITY 64
 
-Token* tokenize(const char* input, int* token_count) {
-  TokenizerState state = init_tokenizer(input);
+bool tokenize(const char* input, TokenList* list) {
+  list->tokens = NULL;
+  list->capacity = 0;
+  return retokenize(input, list);
+}
 
-  int capacity = INIT_TOKEN_CAPACITY;
-  int count = 0;
-  Token* tokens = (Token*)malloc(capacity * sizeof(Token));
+// Same as tokenize(), into a list whose token buffer is kept from an earlier
+// call: the buffer is only grown, so a caller tokenizing many inputs of about
+// the same size stops allocating after the first.
+bool retokenize(const char* input, TokenList* list) {
+  TokenizerState state = init_tokenizer(input);
 
-  if (!tokens) {
-    printf("Error: Can't reallocate memory when creating tokens!\n");
-    return NULL;
-  }
+  list->input = input;
+  list->count = 0;
 
   while (true) {
     Token token = next_token(&state);
 
-    if (count >= capacity) {
-      capacity *= 2;
-      tokens = (Token*)realloc(tokens, capacity * sizeof(Token));
+    if (list->count >= list->capacity) {
+      int capacity = list->capacity > 0 ? list->capacity * 2 : INIT_TOKEN_CAPACITY;
+      STATS_ALLOC(capacity * sizeof(PackedToken));
+      PackedToken* tokens = realloc(list->tokens, capacity * sizeof(PackedToken));
 
       if (!tokens) {
         printf("Error: Can't reallocate memory while increasing tokens' capacity!\n");
-        return NULL;
+        free_token_list(list);
+        return false;
       }
+
+      list->tokens = tokens;
+      list->capacity = capacity;
     }
 
-    tokens[count] = token;
-    count += 1;
+    list->tokens[list->count] = (PackedToken){
+      .offset = token.offset,
+      .length = token.length,
+      .type = token.type,
+      .note = token.note,
+      .has_escapes = token.has_escapes,
+    };
+    list->count += 1;
     
     if (token.type == TOKEN_EOF) {
       break;
     }
   }
 
-  *(token_count) = count;
-  return tokens;
+  return true;
 }
 
-Token next_token(TokenizerState* state) {
-  char c = peek(state);
+// The token at `index`, with line 0 until it is located
+Token get_token(const TokenList* list, const int index) {
+  const PackedToken* packed = &list->tokens[index];
+  Token token = {
+    .type = packed->type,
+    .line = 0,
+    .column = 0,
+    .offset = packed->offset,
+    .length = packed->length,
+    .has_escapes = packed->has_escapes,
+    .note = packed->note,
+  };
+  return token;
+}
 
-  if (c == '\0') {
-    return make_token(TOKEN_EOF, "", state->line, state->column);
+void free_token_list(TokenList* list) {
+  free(list->tokens);
+  list->tokens = NULL;
+  list->count = 0;
+  list->capacity = 0;
+}
+
+// A token whose line/column are where the tokenizer stands now
+static Token token_here(TokenizerState* state, TokenType type, const TokenNote note) {
+  return make_token(type, note, state->current_index, state->line, state->column);
+}
+
+// Consumes a run of digits, folding them into the mantissa. Digits never
+// include a newline, so only the column moves.
+static int scan_digits(TokenizerState* state, uint64_t* mantissa) {
+  const char* begin = &state->input[state->current_index];
+  const char* p = begin;
+  uint64_t value = *mantissa;
+  while (IS_DIGIT(*p)) {
+    value = value * 10 + (*p - '0');
+    p += 1;
   }
 
-  if (isspace(c)) {
+  int count = (int)(p - begin);
+  state->current_index += count;
+  state->column += count;
+  *mantissa = value;
+  return count;
+}
+
+Token next_token(TokenizerState* state) {
+  while (isspace(peek(state))) {
     advance(state);
-    return next_token(state);
+  }
+
+  char c = peek(state);
+
+  if (c == '\0') {
+    return token_here(state, TOKEN_EOF, NOTE_NONE);
   }
 
   if (
@@ -73,165 +129,172 @@ Token next_token(TokenizerState* state) {
     c == '.' 
   ) {
     advance(state);
-    char str[CHAR_SIZE] = { c, '\0' };
-    const char* text = strdup(str);
     switch (c) {
-      case '{': return make_token(TOKEN_LBRACE, text, state->line, state->column);
-      case '}': return make_token(TOKEN_RBRACE, text, state->line, state->column);
-      case '[': return make_token(TOKEN_LBRACKET, text, state->line, state->column);
-      case ']': return make_token(TOKEN_RBRACKET, text, state->line, state->column);
-      case ':': return make_token(TOKEN_COLON, text, state->line, state->column);
-      case ',': return make_token(TOKEN_COMMA, text, state->line, state->column);
-      case '.': return make_token(TOKEN_PERIOD, text, state->line, state->column);
+      case '{': return token_here(state, TOKEN_LBRACE, NOTE_NONE);
+      case '}': return token_here(state, TOKEN_RBRACE, NOTE_NONE);
+      case '[': return token_here(state, TOKEN_LBRACKET, NOTE_NONE);
+      case ']': return token_here(state, TOKEN_RBRACKET, NOTE_NONE);
+      case ':': return token_here(state, TOKEN_COLON, NOTE_NONE);
+      case ',': return token_here(state, TOKEN_COMMA, NOTE_NONE);
+      case '.': return token_here(state, TOKEN_PERIOD, NOTE_NONE);
     }
   } else if (c == '"') {
     advance(state);
     int start_col = state->column + 1;
 
-    char buffer[BUFFER_SIZE];
-    int buffer_index = 0;
+    int start = state->current_index;
+    bool has_escapes = false;
+
+    while (true) {
+      // Plain ASCII never contains a newline, so a whole run only moves the column
+      int run = (int)scan_string_run(&state->input[state->current_index]);
+      state->current_index += run;
+      state->column += run;
 
-    while (peek(state) != '"' && peek(state) != '\0') {
       char c = peek(state);
+      if (c == '"' || c == '\0') {
+        break;
+      }
 
       if (c == '\\') {
+        has_escapes = true;
         advance(state);
         char esc = peek(state);
 
         if (esc == '"' || esc == '\\' || esc == '/' ||
           esc == 'b' || esc == 'f' || esc == 'n' ||
           esc == 'r' || esc == 't') {
-          buffer[buffer_index] = '\\';
-          buffer_index += 1;
-          
-          buffer[buffer_index] = esc;
-          buffer_index += 1;
-
           advance(state);
         } else if (esc == 'u') {
-          buffer[buffer_index] = '\\';
-          buffer_index += 1;
-          
-          buffer[buffer_index] = 'u';
-          buffer_index += 1;
-
           advance(state);
 
           for (int i = 0; i < 4; ++i) {
             char hex = peek(state);
             if (!isxdigit(hex)) {
-              return make_token(TOKEN_INVALID_ESCAPE, "\\uXXXX", state->line, state->column);
+              return token_here(state, TOKEN_INVALID_ESCAPE, NOTE_UNICODE_ESCAPE);
             }
 
-            buffer[buffer_index] = hex;
-            buffer_index += 1;
-
             advance(state);
           }
         } else {
-          // Invalid escape (e.g. \x)
-          char invalid[INVALID_ESCAPE_SIZE] = {'\\', esc, '\0'};
-          advance(state);
-          return make_token(TOKEN_INVALID_ESCAPE, strdup(invalid), state->line, state->column);
+          // Invalid escape (e.g. \x). A '\0' is the end of the input and is not stepped over
+          if (esc != '\0') {
+            advance(state);
+          }
+          return token_here(state, TOKEN_INVALID_ESCAPE, NOTE_ESCAPE);
+        }
+      } else if ((unsigned char)c >= 0x80) {
+        int sequence = utf8_sequence_length(&state->input[state->current_index]);
+        if (sequence == 0) {
+          return token_here(state, TOKEN_INVALID_UTF8, NOTE_UTF8);
         }
+
+        state->current_index += sequence;
+        state->column += sequence;
       } else if (c == '\t' || (c >= 0 && c <= 0x1F)) {  // 0x1F == 31
         // Unescaped control character (tab, newline)
-        char message[MESSAGE_SIZE];
-        snprintf(message, 64, "INVALID_CONTROL:0x%02X", c);
-        return make_token(TOKEN_INVALID_CONTROL_CHARACTERS, message, state->line, state->column);
+        return token_here(state, TOKEN_INVALID_CONTROL_CHARACTERS, NOTE_CONTROL_CHARACTER);
       } else {
-        buffer[buffer_index] = c;
-        buffer_index += 1;
         advance(state);
       }
     }
 
     if (peek(state) != '"') {
-      return make_token(TOKEN_INVALID, "Unterminated string", state->line, state->column);
+      return token_here(state, TOKEN_INVALID, NOTE_UNTERMINATED_STRING);
     }
 
-    buffer[buffer_index] = '\0';
+    // Escapes are kept raw, so the token's text is exactly the input between the quotes
+    int length = state->current_index - start;
     advance(state);
-    return make_token(TOKEN_STRING, strdup(buffer), state->line, start_col);
+    return make_slice_token(TOKEN_STRING, start, length, has_escapes, state->line, start_col);
   } else if (isdigit(c) || c == '-') {
     int start = state->current_index;
     int start_col = state->column + 1;
 
+    // The value is accumulated while the lexeme is validated, so it is never scanned twice
+    NumberScan scan;
+    init_number_scan(&scan);
+
     if (peek(state) == '-') {
+      scan.negative = true;
       advance(state);
       if (!isdigit(peek(state))) {
-        return make_token(TOKEN_INVALID, strdup("-"), state->line, start_col);
+        return make_token(TOKEN_INVALID, NOTE_MINUS, start + 1, state->line, start_col);
       }
     }
 
     // integer part
     if (peek(state) == '0') {
       advance(state);
+      scan.digits = 1;
 
       if (isdigit(peek(state))) {
-        return make_token(TOKEN_INVALID_LEADING_ZEROES, strdup("0X"), state->line, state->column);
+        return token_here(state, TOKEN_INVALID_LEADING_ZEROES, NOTE_LEADING_ZERO);
       } else if (peek(state) == 'x') {
-        return make_token(TOKEN_INVALID_HEX, strdup("0x"), state->line, state->column);
+        return token_here(state, TOKEN_INVALID_HEX, NOTE_HEX);
       }
     } else if (isdigit(peek(state))) {
-      while (isdigit(peek(state))) {
-        advance(state);
-      }
+      scan.digits += scan_digits(state, &scan.mantissa);
     } else {
       // no digit after optional minus
-      return make_token(TOKEN_INVALID, strdup("-X"), state->line, start_col);
+      return make_token(TOKEN_INVALID, NOTE_MINUS_DIGIT, start + 1, state->line, start_col);
     }
 
     // fractional part (e.g. .123)
     if (peek(state) == '.') {
       advance(state);
       if (!isdigit(peek(state))) {
-        return make_token(TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER, strdup(".X"), state->line, state->column);
-      }
-      while (isdigit(peek(state))) {
-        advance(state);
+        return token_here(state, TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER, NOTE_FRACTION);
       }
+      int count = scan_digits(state, &scan.mantissa);
+      scan.real = true;
+      scan.digits += count;
+      scan.exponent -= count;
     } 
 
     // exponent part (e.g. e+5, E-2)
     if (peek(state) == 'e' || peek(state) == 'E') {
+      scan.real = true;
       advance(state);
 
+      bool negative_exponent = false;
       if (peek(state) == '+' || peek(state) == '-') {
-        advance(state);
+        negative_exponent = advance(state) == '-';
       }
 
       if (!isdigit(peek(state))) {
-        return make_token(TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER, strdup("eX"), state->line, state->column);
+        return token_here(state, TOKEN_INVALID_UNEXPECTED_END_OF_NUMBER, NOTE_EXPONENT);
       }
 
+      int exponent = 0;
       while (isdigit(peek(state))) {
-        advance(state);
+        char digit = advance(state);
+        if (exponent < MAX_EXPONENT) {
+          exponent = exponent * 10 + (digit - '0');
+        }
       }
+      scan.exponent += negative_exponent ? -exponent : exponent;
     }
 
     int end = state->current_index;
     int length = end - start;
-    char* number = strndup(&state->input[start], length);
-
-    return make_token(TOKEN_NUMBER, number, state->line, start_col);
+    state->number = finish_number(&scan, &state->input[start], length);
+    return make_slice_token(TOKEN_NUMBER, start, length, false, state->line, start_col);
   } else if (match_keyword(state, "true")) {
     state->current_index += 4;
     state->column += 4;
-    return make_token(TOKEN_TRUE, "true", state->line, state->column - 4);
+    return make_token(TOKEN_TRUE, NOTE_NONE, state->current_index - 4, state->line, state->column - 4);
   } else if (match_keyword(state, "false")) {
     state->current_index += 5;
     state->column += 5;
-    return make_token(TOKEN_FALSE, "false", state->line, state->column - 5);
+    return make_token(TOKEN_FALSE, NOTE_NONE, state->current_index - 5, state->line, state->column - 5);
   } else if (match_keyword(state, "null")) {
     state->current_index += 4;
     state->column += 4;
-    return make_token(TOKEN_NULL, "null", state->line, state->column - 4);
+    return make_token(TOKEN_NULL, NOTE_NONE, state->current_index - 4, state->line, state->column - 4);
   } else {
-    char str[2] = { c, '\0' };
-    const char* invalid = strdup(str);
     advance(state);
-    return make_token(TOKEN_INVALID, invalid, state->line, state->column);
+    return token_here(state, TOKEN_INVALID, NOTE_UNEXPECTED_CHARACTER);
   }
 }
 
@@ -253,22 +316,48 @@ char advance(TokenizerState* state) {
   return current_char;
 }
 
-Token make_token(TokenType type, const char* value, const int line, const int column) {
+Token make_token(TokenType type, const TokenNote note, const int offset, const int line, const int column) {
+  STATS_TOKEN(type);
   Token token = { 
     .type = type, 
-    .value = strdup(value), 
     .line = line, 
-    .column = column
+    .column = column,
+    .offset = offset,
+    .length = 0,
+    .has_escapes = false,
+    .note = note,
   };
   return token;
 }
 
+// The input is never copied: the token only records where its lexeme is
+Token make_slice_token(TokenType type, const int start, const int length, const bool has_escapes, const int line, const int column) {
+  Token token = {
+    .type = type,
+    .line = line,
+    .column = column,
+    .offset = start,
+    .length = length,
+    .has_escapes = has_escapes,
+    .note = NOTE_NONE,
+  };
+
+  STATS_TOKEN(type);
+  if (type == TOKEN_STRING) {
+    STATS_MAX(longest_string, length);
+  }
+
+  return token;
+}
+
 TokenizerState init_tokenizer(const char* input) {
   TokenizerState state = {
     .input = input,
     .current_index = 0,
     .line = 1,
     .column = 0,
+    .zero_copy = false,
+    .number = { .kind = NUMBER_INT64, .value.integer = 0 },
   };
   return state;
 }
@@ -278,30 +367,151 @@ bool match_keyword(TokenizerState* state, const char* keyword) {
   return strncmp(&state->input[state->current_index], keyword, len) == 0;
 }
 
-void free_tokens(Token* tokens, const int count) {
-  for (int i = 0; i < count; ++i) {
-    free((void*)tokens[i].value);
+// Line of a position and where that line starts, found by counting newlines
+typedef struct textCursor {
+  int offset;
+  int line;
+  int line_start;
+} TextCursor;
+
+static void move_cursor(const char* input, TextCursor* cursor, const int offset) {
+  if (offset < cursor->offset) {
+    *cursor = (TextCursor){ .offset = 0, .line = 1, .line_start = 0 };
+  }
+
+  const char* newline;
+  while ((newline = memchr(&input[cursor->offset], '\n', offset - cursor->offset)) != NULL) {
+    cursor->line += 1;
+    cursor->line_start = (int)(newline - input) + 1;
+    cursor->offset = cursor->line_start;
+  }
+  cursor->offset = offset;
+}
+
+// Strings and numbers are reported one byte into their lexeme, other tokens at their offset
+static int token_position(const Token* token) {
+  return token->type == TOKEN_STRING || token->type == TOKEN_NUMBER ? token->offset + 1 : token->offset;
+}
+
+// Line and column the tokenizer has once it has consumed input[0..offset)
+void locate_offset(const char* input, const int offset, int* line, int* column) {
+  TextCursor cursor = { .offset = 0, .line = 1, .line_start = 0 };
+  move_cursor(input, &cursor, offset);
+  *line = cursor.line;
+  *column = offset - cursor.line_start;
+}
+
+// Fills in the position of a token taken from a TokenList
+Token locate_token(const char* input, Token token) {
+  if (token.line == 0) {
+    locate_offset(input, token_position(&token), &token.line, &token.column);
+  }
+  return token;
+}
+
+static const char* fixed_text(const Token* token) {
+  switch (token->note) {
+    case NOTE_UNTERMINATED_STRING: return "Unterminated string";
+    case NOTE_UNICODE_ESCAPE: return "\\uXXXX";
+    case NOTE_UTF8: return "Invalid UTF-8";
+    case NOTE_MINUS: return "-";
+    case NOTE_MINUS_DIGIT: return "-X";
+    case NOTE_LEADING_ZERO: return "0X";
+    case NOTE_HEX: return "0x";
+    case NOTE_FRACTION: return ".X";
+    case NOTE_EXPONENT: return "eX";
+    default: break;
+  }
+
+  switch (token->type) {
+    case TOKEN_LBRACE: return "{";
+    case TOKEN_RBRACE: return "}";
+    case TOKEN_LBRACKET: return "[";
+    case TOKEN_RBRACKET: return "]";
+    case TOKEN_COLON: return ":";
+    case TOKEN_COMMA: return ",";
+    case TOKEN_PERIOD: return ".";
+    case TOKEN_TRUE: return "true";
+    case TOKEN_FALSE: return "false";
+    case TOKEN_NULL: return "null";
+    default: return "";
   }
-  free(tokens);
 }
 
-void print_token(Token token, const int index, const bool color_enabled) {
+// Text shown for a token: its lexeme, or the diagnostic of an invalid token.
+// Texts that are not in the input are built in `buffer` (TOKEN_TEXT_SIZE bytes).
+const char* token_display_text(const char* input, const Token* token, char* buffer, int* length) {
+  switch (token->note) {
+    case NOTE_NONE: {
+      if (token->type == TOKEN_STRING || token->type == TOKEN_NUMBER) {
+        *length = token->length;
+        return &input[token->offset];
+      }
+      break;
+    }
+
+    case NOTE_UNEXPECTED_CHARACTER: {
+      *length = 1;
+      return &input[token->offset - 1];
+    }
+
+    case NOTE_ESCAPE: {
+      // The offset is past the escaped character, which is NUL when the input ends there
+      *length = input[token->offset - 1] != '\0' ? 2 : 1;
+      return &input[token->offset - 2];
+    }
+
+    case NOTE_CONTROL_CHARACTER: {
+      *length = snprintf(buffer, TOKEN_TEXT_SIZE, "INVALID_CONTROL:0x%02X", input[token->offset]);
+      return buffer;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  const char* text = fixed_text(token);
+  *length = strlen(text);
+  return text;
+}
+
+void print_token(const char* input, Token token, const int index, const bool color_enabled) {
+  token = locate_token(input, token);
+
+  char buffer[TOKEN_TEXT_SIZE];
+  int length;
+  const char* text = token_display_text(input, &token, buffer, &length);
+
   if (color_enabled) {
-    printf("%sToken #%d:%s [%sL%d%s:%sC%d%s] %s%-10s%s | Value: '%s'\n",
+    printf("%sToken #%d:%s [%sL%d%s:%sC%d%s] %s%-10s%s | Value: '%.*s'\n",
       CYAN, index, RESET, 
       YELLOW, token.line, RESET,
       YELLOW, token.column, RESET,
       GREEN, token_type_to_string(token.type), RESET,
-      token.value
+      length, text
     );
   } else {
-    printf("Token #%d: [L%d:C%d] %-10s | Value: '%s'\n",
+    printf("Token #%d: [L%d:C%d] %-10s | Value: '%.*s'\n",
       index, 
       token.line, 
       token.column, 
       token_type_to_string(token.type), 
-      token.value
+      length, text
     );
   }
 
-}
\ No newline at end of file
+}
+
+// Locates the tokens in one pass over the input while printing them
+void print_tokens(const TokenList* list, const bool color_enabled) {
+  TextCursor cursor = { .offset = 0, .line = 1, .line_start = 0 };
+  for (int i = 0; i < list->count; ++i) {
+    Token token = get_token(list, i);
+    int position = token_position(&token);
+    move_cursor(list->input, &cursor, position);
+    token.line = cursor.line;
+    token.column = position - cursor.line_start;
+    print_token(list->input, token, i + 1, color_enabled);
+  }
+}
@@ -0,0 +1,152 @@
+#include <stdbool.h>
+#include <string.h>
+#include "unicode.h"
+
+#define HIGH_SURROGATE_MIN 0xD800
+#define HIGH_SURROGATE_MAX 0xDBFF
+#define LOW_SURROGATE_MIN 0xDC00
+#define LOW_SURROGATE_MAX 0xDFFF
+#define UNICODE_ESCAPE_SIZE 6 // \uXXXX
+
+static bool is_continuation(const unsigned char c) {
+  return (c & 0xC0) == 0x80;
+}
+
+// Length of the well-formed UTF-8 sequence (RFC 3629) starting at a non-ASCII
+// byte, or 0 when it is invalid: stray continuation bytes, overlong forms,
+// surrogates and code points above U+10FFFF. The input is NUL-terminated and a
+// NUL is never a continuation byte, so this never reads past the end.
+int utf8_sequence_length(const char* input) {
+  const unsigned char* p = (const unsigned char*)input;
+  unsigned char lead = p[0];
+
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    return is_continuation(p[1]) ? 2 : 0;
+  }
+
+  if (lead >= 0xE0 && lead <= 0xEF) {
+    unsigned char min = lead == 0xE0 ? 0xA0 : 0x80; // no overlong forms
+    unsigned char max = lead == 0xED ? 0x9F : 0xBF; // no surrogates
+    return p[1] >= min && p[1] <= max && is_continuation(p[2]) ? 3 : 0;
+  }
+
+  if (lead >= 0xF0 && lead <= 0xF4) {
+    unsigned char min = lead == 0xF0 ? 0x90 : 0x80; // no overlong forms
+    unsigned char max = lead == 0xF4 ? 0x8F : 0xBF; // nothing above U+10FFFF
+    return p[1] >= min && p[1] <= max && is_continuation(p[2]) && is_continuation(p[3]) ? 4 : 0;
+  }
+
+  return 0;
+}
+
+int encode_utf8(char* output, const uint32_t code_point) {
+  if (code_point < 0x80) {
+    output[0] = (char)code_point;
+    return 1;
+  }
+
+  if (code_point < 0x800) {
+    output[0] = (char)(0xC0 | (code_point >> 6));
+    output[1] = (char)(0x80 | (code_point & 0x3F));
+    return 2;
+  }
+
+  if (code_point < 0x10000) {
+    output[0] = (char)(0xE0 | (code_point >> 12));
+    output[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+    output[2] = (char)(0x80 | (code_point & 0x3F));
+    return 3;
+  }
+
+  output[0] = (char)(0xF0 | (code_point >> 18));
+  output[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+  output[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+  output[3] = (char)(0x80 | (code_point & 0x3F));
+  return 4;
+}
+
+static uint32_t hex_value(const char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return c - 'A' + 10;
+}
+
+static uint32_t read_hex4(const char* input) {
+  return (hex_value(input[0]) << 12) | (hex_value(input[1]) << 8) |
+    (hex_value(input[2]) << 4) | hex_value(input[3]);
+}
+
+static bool is_unicode_escape(const char* input, const int remaining) {
+  if (remaining < UNICODE_ESCAPE_SIZE || input[0] != '\\' || input[1] != 'u') {
+    return false;
+  }
+
+  for (int i = 2; i < UNICODE_ESCAPE_SIZE; ++i) {
+    char c = input[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Decodes the escape sequences of a string's raw content, already validated by
+// the tokenizer, into `output` and returns the decoded length. Every escape is
+// at least as long as its UTF-8 encoding, so `output` needs at most `length`
+// bytes and may even be `input` itself. Surrogate pairs are combined; a lone
+// surrogate becomes U+FFFD. Runs without escapes are copied with memmove.
+int unescape_string(char* output, const char* input, const int length) {
+  int read = 0;
+  int written = 0;
+
+  while (read < length) {
+    const char* backslash = memchr(input + read, '\\', length - read);
+    int run = backslash ? (int)(backslash - (input + read)) : length - read;
+    if (output + written != input + read) {
+      memmove(output + written, input + read, run);
+    }
+    read += run;
+    written += run;
+
+    if (!backslash) {
+      break;
+    }
+
+    char escape = input[read + 1];
+    read += 2;
+
+    switch (escape) {
+      case 'b': output[written++] = '\b'; break;
+      case 'f': output[written++] = '\f'; break;
+      case 'n': output[written++] = '\n'; break;
+      case 'r': output[written++] = '\r'; break;
+      case 't': output[written++] = '\t'; break;
+      case 'u': {
+        uint32_t code_point = read_hex4(input + read);
+        read += 4;
+
+        if (code_point >= HIGH_SURROGATE_MIN && code_point <= HIGH_SURROGATE_MAX) {
+          uint32_t low = is_unicode_escape(input + read, length - read) ? read_hex4(input + read + 2) : 0;
+          if (low >= LOW_SURROGATE_MIN && low <= LOW_SURROGATE_MAX) {
+            code_point = 0x10000 + ((code_point - HIGH_SURROGATE_MIN) << 10) + (low - LOW_SURROGATE_MIN);
+            read += UNICODE_ESCAPE_SIZE;
+          } else {
+            code_point = REPLACEMENT_CHARACTER;
+          }
+        } else if (code_point >= LOW_SURROGATE_MIN && code_point <= LOW_SURROGATE_MAX) {
+          code_point = REPLACEMENT_CHARACTER;
+        }
+
+        written += encode_utf8(output + written, code_point);
+        break;
+      }
+      default: output[written++] = escape; break; // '"', '\\' and '/'
+    }
+  }
+
+  return written;
+}
@@ -0,0 +1,97 @@
+#include "validate.h"
+#include "tokenizer.h"
+#include "parser.h"
+
+// Follows the nesting of the value being checked, to find the bracket that closes it
+typedef struct valueEnd {
+  ParserState* state;
+  int depth;
+  Token bracket;
+} ValueEnd;
+
+void init_json_validator(JsonValidator* validator) {
+  validator->max_depth = 0;
+  init_parser_scratch(&validator->scratch);
+}
+
+void free_json_validator(JsonValidator* validator) {
+  free_parser_scratch(&validator->scratch);
+  init_json_validator(validator);
+}
+
+static ParserState validator_parser(JsonValidator* validator, TokenizerState* tokenizer) {
+  ParserState state = init_pull_parser(tokenizer);
+  state.max_depth = validator->max_depth;
+  state.scratch = &validator->scratch;
+  return state;
+}
+
+bool validate_json_text(JsonValidator* validator, const char* input, ParseError* error) {
+  TokenizerState tokenizer = init_tokenizer(input);
+  ParserState state = validator_parser(validator, &tokenizer);
+
+  JsonEventHandler handler = { .context = NULL };
+  bool valid = parse_json_text_events(&state, &handler, error);
+  free_parser_state(&state);
+  return valid;
+}
+
+static bool enter_container(void* context) {
+  ValueEnd* end = context;
+  end->depth += 1;
+  return true;
+}
+
+// Called while the closing bracket is still the parser's lookahead
+static bool leave_container(void* context) {
+  ValueEnd* end = context;
+  end->depth -= 1;
+  if (end->depth == 0) {
+    end->bracket = parser_peek(end->state);
+  }
+  return true;
+}
+
+// Checks the one value starting where the tokenizer stands (a scalar, or a
+// container as a whole) and leaves the tokenizer just past it; what follows is
+// not looked at. Positions in errors are the tokenizer's.
+bool validate_json_value(JsonValidator* validator, TokenizerState* tokenizer, ParseError* error) {
+  clear_error(error);
+
+  ParserState state = validator_parser(validator, tokenizer);
+  switch (parser_peek(&state).type) {
+    case TOKEN_NULL:
+    case TOKEN_TRUE:
+    case TOKEN_FALSE:
+    case TOKEN_NUMBER:
+    case TOKEN_STRING: {
+      return true;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  ValueEnd end = { .state = &state, .depth = 0 };
+  JsonEventHandler handler = {
+    .context = &end,
+    .on_start_object = enter_container,
+    .on_end_object = leave_container,
+    .on_start_array = enter_container,
+    .on_end_array = leave_container,
+  };
+
+  bool valid = parse_json_events(&state, &handler, error);
+  free_parser_state(&state);
+  if (!valid) {
+    return false;
+  }
+
+  // The parser has read one token ahead: step back to just past the bracket,
+  // where the tokenizer stood when it produced it
+  tokenizer->current_index = end.bracket.offset;
+  tokenizer->line = end.bracket.line;
+  tokenizer->column = end.bracket.column;
+  return true;
+}
@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+#include "writer.h"
+#include "stats.h"
+
+#define WRITER_INIT_CAPACITY 4096
+#define WRITE_STACK_SIZE 64
+#define NUMBER_BUFFER_SIZE 32
+#define SHORTEST_DOUBLE_DIGITS 15
+#define ROUND_TRIP_DOUBLE_DIGITS 17
+#define BYTE_ONES 0x0101010101010101ULL
+#define BYTE_HIGHS 0x8080808080808080ULL
+
+// Character written after the backslash for each byte that must be escaped,
+// 'u' for the ones only expressible as \u00XX, 0 for bytes copied as they are
+static const char escape_table[256] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  ['"'] = '"',
+  ['\\'] = '\\',
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+typedef struct writeFrame {
+  const JsonValue* container;
+  int next; // index of the next element/pair to write
+} WriteFrame;
+
+static void init_writer(JsonWriter* writer, const WriterStyle style) {
+  writer->buffer = NULL;
+  writer->length = 0;
+  writer->capacity = 0;
+  writer->sink = NULL;
+  writer->sink_context = NULL;
+  writer->fd = -1;
+  writer->style = style;
+  writer->failed = false;
+}
+
+void init_json_writer(JsonWriter* writer, const WriterStyle style) {
+  init_writer(writer, style);
+}
+
+void init_json_writer_sink(JsonWriter* writer, const WriterStyle style, JsonSink sink, void* context) {
+  init_writer(writer, style);
+  writer->sink = sink;
+  writer->sink_context = context;
+}
+
+void init_json_writer_fd(JsonWriter* writer, const WriterStyle style, const int fd) {
+  init_writer(writer, style);
+  writer->fd = fd;
+}
+
+static bool is_streaming(const JsonWriter* writer) {
+  return writer->sink || writer->fd >= 0;
+}
+
+static bool write_fd(const int fd, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    data += written;
+    length -= written;
+  }
+  return true;
+}
+
+// Hands `data` to the sink or the file descriptor
+static bool emit(JsonWriter* writer, const char* data, const size_t length) {
+  bool ok = writer->sink
+    ? writer->sink(writer->sink_context, data, length)
+    : write_fd(writer->fd, data, length);
+  if (!ok) {
+    writer->failed = true;
+  }
+  return ok;
+}
+
+bool json_writer_flush(JsonWriter* writer) {
+  if (writer->failed) {
+    return false;
+  }
+
+  if (!is_streaming(writer) || writer->length == 0) {
+    return true;
+  }
+
+  size_t length = writer->length;
+  writer->length = 0;
+  return emit(writer, writer->buffer, length);
+}
+
+// Slow path of reserve(): a streaming writer flushes its buffer, a collecting
+// writer grows it geometrically.
+static bool make_room(JsonWriter* writer, const size_t needed) {
+  if (writer->failed) {
+    return false;
+  }
+
+  if (is_streaming(writer) && writer->buffer) {
+    if (!json_writer_flush(writer)) {
+      return false;
+    }
+
+    if (needed <= writer->capacity) {
+      return true;
+    }
+  }
+
+  size_t capacity = writer->capacity;
+  if (capacity == 0) {
+    capacity = is_streaming(writer) ? WRITER_BUFFER_SIZE : WRITER_INIT_CAPACITY;
+  }
+  while (capacity < writer->length + needed) {
+    capacity *= 2;
+  }
+
+  STATS_ALLOC(capacity);
+  char* buffer = realloc(writer->buffer, capacity);
+  if (!buffer) {
+    fprintf(stderr, "Error: Can't allocate memory for JsonWriter buffer!\n");
+    writer->failed = true;
+    return false;
+  }
+
+  writer->buffer = buffer;
+  writer->capacity = capacity;
+  return true;
+}
+
+// Makes room for `needed` more bytes. Once the writer has failed, writes may
+// still land in the buffer, but nothing reaches the sink any more.
+static inline bool reserve(JsonWriter* writer, const size_t needed) {
+  return writer->length + needed <= writer->capacity || make_room(writer, needed);
+}
+
+static bool put_char(JsonWriter* writer, const char c) {
+  if (!reserve(writer, 1)) {
+    return false;
+  }
+
+  writer->buffer[writer->length++] = c;
+  return true;
+}
+
+bool json_writer_raw(JsonWriter* writer, const char* data, const size_t length) {
+  // A streaming writer passes pieces larger than its buffer straight through
+  if (is_streaming(writer) && length >= WRITER_BUFFER_SIZE) {
+    return json_writer_flush(writer) && emit(writer, data, length);
+  }
+
+  if (!reserve(writer, length)) {
+    return false;
+  }
+
+  memcpy(writer->buffer + writer->length, data, length);
+  writer->length += length;
+  return true;
+}
+
+// True when any of the 8 bytes at `text` is '"', '\\' or a control character.
+// The borrow trick is only exact for the word as a whole, which is all the
+// caller asks for before falling back to escape_table.
+static inline bool word_needs_escape(const char* text) {
+  uint64_t word;
+  memcpy(&word, text, sizeof(word));
+
+  uint64_t quote = word ^ (BYTE_ONES * '"');
+  uint64_t backslash = word ^ (BYTE_ONES * '\\');
+  uint64_t below_space = (word - BYTE_ONES * 0x20) & ~word;
+  uint64_t zero_quote = (quote - BYTE_ONES) & ~quote;
+  uint64_t zero_backslash = (backslash - BYTE_ONES) & ~backslash;
+  return ((below_space | zero_quote | zero_backslash) & BYTE_HIGHS) != 0;
+}
+
+// Copies runs of plain bytes, skipping 8 at a time while no byte needs
+// attention, and escapes the rest through escape_table
+bool json_writer_string(JsonWriter* writer, const char* text, const size_t length) {
+  const unsigned char* bytes = (const unsigned char*)text;
+  if (!put_char(writer, '"')) {
+    return false;
+  }
+
+  size_t start = 0;
+  for (size_t i = 0; i < length; ++i) {
+    while (i + sizeof(uint64_t) <= length && !word_needs_escape(text + i)) {
+      i += sizeof(uint64_t);
+    }
+    if (i == length) {
+      break;
+    }
+
+    char escape = escape_table[bytes[i]];
+    if (escape == 0) {
+      continue;
+    }
+
+    if (!json_writer_raw(writer, text + start, i - start) || !reserve(writer, 6)) {
+      return false;
+    }
+
+    char* out = writer->buffer + writer->length;
+    out[0] = '\\';
+    out[1] = escape;
+    if (escape == 'u') {
+      out[2] = '0';
+      out[3] = '0';
+      out[4] = hex_digits[bytes[i] >> 4];
+      out[5] = hex_digits[bytes[i] & 0xF];
+      writer->length += 6;
+    } else {
+      writer->length += 2;
+    }
+    start = i + 1;
+  }
+
+  return json_writer_raw(writer, text + start, length - start) && put_char(writer, '"');
+}
+
+// Two digits per division, written backwards from the end of `output`
+static int format_uint64(char* output, uint64_t value) {
+  char digits[NUMBER_BUFFER_SIZE];
+  int position = NUMBER_BUFFER_SIZE;
+
+  while (value >= 100) {
+    int pair = (int)(value % 100) * 2;
+    value /= 100;
+    digits[--position] = digit_pairs[pair + 1];
+    digits[--position] = digit_pairs[pair];
+  }
+
+  if (value >= 10) {
+    digits[--position] = digit_pairs[value * 2 + 1];
+    digits[--position] = digit_pairs[value * 2];
+  } else {
+    digits[--position] = (char)('0' + value);
+  }
+
+  int length = NUMBER_BUFFER_SIZE - position;
+  memcpy(output, digits + position, length);
+  return length;
+}
+
+bool json_writer_uint64(JsonWriter* writer, const uint64_t value) {
+  if (!reserve(writer, NUMBER_BUFFER_SIZE)) {
+    return false;
+  }
+
+  writer->length += format_uint64(writer->buffer + writer->length, value);
+  return true;
+}
+
+bool json_writer_int64(JsonWriter* writer, const int64_t value) {
+  if (!reserve(writer, NUMBER_BUFFER_SIZE)) {
+    return false;
+  }
+
+  char* out = writer->buffer + writer->length;
+  if (value < 0) {
+    *out = '-';
+    writer->length += 1 + format_uint64(out + 1, -(uint64_t)value);
+  } else {
+    writer->length += format_uint64(out, (uint64_t)value);
+  }
+  return true;
+}
+
+// Shortest of %.15g and %.17g that reads back as the same double. JSON has no
+// NaN or infinity, so those are written as null.
+bool json_writer_double(JsonWriter* writer, const double value) {
+  if (!isfinite(value)) {
+    return json_writer_raw(writer, "null", 4);
+  }
+
+  if (!reserve(writer, NUMBER_BUFFER_SIZE)) {
+    return false;
+  }
+
+  char* out = writer->buffer + writer->length;
+  int length = snprintf(out, NUMBER_BUFFER_SIZE, "%.*g", SHORTEST_DOUBLE_DIGITS, value);
+  if (strtod(out, NULL) != value) {
+    length = snprintf(out, NUMBER_BUFFER_SIZE, "%.*g", ROUND_TRIP_DOUBLE_DIGITS, value);
+  }
+
+  writer->length += length;
+  return true;
+}
+
+// Numbers keep the text they were parsed from, which round-trips exactly and
+// is cheaper to copy than to format; only values built without text are formatted.
+static bool write_number(JsonWriter* writer, const JsonValue* value) {
+  if (value->number) {
+    return json_writer_raw(writer, value->number, value->length);
+  }
+
+  switch (value->number_kind) {
+    case NUMBER_INT64: return json_writer_int64(writer, value->numeric.integer);
+    case NUMBER_UINT64: return json_writer_uint64(writer, value->numeric.unsigned_integer);
+    default: return json_writer_double(writer, value->numeric.real);
+  }
+}
+
+static bool write_newline(JsonWriter* writer, const int depth) {
+  if (writer->style != WRITER_PRETTY) {
+    return true;
+  }
+
+  size_t spaces = (size_t)depth * WRITER_INDENT;
+  if (!reserve(writer, spaces + 1)) {
+    return false;
+  }
+
+  writer->buffer[writer->length] = '\n';
+  memset(writer->buffer + writer->length + 1, ' ', spaces);
+  writer->length += spaces + 1;
+  return true;
+}
+
+static int container_count(const JsonValue* value) {
+  return value->type == JSON_ARRAY ? value->array->count : value->object->count;
+}
+
+// Writes a scalar, or the opening bracket of a container (and the closing one
+// too when it is empty). Returns true in `opened` when children follow.
+static bool write_open(JsonWriter* writer, const JsonValue* value, bool* opened) {
+  *opened = false;
+
+  switch (value->type) {
+    case JSON_NULL: return json_writer_raw(writer, "null", 4);
+    case JSON_BOOL: return value->boolean ? json_writer_raw(writer, "true", 4) : json_writer_raw(writer, "false", 5);
+    case JSON_NUMBER: return write_number(writer, value);
+    case JSON_STRING: return json_writer_string(writer, value->string, value->length);
+    default: break;
+  }
+
+  bool is_array = value->type == JSON_ARRAY;
+  if (container_count(value) == 0) {
+    return json_writer_raw(writer, is_array ? "[]" : "{}", 2);
+  }
+
+  *opened = true;
+  return put_char(writer, is_array ? '[' : '{');
+}
+
+// Walks the tree with an explicit stack (on the C stack while it fits, on the
+// heap beyond that), like free_json_value(), so any depth the parser accepted
+// can be written back.
+bool write_json_value(JsonWriter* writer, const JsonValue* value) {
+  WriteFrame local[WRITE_STACK_SIZE];
+  WriteFrame* frames = local;
+  int capacity = WRITE_STACK_SIZE;
+  int depth = 0;
+
+  bool opened;
+  bool ok = write_open(writer, value, &opened);
+  if (ok && opened) {
+    frames[depth++] = (WriteFrame){ .container = value, .next = 0 };
+  }
+
+  while (ok && depth > 0) {
+    WriteFrame* frame = &frames[depth - 1];
+    const JsonValue* container = frame->container;
+
+    if (frame->next == container_count(container)) {
+      ok = write_newline(writer, depth - 1) && put_char(writer, container->type == JSON_ARRAY ? ']' : '}');
+      depth -= 1;
+      continue;
+    }
+
+    if (frame->next > 0 && !put_char(writer, ',')) {
+      ok = false;
+      break;
+    }
+
+    if (!write_newline(writer, depth)) {
+      ok = false;
+      break;
+    }
+
+    const JsonValue* child;
+    if (container->type == JSON_ARRAY) {
+      child = container->array->elements[frame->next];
+    } else {
+      const JsonPair* pair = container->object->pairs[frame->next];
+      const char* separator = writer->style == WRITER_PRETTY ? ": " : ":";
+      if (!json_writer_string(writer, pair->key, pair->key_length) ||
+        !json_writer_raw(writer, separator, strlen(separator))) {
+        ok = false;
+        break;
+      }
+      child = pair->value;
+    }
+    frame->next += 1;
+
+    ok = write_open(writer, child, &opened);
+    if (!ok || !opened) {
+      continue;
+    }
+
+    if (depth == capacity) {
+      STATS_ALLOC(sizeof(WriteFrame) * capacity * 2);
+      WriteFrame* grown = malloc(sizeof(WriteFrame) * capacity * 2);
+      if (!grown) {
+        fprintf(stderr, "Error: Can't allocate memory while writing JsonValue!\n");
+        writer->failed = true;
+        ok = false;
+        break;
+      }
+
+      memcpy(grown, frames, sizeof(WriteFrame) * depth);
+      if (frames != local) {
+        free(frames);
+      }
+      frames = grown;
+      capacity *= 2;
+    }
+
+    frames[depth++] = (WriteFrame){ .container = child, .next = 0 };
+  }
+
+  if (frames != local) {
+    free(frames);
+  }
+
+  return ok && !writer->failed;
+}
+
+void free_json_writer(JsonWriter* writer) {
+  free(writer->buffer);
+  writer->buffer = NULL;
+  writer->length = 0;
+  writer->capacity = 0;
+}